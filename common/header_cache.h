@@ -0,0 +1,250 @@
+// header_cache.h - 两个编译器共用的源文件读取、字符串驻留和头文件预编译缓存
+// 缓存文件格式（EMGPCH1，以头文件内容的 FNV-1a 哈希为键）只在这里定义一份，
+// 两个编译器生成的 .pch 可以互相读取；格式变化时只需修改这里的版本号
+
+#ifndef EMERGING_HEADER_CACHE_H
+#define EMERGING_HEADER_CACHE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+// ---------- 源文件读取 ----------
+// 一次性读入整个源文件，词法分析直接在内存中按指针扫描
+bool readSourceFile(const string& path, string& buf) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    in.seekg(0, ios::end);
+    streamoff size = in.tellg();
+    in.seekg(0, ios::beg);
+    buf.resize(size > 0 ? (size_t)size : 0);
+    if (size > 0 && !in.read(&buf[0], size)) return false;
+    return true;
+}
+
+// ---------- 字符串驻留 ----------
+// 标识符与字符串内容全局驻留，Token、符号表和语法树只保存32位编号
+typedef uint32_t SymId;
+
+class Interner {
+    static const size_t BLOCK_SIZE = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks; // 字符存储，块地址固定，str() 返回的指针始终有效
+    size_t blockUsed;
+    vector<const char*> strs;          // 编号 -> 以NUL结尾的字符串
+    vector<uint32_t> lens;
+    vector<uint32_t> hashes;
+    vector<uint32_t> slots;            // 开放寻址表，存 编号+1，0 表示空槽
+
+    static uint32_t hashBytes(const char* s, size_t n) {
+        uint32_t h = 2166136261u; // FNV-1a
+        for (size_t i = 0; i < n; ++i) {
+            h ^= (unsigned char)s[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    const char* store(const char* s, size_t n) {
+        if (blocks.empty() || blockUsed + n + 1 > BLOCK_SIZE) {
+            blocks.emplace_back(new char[n + 1 > BLOCK_SIZE ? n + 1 : BLOCK_SIZE]);
+            blockUsed = 0;
+        }
+        char* dst = blocks.back().get() + blockUsed;
+        memcpy(dst, s, n);
+        dst[n] = 0;
+        blockUsed += n + 1;
+        return dst;
+    }
+
+    void insertSlot(SymId id) {
+        size_t mask = slots.size() - 1;
+        size_t i = hashes[id] & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = id + 1;
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, 0);
+        for (SymId id = 0; id < strs.size(); ++id) insertSlot(id);
+    }
+
+public:
+    Interner() : blockUsed(0) { rehash(1024); }
+
+    SymId intern(const char* s, size_t n) {
+        uint32_t h = hashBytes(s, n);
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; slots[i]; i = (i + 1) & mask) {
+            SymId id = slots[i] - 1;
+            if (hashes[id] == h && lens[id] == n && memcmp(strs[id], s, n) == 0) return id;
+        }
+        SymId id = (SymId)strs.size();
+        strs.push_back(store(s, n));
+        lens.push_back((uint32_t)n);
+        hashes.push_back(h);
+        if (strs.size() * 2 > slots.size()) rehash(slots.size() * 2);
+        else insertSlot(id);
+        return id;
+    }
+    SymId intern(const string& s) { return intern(s.data(), s.size()); }
+
+    const char* str(SymId id) const { return strs[id]; }
+    size_t length(SymId id) const { return lens[id]; }
+};
+
+Interner interner;
+
+
+// ---------- 头文件与预编译缓存 ----------
+// #include 的头文件只含声明：extern 函数、带常量初值的全局变量、#define 别名和嵌套的 #include。
+// 头文件解析后的声明列表写入同目录的 <头文件>.pch，以头文件内容哈希为键；
+// 之后的编译整块读入缓存直接使用，不再做词法和语法分析。内容或格式不符时重新生成
+enum DeclKind : uint8_t { DECL_EXTERN, DECL_GLOBAL, DECL_ALIAS, DECL_INCLUDE };
+
+struct Decl {
+    DeclKind kind;
+    SymId name;     // DECL_INCLUDE 时为头文件路径
+    SymId target;   // DECL_ALIAS 的目标名
+    int32_t value;  // DECL_GLOBAL 的初值
+};
+
+// 缓存文件布局：PchHeader + declCount 个 PchRecord + 字符串区（名字以偏移和长度引用）
+struct PchHeader {
+    char magic[8];
+    uint64_t contentHash;
+    uint32_t declCount;
+    uint32_t stringBytes;
+};
+
+struct PchRecord {
+    uint8_t kind;
+    uint8_t reserved[3];
+    int32_t value;
+    uint32_t nameOffset, nameLength;
+    uint32_t targetOffset, targetLength;
+};
+
+const char PCH_MAGIC[8] = { 'E', 'M', 'G', 'P', 'C', 'H', '1', 0 }; // 格式变化时修改版本号
+
+string dirName(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+// 进程号，用于生成互不冲突的临时文件名
+#ifdef _WIN32
+#include <process.h>
+inline int processId() { return _getpid(); }
+#else
+#include <unistd.h>
+inline int processId() { return (int)getpid(); }
+#endif
+
+class HeaderCache {
+    vector<string> searchDirs;
+    set<string> included;
+    string buf; // 读缓存文件用，多次复用
+
+public:
+    void addSearchDir(const string& dir) { searchDirs.push_back(dir); }
+
+    // 依次在包含者所在目录和各搜索目录中查找
+    bool resolve(const string& name, const string& fromDir, string& path) const {
+        if (ifstream(fromDir + name)) { path = fromDir + name; return true; }
+        for (const string& dir : searchDirs) {
+            if (ifstream(dir + name)) { path = dir + name; return true; }
+        }
+        return false;
+    }
+
+    // 每个头文件在一次编译中只包含一次
+    bool markIncluded(const string& path) { return included.insert(path).second; }
+
+    static uint64_t hashContent(const string& text) {
+        uint64_t h = 14695981039346656037ull; // FNV-1a 64
+        for (unsigned char c : text) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    bool load(const string& headerPath, uint64_t hash, vector<Decl>& decls) {
+        if (!readSourceFile(headerPath + ".pch", buf) || buf.size() < sizeof(PchHeader)) return false;
+        PchHeader hdr;
+        memcpy(&hdr, buf.data(), sizeof hdr);
+        if (memcmp(hdr.magic, PCH_MAGIC, sizeof hdr.magic) != 0 || hdr.contentHash != hash) return false;
+        size_t recBytes = (size_t)hdr.declCount * sizeof(PchRecord);
+        if (buf.size() != sizeof hdr + recBytes + hdr.stringBytes) return false;
+        const char* recs = buf.data() + sizeof hdr;
+        const char* strs = recs + recBytes;
+        decls.clear();
+        decls.reserve(hdr.declCount);
+        for (uint32_t i = 0; i < hdr.declCount; ++i) {
+            PchRecord r;
+            memcpy(&r, recs + i * sizeof r, sizeof r);
+            if (r.kind > DECL_INCLUDE
+                || (uint64_t)r.nameOffset + r.nameLength > hdr.stringBytes
+                || (uint64_t)r.targetOffset + r.targetLength > hdr.stringBytes) return false;
+            SymId name = interner.intern(strs + r.nameOffset, r.nameLength);
+            SymId target = r.targetLength ? interner.intern(strs + r.targetOffset, r.targetLength) : 0;
+            decls.push_back({ (DeclKind)r.kind, name, target, r.value });
+        }
+        return true;
+    }
+
+    // 写缓存失败（如目录只读）不影响编译
+    void save(const string& headerPath, uint64_t hash, const vector<Decl>& decls) {
+        string strs;
+        vector<PchRecord> recs(decls.size());
+        for (size_t i = 0; i < decls.size(); ++i) {
+            const Decl& d = decls[i];
+            PchRecord& r = recs[i];
+            memset(&r, 0, sizeof r);
+            r.kind = d.kind;
+            r.value = d.value;
+            r.nameOffset = (uint32_t)strs.size();
+            r.nameLength = (uint32_t)interner.length(d.name);
+            strs.append(interner.str(d.name), r.nameLength);
+            if (d.kind == DECL_ALIAS) {
+                r.targetOffset = (uint32_t)strs.size();
+                r.targetLength = (uint32_t)interner.length(d.target);
+                strs.append(interner.str(d.target), r.targetLength);
+            }
+        }
+        PchHeader hdr;
+        memcpy(hdr.magic, PCH_MAGIC, sizeof hdr.magic);
+        hdr.contentHash = hash;
+        hdr.declCount = (uint32_t)decls.size();
+        hdr.stringBytes = (uint32_t)strs.size();
+        // 先写到带进程号的临时文件再改名，并发的编译不会读到写了一半的缓存
+        string path = headerPath + ".pch";
+        string temp = headerPath + "." + to_string(processId()) + ".pch";
+        {
+            ofstream out(temp, ios::binary);
+            if (!out) return;
+            out.write((const char*)&hdr, sizeof hdr);
+            if (!recs.empty()) out.write((const char*)recs.data(), recs.size() * sizeof(PchRecord));
+            out.write(strs.data(), strs.size());
+            if (!out.flush()) {
+                out.close();
+                remove(temp.c_str());
+                return;
+            }
+        }
+        // Windows 上 rename 不覆盖已有文件：先删掉旧缓存，其间别的编译只会找不到缓存而重新解析
+        if (rename(temp.c_str(), path.c_str()) != 0) {
+            remove(path.c_str());
+            if (rename(temp.c_str(), path.c_str()) != 0) remove(temp.c_str());
+        }
+    }
+};
+
+#endif // EMERGING_HEADER_CACHE_H
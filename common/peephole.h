@@ -0,0 +1,793 @@
+// peephole.h - 两个编译器共用的指令序列、窥孔优化与乘除常数的指令选择
+// emerging.cpp 和 i686-Emerging-SourceCode/i686-emerging.cpp 生成同样的 32 位指令，
+// 这一部分只保留一份，改动规则时两边一起生效
+
+#ifndef EMERGING_PEEPHOLE_H
+#define EMERGING_PEEPHOLE_H
+
+#include <ostream>
+#include <string>
+#include <map>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+// ---------- 指令序列与窥孔优化 ----------
+// 函数体先生成为结构化的指令序列，经窥孔优化后再输出为文本。
+// 操作数保存为汇编文本（寄存器名、立即数、[基址+偏移]、标签名），规则按文本匹配。
+// 规则表中每条规则查看从某条指令开始的几条相邻指令，能改写就就地改写，
+// 删除的指令只打上 OP_NONE 标记，扫描结束后统一压缩。
+enum Opcode : uint8_t {
+    OP_NONE,  // 已删除
+    OP_LABEL, // a 为标签名
+    OP_MOV, OP_MOVZX, OP_LEA, OP_ADD, OP_SUB, OP_IMUL, OP_NEG, OP_SHL, OP_SHR, OP_SAR, OP_XOR, OP_CMP, OP_TEST,
+    OP_PUSH, OP_POP, OP_CDQ, OP_IDIV, OP_CALL, OP_JMP, OP_JCC, OP_SETCC, OP_LEAVE, OP_RET,
+    OP_RAW,   // 其他指令，a 为整行文本，窥孔对它不做任何假设
+    OP_COUNT
+};
+
+const char* const OPCODE_NAMES[OP_COUNT] = {
+    "", "", "mov", "movzx", "lea", "add", "sub", "imul", "neg", "shl", "shr", "sar", "xor", "cmp", "test",
+    "push", "pop", "cdq", "idiv", "call", "jmp", "j", "set", "leave", "ret", ""
+};
+
+// 有符号比较的条件码，与取反后的条件码一一对应
+enum Cond : uint8_t { CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE, CC_COUNT };
+const char* const COND_NAMES[CC_COUNT] = { "e", "ne", "l", "le", "g", "ge" };
+const Cond COND_NEGATE[CC_COUNT] = { CC_NE, CC_E, CC_GE, CC_G, CC_LE, CC_L };
+
+struct Instr {
+    Opcode op;
+    Cond cc;        // JCC/SETCC 的条件
+    string a, b, c; // 操作数，按书写顺序，没有的为空
+};
+
+inline void writeInstrs(ostream& out, const vector<Instr>& code) {
+    for (const Instr& in : code) {
+        switch (in.op) {
+        case OP_NONE:  break;
+        case OP_LABEL: out << in.a << ":\n"; break;
+        case OP_RAW:   out << "    " << in.a << "\n"; break;
+        default:
+            out << "    " << OPCODE_NAMES[in.op];
+            if (in.op == OP_JCC || in.op == OP_SETCC) out << COND_NAMES[in.cc];
+            if (!in.a.empty()) out << " " << in.a;
+            if (!in.b.empty()) out << ", " << in.b;
+            if (!in.c.empty()) out << ", " << in.c;
+            out << "\n";
+            break;
+        }
+    }
+}
+
+// 32位通用寄存器及其低8位名字；窥孔按名字识别寄存器
+const char* const GPR_NAMES[8] = { "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp" };
+const char* const GPR_LOW_NAMES[8] = { "al", "bl", "cl", "dl", nullptr, nullptr, nullptr, nullptr };
+
+// 是32位寄存器名时返回编号，否则返回 -1
+inline int gprIndex(const string& s) {
+    for (int r = 0; r < 8; ++r) {
+        if (s == GPR_NAMES[r]) return r;
+    }
+    return -1;
+}
+
+// 操作数分类：内存操作数带方括号，寄存器按名字识别，其余（数字、标签地址）都是立即数
+inline bool isMemOperand(const string& s) { return s.find('[') != string::npos; }
+
+inline bool isRegOperand(const string& s) {
+    for (int r = 0; r < 8; ++r) {
+        if (s == GPR_NAMES[r] || (GPR_LOW_NAMES[r] && s == GPR_LOW_NAMES[r])) return true;
+    }
+    return false;
+}
+
+inline bool isImmOperand(const string& s) { return !s.empty() && !isMemOperand(s) && !isRegOperand(s); }
+
+// 操作数文本中是否出现寄存器 r（含低8位形式），按标识符整体比较
+inline bool mentionsGpr(const string& s, int r) {
+    size_t i = 0, n = s.size();
+    while (i < n) {
+        if (!isalpha((unsigned char)s[i]) && s[i] != '_') { i++; continue; }
+        size_t j = i;
+        while (j < n && (isalnum((unsigned char)s[j]) || s[j] == '_')) j++;
+        size_t len = j - i;
+        if ((len == 3 && s.compare(i, 3, GPR_NAMES[r]) == 0) ||
+            (GPR_LOW_NAMES[r] && len == 2 && s.compare(i, 2, GPR_LOW_NAMES[r]) == 0)) {
+            return true;
+        }
+        i = j;
+    }
+    return false;
+}
+
+// 内存操作数在需要时加 dword（另一侧不是寄存器时 NASM 无法推断宽度）
+inline string sizedOperand(const string& s) {
+    return isMemOperand(s) && s.compare(0, 6, "dword ") != 0 ? "dword " + s : s;
+}
+
+// 两个操作数是否指同一位置（忽略 dword 前缀）
+inline bool sameOperand(const string& x, const string& y) {
+    size_t i = x.compare(0, 6, "dword ") == 0 ? 6 : 0;
+    size_t j = y.compare(0, 6, "dword ") == 0 ? 6 : 0;
+    return x.compare(i, string::npos, y, j, string::npos) == 0;
+}
+
+class Peephole {
+public:
+    typedef bool (*RuleFn)(Peephole& p, size_t i);
+    struct Rule {
+        const char* name;
+        RuleFn apply;
+    };
+    static const Rule RULES[];
+    static const size_t RULE_COUNT;
+    static const size_t WINDOW = 4; // 规则最多同时查看的指令条数
+
+    Peephole() : code(nullptr), hits(RULE_COUNT, 0) {}
+
+    // 规则只删除或改写指令，从不删除标签，因此标签下标在整个过程中有效，
+    // 删除的指令最后统一压缩。某处改写后回退一个窗口重新检查，一趟扫描即可
+    void run(vector<Instr>& instrs) {
+        code = &instrs;
+        indexLabels();
+        size_t i = 0;
+        while (i < code->size()) {
+            bool fired = false;
+            for (size_t r = 0; r < RULE_COUNT && (*code)[i].op != OP_NONE; ++r) {
+                if (RULES[r].apply(*this, i)) {
+                    hits[r]++;
+                    fired = true;
+                }
+            }
+            if (!fired) {
+                i++;
+                continue;
+            }
+            for (size_t k = 0; k < WINDOW - 1; ++k) {
+                size_t j = prev(i);
+                if (j == i) break;
+                i = j;
+            }
+        }
+        compact();
+        code = nullptr;
+    }
+
+    void printStats(ostream& os) const {
+        os << "窥孔优化规则命中次数:\n";
+        for (size_t r = 0; r < RULE_COUNT; ++r) {
+            os << "  " << RULES[r].name << ": " << hits[r] << "\n";
+        }
+    }
+
+    // ---- 供规则使用的查询 ----
+    Instr& at(size_t i) { return (*code)[i]; }
+
+    // i 之后下一条未删除的指令，没有则返回序列长度
+    size_t next(size_t i) const {
+        size_t n = code->size();
+        do { i++; } while (i < n && (*code)[i].op == OP_NONE);
+        return i;
+    }
+
+    // i 之前上一条未删除的指令，没有则返回 i 本身
+    size_t prev(size_t i) const {
+        for (size_t j = i; j-- > 0;) {
+            if ((*code)[j].op != OP_NONE) return j;
+        }
+        return i;
+    }
+
+    bool valid(size_t i) const { return i < code->size(); }
+    void remove(size_t i) { (*code)[i].op = OP_NONE; }
+
+    // 指令是否读取寄存器 r（部分写入视为读取，因为其余位保持不变）
+    static bool readsGpr(const Instr& in, int r) {
+        switch (in.op) {
+        case OP_LABEL: case OP_JMP: case OP_JCC: case OP_NONE:
+            return false;
+        case OP_MOV: case OP_MOVZX: case OP_LEA: case OP_POP:
+            return (isMemOperand(in.a) && mentionsGpr(in.a, r)) || mentionsGpr(in.b, r);
+        case OP_SETCC:
+            return mentionsGpr(in.a, r);
+        case OP_XOR:
+            if (in.a == in.b) return false; // 清零惯用法
+            return mentionsGpr(in.a, r) || mentionsGpr(in.b, r);
+        case OP_IMUL:
+            if (in.b.empty()) return r == 0 || mentionsGpr(in.a, r); // 单操作数：edx:eax = eax * a
+            if (!in.c.empty()) {
+                return (isMemOperand(in.a) && mentionsGpr(in.a, r)) || mentionsGpr(in.b, r);
+            }
+            return mentionsGpr(in.a, r) || mentionsGpr(in.b, r);
+        case OP_CDQ:   return r == 0;
+        case OP_IDIV:  return r == 0 || r == 3 || mentionsGpr(in.a, r);
+        case OP_LEAVE: return r == 6 || r == 7;
+        case OP_RET:   return r == 0 || r == 7;
+        case OP_PUSH:  return r == 7 || mentionsGpr(in.a, r);
+        case OP_CALL: case OP_RAW:
+            return true; // 不了解其行为，一律视为读取
+        default:
+            return mentionsGpr(in.a, r) || mentionsGpr(in.b, r) || mentionsGpr(in.c, r);
+        }
+    }
+
+    // 指令是否完整改写寄存器 r
+    static bool writesGpr(const Instr& in, int r) {
+        switch (in.op) {
+        case OP_IMUL:
+            if (in.b.empty()) return r == 0 || r == 3;
+            return gprIndex(in.a) == r;
+        case OP_MOV: case OP_MOVZX: case OP_LEA: case OP_POP: case OP_ADD: case OP_SUB:
+        case OP_NEG: case OP_SHL: case OP_SHR: case OP_SAR: case OP_XOR:
+            return gprIndex(in.a) == r;
+        case OP_CDQ:   return r == 3;
+        case OP_IDIV:  return r == 0 || r == 3;
+        case OP_LEAVE: return r == 6 || r == 7;
+        default:       return false;
+        }
+    }
+
+    // 指令 i 之后寄存器 r 的值是否不再被使用。沿控制流向后查看有限条指令，
+    // 跳转跟随到目标标签，条件跳转两条路径都要满足；看不清的一律按活跃处理
+    bool regDeadAfter(size_t i, int r, int budget = 24) const {
+        for (size_t j = next(i); j < code->size(); j = next(j)) {
+            if (--budget < 0) return false;
+            const Instr& in = (*code)[j];
+            if (in.op == OP_JMP || in.op == OP_JCC) {
+                auto it = labels.find(in.a);
+                if (it == labels.end()) return false;
+                if (in.op == OP_JMP) { j = it->second; continue; }
+                if (!regDeadAfter(it->second, r, budget)) return false;
+                continue;
+            }
+            if (readsGpr(in, r)) return false;
+            if (writesGpr(in, r) || in.op == OP_RET) return true;
+        }
+        return false;
+    }
+
+    // 指令 i 之后标志位是否不再被使用。代码生成器从不让标志位跨越标签或跳转存活
+    bool flagsDeadAfter(size_t i) const {
+        for (size_t j = next(i); j < code->size(); j = next(j)) {
+            switch ((*code)[j].op) {
+            case OP_JCC: case OP_SETCC: case OP_RAW:
+                return false;
+            case OP_LABEL: case OP_JMP: case OP_RET: case OP_CALL:
+            case OP_ADD: case OP_SUB: case OP_IMUL: case OP_NEG: case OP_XOR: case OP_CMP: case OP_TEST:
+            case OP_SHL: case OP_SHR: case OP_SAR:
+                return true;
+            default:
+                break;
+            }
+        }
+        return true;
+    }
+
+    // 从 i 开始（跳过标签）是否会落到标签 name
+    bool fallsInto(size_t i, const string& name) const {
+        for (size_t j = i; j < code->size() && ((*code)[j].op == OP_LABEL || (*code)[j].op == OP_NONE); ++j) {
+            if ((*code)[j].op == OP_LABEL && (*code)[j].a == name) return true;
+        }
+        return false;
+    }
+
+private:
+    vector<Instr>* code;
+    vector<uint64_t> hits;
+    map<string, size_t> labels;      // 标签名 -> 下标，run 开始时建立
+
+    void indexLabels() {
+        labels.clear();
+        for (size_t i = 0; i < code->size(); ++i) {
+            if ((*code)[i].op == OP_LABEL) labels[(*code)[i].a] = i;
+        }
+    }
+
+    void compact() {
+        size_t n = 0;
+        for (size_t i = 0; i < code->size(); ++i) {
+            if ((*code)[i].op != OP_NONE) {
+                if (n != i) (*code)[n] = move((*code)[i]);
+                n++;
+            }
+        }
+        code->resize(n);
+    }
+};
+
+// ---- 窥孔规则 ----
+// 每条规则检查以 i 开头的窗口，命中时改写并返回 true。新增规则只需写一个函数并加入 RULES
+
+// push X; pop Y  =>  mov Y, X（X 与 Y 相同则都删掉）
+inline bool rulePushPop(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (p.at(i).op != OP_PUSH || !p.valid(j) || p.at(j).op != OP_POP) return false;
+    Instr& push = p.at(i);
+    Instr& pop = p.at(j);
+    if (push.a == pop.a) {
+        p.remove(i);
+        p.remove(j);
+        return true;
+    }
+    if (isMemOperand(push.a) && isMemOperand(pop.a)) return false;
+    if (mentionsGpr(push.a, 7) || mentionsGpr(pop.a, 7)) return false; // 以 esp 寻址时地址会随之变化
+    pop.op = OP_MOV;
+    pop.b = push.a;
+    if (isImmOperand(push.a)) pop.a = sizedOperand(pop.a);
+    p.remove(i);
+    return true;
+}
+
+// mov X, Y; mov Y, X  =>  删除第二条（其中一侧是寄存器，另一侧不以它寻址）
+inline bool ruleStoreLoad(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    const Instr& st = p.at(i);
+    const Instr& ld = p.at(j);
+    if (st.op != OP_MOV || ld.op != OP_MOV || !sameOperand(st.a, ld.b) || !sameOperand(st.b, ld.a)) return false;
+    int r = gprIndex(st.b);
+    const string* other = &st.a;
+    if (r < 0) {
+        r = gprIndex(st.a);
+        other = &st.b;
+    }
+    if (r < 0 || mentionsGpr(*other, r)) return false;
+    p.remove(j);
+    return true;
+}
+
+// mov X, X  =>  删除
+inline bool ruleSelfMove(Peephole& p, size_t i) {
+    const Instr& in = p.at(i);
+    if (in.op != OP_MOV || in.a != in.b) return false;
+    p.remove(i);
+    return true;
+}
+
+// mov R, X 之后紧接着的指令不读 R 就改写 R  =>  删除这条 mov
+inline bool ruleDeadMove(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    const Instr& in = p.at(i);
+    if (in.op != OP_MOV || !p.valid(j)) return false;
+    int r = gprIndex(in.a);
+    if (r < 0 || Peephole::readsGpr(p.at(j), r) || !Peephole::writesGpr(p.at(j), r)) return false;
+    p.remove(i);
+    return true;
+}
+
+// mov T, X; mov Y, T 或 push T（此后 T 不再使用） =>  mov Y, X 或 push X
+inline bool ruleForwardCopy(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    const Instr& ld = p.at(i);
+    Instr& use = p.at(j);
+    int t = gprIndex(ld.a);
+    if (ld.op != OP_MOV || t < 0) return false;
+    if (use.op == OP_PUSH && use.a == ld.a) {
+        if (!p.regDeadAfter(j, t)) return false;
+        use.a = sizedOperand(ld.b);
+        p.remove(i);
+        return true;
+    }
+    if (use.op != OP_MOV || use.b != ld.a) return false;
+    if (mentionsGpr(use.a, t) || (isMemOperand(use.a) && isMemOperand(ld.b))) return false;
+    if (!p.regDeadAfter(j, t)) return false;
+    use.b = ld.b;
+    if (isImmOperand(ld.b)) use.a = sizedOperand(use.a);
+    p.remove(i);
+    return true;
+}
+
+// mov T, X; op T, Y; mov X, T（此后 T 不再使用） =>  op X, Y
+// 变量在寄存器中时 x = x + 1 之类的语句就只剩一条指令
+inline bool ruleFoldThroughTemp(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    size_t k = p.next(j);
+    if (!p.valid(k)) return false;
+    const Instr& ld = p.at(i);
+    Instr& op = p.at(j);
+    const Instr& st = p.at(k);
+    if (ld.op != OP_MOV || st.op != OP_MOV || !sameOperand(st.a, ld.b) || st.b != ld.a) return false;
+    if (op.op != OP_ADD && op.op != OP_SUB && op.op != OP_IMUL) return false;
+    int t = gprIndex(ld.a);
+    const string& x = ld.b;
+    if (t < 0 || op.a != ld.a || isImmOperand(x)) return false;
+    bool xMem = isMemOperand(x);
+    if (op.op == OP_IMUL) {
+        // 乘法的目的操作数必须是寄存器；三操作数形式要求被乘数就是 T；单操作数形式不参与
+        if (xMem || op.b.empty()) return false;
+        if (!op.c.empty() && op.b != ld.a) return false;
+        if (op.c.empty() && mentionsGpr(op.b, t)) return false;
+    }
+    else if (mentionsGpr(op.b, t) || (xMem && isMemOperand(op.b))) {
+        return false;
+    }
+    if (!p.regDeadAfter(k, t)) return false;
+    op.a = xMem && isImmOperand(op.b) ? sizedOperand(x) : x;
+    if (op.op == OP_IMUL && !op.c.empty()) op.b = x;
+    p.remove(i);
+    p.remove(k);
+    return true;
+}
+
+// mov T, X; op R, T 或 cmp T, Y（此后 T 不再使用） =>  直接以 X 作操作数
+inline bool ruleForwardOperand(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    const Instr& ld = p.at(i);
+    Instr& use = p.at(j);
+    int t = gprIndex(ld.a);
+    if (ld.op != OP_MOV || t < 0) return false;
+    const string& x = ld.b;
+    bool xMem = isMemOperand(x), xImm = isImmOperand(x);
+    if (use.op == OP_CMP && use.a == ld.a && !mentionsGpr(use.b, t) && !xImm) {
+        if (xMem && isMemOperand(use.b)) return false;
+        if (!p.regDeadAfter(j, t)) return false;
+        use.a = xMem && isImmOperand(use.b) ? sizedOperand(x) : x;
+        p.remove(i);
+        return true;
+    }
+    bool binary = use.op == OP_ADD || use.op == OP_SUB || use.op == OP_CMP ||
+                  (use.op == OP_IMUL && use.c.empty() && !xImm);
+    if (!binary || use.b != ld.a || mentionsGpr(use.a, t)) return false;
+    if (xMem && isMemOperand(use.a)) return false;
+    if (xImm && isMemOperand(use.a)) return false;
+    if (!p.regDeadAfter(j, t)) return false;
+    use.b = x;
+    p.remove(i);
+    return true;
+}
+
+// cmp R, 0  =>  test R, R
+inline bool ruleCompareZero(Peephole& p, size_t i) {
+    Instr& in = p.at(i);
+    if (in.op != OP_CMP || in.b != "0" || gprIndex(in.a) < 0) return false;
+    in.op = OP_TEST;
+    in.b = in.a;
+    return true;
+}
+
+// setcc r8; movzx R, r8; test R, R; je/jne L（此后 R 不再使用） =>  直接按原条件跳转
+inline bool ruleSetccBranch(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    size_t k = p.next(j);
+    if (!p.valid(k)) return false;
+    size_t l = p.next(k);
+    if (!p.valid(l)) return false;
+    const Instr& set = p.at(i);
+    const Instr& ext = p.at(j);
+    const Instr& test = p.at(k);
+    Instr& jcc = p.at(l);
+    if (set.op != OP_SETCC || ext.op != OP_MOVZX || ext.b != set.a) return false;
+    if (test.op != OP_TEST || test.a != ext.a || test.b != ext.a) return false;
+    if (jcc.op != OP_JCC || (jcc.cc != CC_E && jcc.cc != CC_NE)) return false;
+    int r = gprIndex(ext.a);
+    if (r < 0 || !p.regDeadAfter(l, r)) return false;
+    jcc.cc = jcc.cc == CC_NE ? set.cc : COND_NEGATE[set.cc];
+    p.remove(i);
+    p.remove(j);
+    p.remove(k);
+    return true;
+}
+
+// jmp L 后面（隔着若干标签）就是 L  =>  删除 jmp
+inline bool ruleJumpToNext(Peephole& p, size_t i) {
+    const Instr& in = p.at(i);
+    if (in.op != OP_JMP || !p.fallsInto(p.next(i), in.a)) return false;
+    p.remove(i);
+    return true;
+}
+
+// jcc L1; jmp L2; L1:  =>  j!cc L2; L1:
+inline bool ruleBranchOverJump(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    if (!p.valid(j)) return false;
+    Instr& jcc = p.at(i);
+    const Instr& jmp = p.at(j);
+    if (jcc.op != OP_JCC || jmp.op != OP_JMP || !p.fallsInto(p.next(j), jcc.a)) return false;
+    jcc.cc = COND_NEGATE[jcc.cc];
+    jcc.a = jmp.a;
+    p.remove(j);
+    return true;
+}
+
+// jmp/ret 之后直到下一个标签的指令不可达  =>  删除
+inline bool ruleUnreachable(Peephole& p, size_t i) {
+    size_t j = p.next(i);
+    Opcode op = p.at(i).op;
+    if ((op != OP_JMP && op != OP_RET) || !p.valid(j) || p.at(j).op == OP_LABEL) return false;
+    p.remove(j);
+    return true;
+}
+
+// add/sub R, 0（之后不用标志位） =>  删除
+inline bool ruleAddZero(Peephole& p, size_t i) {
+    const Instr& in = p.at(i);
+    if ((in.op != OP_ADD && in.op != OP_SUB) || in.b != "0" || !p.flagsDeadAfter(i)) return false;
+    p.remove(i);
+    return true;
+}
+
+// mov R, 0（之后不用标志位） =>  xor R, R
+inline bool ruleZeroIdiom(Peephole& p, size_t i) {
+    Instr& in = p.at(i);
+    if (in.op != OP_MOV || in.b != "0" || gprIndex(in.a) < 0 || !p.flagsDeadAfter(i)) return false;
+    in.op = OP_XOR;
+    in.b = in.a;
+    return true;
+}
+
+// ---- 基本块内的存储转发与死存储 ----
+// 语言里没有指针，内存操作数只有变量槽 [ebp±N] 和全局变量，文本不同就互不重叠。
+// 以 esp 寻址的操作数随压栈改变含义，不参与。标签、跳转、调用、返回和原样输出的指令
+// 结束基本块，被调函数可能读写全局变量，分析到此为止
+
+inline bool isTrackedMem(const string& s) { return isMemOperand(s) && !mentionsGpr(s, 7); }
+
+inline bool endsBlock(Opcode op) {
+    return op == OP_LABEL || op == OP_JMP || op == OP_JCC || op == OP_CALL || op == OP_RAW ||
+           op == OP_LEAVE || op == OP_RET;
+}
+
+// 指令是否读取内存操作数 m（目的操作数为 m 的运算也读取它）
+inline bool readsMem(const Instr& in, const string& m) {
+    switch (in.op) {
+    case OP_MOV: case OP_MOVZX:
+        return sameOperand(in.b, m);
+    case OP_LEA: case OP_POP: case OP_SETCC:
+        return false;
+    default:
+        return sameOperand(in.a, m) || sameOperand(in.b, m) || sameOperand(in.c, m);
+    }
+}
+
+// 指令是否改写寄存器 r 的任何部分（含 setcc al 之类的部分写入）
+inline bool clobbersGpr(const Instr& in, int r) {
+    if (Peephole::writesGpr(in, r)) return true;
+    switch (in.op) {
+    case OP_PUSH: case OP_POP:
+        return r == 7 || (in.op == OP_POP && mentionsGpr(in.a, r) && !isMemOperand(in.a));
+    case OP_CMP: case OP_TEST: case OP_IDIV: case OP_CDQ:
+        return false;
+    default:
+        return !isMemOperand(in.a) && mentionsGpr(in.a, r);
+    }
+}
+
+// 指令是否改写内存操作数 m 的地址所用的寄存器
+inline bool clobbersAddress(const Instr& in, const string& m) {
+    for (int r = 0; r < 8; ++r) {
+        if (mentionsGpr(m, r) && clobbersGpr(in, r)) return true;
+    }
+    return false;
+}
+
+// mov M, V 或 mov V, M（V 为寄存器或立即数）之后 M 与 V 相等，直到基本块结束或其中之一被改写；
+// 其间读 M 的指令改读 V，重新装入 V 的 mov 直接删除。每次改一处，回退后由下一轮继续
+inline bool ruleStoreForward(Peephole& p, size_t i) {
+    const Instr& def = p.at(i);
+    if (def.op != OP_MOV) return false;
+    string m, v;
+    if (isTrackedMem(def.a) && (gprIndex(def.b) >= 0 || isImmOperand(def.b))) {
+        m = def.a;
+        v = def.b;
+    }
+    else if (gprIndex(def.a) >= 0 && isTrackedMem(def.b) && !mentionsGpr(def.b, gprIndex(def.a))) {
+        m = def.b;
+        v = def.a;
+    }
+    else {
+        return false;
+    }
+    int r = gprIndex(v); // 立即数时为 -1
+    int budget = 24;
+    for (size_t j = p.next(i); p.valid(j) && --budget >= 0; j = p.next(j)) {
+        Instr& in = p.at(j);
+        if (endsBlock(in.op)) return false;
+        if (readsMem(in, m)) {
+            bool srcB = sameOperand(in.b, m) && !isMemOperand(in.a) && in.c.empty();
+            if (in.op == OP_MOV && gprIndex(in.a) >= 0) {
+                if (in.a == v) p.remove(j);
+                else in.b = v;
+            }
+            else if ((in.op == OP_ADD || in.op == OP_SUB || in.op == OP_XOR || in.op == OP_CMP ||
+                      in.op == OP_TEST || in.op == OP_IMUL) && srcB) {
+                in.b = v;
+            }
+            else if (in.op == OP_PUSH) {
+                in.a = v;
+            }
+            else if (r >= 0 && (in.op == OP_CMP || in.op == OP_TEST || in.op == OP_IDIV ||
+                                (in.op == OP_IMUL && in.b.empty())) && sameOperand(in.a, m)) {
+                in.a = v;
+            }
+            else if (r >= 0 && in.op == OP_IMUL && !in.c.empty() && sameOperand(in.b, m)) {
+                in.b = v;
+            }
+            else {
+                return false;
+            }
+            return true;
+        }
+        if (sameOperand(in.a, m) || clobbersAddress(in, m)) return false;
+        if (r >= 0 && clobbersGpr(in, r)) return false;
+    }
+    return false;
+}
+
+// mov M, V 之后基本块内 M 未被读取就被整体改写，或 M 是局部变量槽 [ebp-N] 而函数随即返回  =>  删除
+inline bool ruleDeadStore(Peephole& p, size_t i) {
+    const Instr& st = p.at(i);
+    if (st.op != OP_MOV || !isTrackedMem(st.a)) return false;
+    const string& m = st.a;
+    bool local = mentionsGpr(m, 6) && m.find('-') != string::npos;
+    int budget = 24;
+    for (size_t j = p.next(i); p.valid(j) && --budget >= 0; j = p.next(j)) {
+        const Instr& in = p.at(j);
+        bool dead = (local && (in.op == OP_LEAVE || in.op == OP_RET)) ||
+                    ((in.op == OP_MOV || in.op == OP_POP) && sameOperand(in.a, m) && !readsMem(in, m));
+        if (dead) {
+            p.remove(i);
+            return true;
+        }
+        if (endsBlock(in.op) || readsMem(in, m) || sameOperand(in.a, m) || clobbersAddress(in, m)) return false;
+    }
+    return false;
+}
+
+const Peephole::Rule Peephole::RULES[] = {
+    { "push-pop",           rulePushPop },
+    { "store-load",         ruleStoreLoad },
+    { "self-move",          ruleSelfMove },
+    { "dead-move",          ruleDeadMove },
+    { "forward-copy",       ruleForwardCopy },
+    { "fold-through-temp",  ruleFoldThroughTemp },
+    { "forward-operand",    ruleForwardOperand },
+    { "store-forward",      ruleStoreForward },
+    { "dead-store",         ruleDeadStore },
+    { "setcc-branch",       ruleSetccBranch },
+    { "compare-zero",       ruleCompareZero },
+    { "jump-to-next",       ruleJumpToNext },
+    { "branch-over-jump",   ruleBranchOverJump },
+    { "unreachable",        ruleUnreachable },
+    { "add-zero",           ruleAddZero },
+    { "zero-idiom",         ruleZeroIdiom },
+};
+const size_t Peephole::RULE_COUNT = sizeof(Peephole::RULES) / sizeof(Peephole::RULES[0]);
+
+// ---- 乘除常数的指令选择 ----
+// 乘以常数改写为 lea/shl/add/sub，序列不比 imul（延迟 3 周期）慢时才替换；
+// 有符号除以常数：2 的幂用移位加舍入偏置，其他除数乘以"魔数"取积的高 32 位再移位
+// （Hacker's Delight 第 10 章），都不用 idiv
+
+inline void appendInstr(vector<Instr>& code, Opcode op, string a, string b = string()) {
+    code.push_back(Instr{ op, CC_E, move(a), move(b), string() });
+}
+
+inline int log2Exact(uint32_t m) {
+    int k = 0;
+    while ((1u << k) != m) k++;
+    return k;
+}
+
+inline bool isPowerOfTwo(uint32_t m) { return m != 0 && (m & (m - 1)) == 0; }
+
+// lea 一条指令能乘的数：r + r*2、r + r*4、r + r*8
+inline bool isLeaFactor(uint32_t m) { return m == 3 || m == 5 || m == 9; }
+
+inline string leaScale(const string& r, uint32_t m) {
+    return "[" + r + "+" + r + "*" + to_string(m - 1) + "]";
+}
+
+// r = r * c；t 为可以改写的另一个寄存器，没有则为空。找不到合适的序列返回 false，调用方仍用 imul
+inline bool lowerMulConst(vector<Instr>& code, const string& r, const string& t, int32_t c) {
+    uint32_t m = c < 0 ? 0u - (uint32_t)c : (uint32_t)c;
+    vector<Instr> seq;
+    if (m == 0) {
+        appendInstr(seq, OP_MOV, r, "0");
+    }
+    else if (isPowerOfTwo(m)) {
+        if (m > 1) appendInstr(seq, OP_SHL, r, to_string(log2Exact(m)));
+    }
+    else if (isLeaFactor(m)) {
+        appendInstr(seq, OP_LEA, r, leaScale(r, m));
+    }
+    else {
+        // 两条指令：lea 后再 shl 或再 lea
+        for (uint32_t f = 3; f <= 9 && seq.empty(); f += 2) {
+            if (!isLeaFactor(f) || m % f != 0) continue;
+            uint32_t g = m / f;
+            if (isPowerOfTwo(g)) {
+                appendInstr(seq, OP_LEA, r, leaScale(r, f));
+                appendInstr(seq, OP_SHL, r, to_string(log2Exact(g)));
+            }
+            else if (isLeaFactor(g)) {
+                appendInstr(seq, OP_LEA, r, leaScale(r, f));
+                appendInstr(seq, OP_LEA, r, leaScale(r, g));
+            }
+        }
+        // 2^k ± 1：借临时寄存器保存原值（寄存器间 mov 不计开销），这时不再追加 neg
+        if (seq.empty() && !t.empty() && c > 0 && (isPowerOfTwo(m - 1) || isPowerOfTwo(m + 1))) {
+            bool plus = isPowerOfTwo(m - 1);
+            appendInstr(seq, OP_MOV, t, r);
+            appendInstr(seq, OP_SHL, r, to_string(log2Exact(plus ? m - 1 : m + 1)));
+            appendInstr(seq, plus ? OP_ADD : OP_SUB, r, t);
+            code.insert(code.end(), seq.begin(), seq.end());
+            return true;
+        }
+        if (seq.empty()) return false;
+    }
+    if (c < 0 && m != 0) {
+        if (seq.size() >= 2) return false;
+        appendInstr(seq, OP_NEG, r);
+    }
+    code.insert(code.end(), seq.begin(), seq.end());
+    return true;
+}
+
+// 除数 d 为 ±2^k 时，r = r / d（向零取整）；t 为可以改写的另一个寄存器（|d| = 1 时不用）。
+// 负的被除数先加上 2^k - 1，再算术右移
+inline void lowerDivPowerOfTwo(vector<Instr>& code, const string& r, const string& t, int32_t d) {
+    uint32_t m = d < 0 ? 0u - (uint32_t)d : (uint32_t)d;
+    int k = log2Exact(m);
+    if (k > 0) {
+        appendInstr(code, OP_MOV, t, r);
+        if (k > 1) appendInstr(code, OP_SAR, t, "31");
+        appendInstr(code, OP_SHR, t, to_string(32 - k));
+        appendInstr(code, OP_ADD, r, t);
+        appendInstr(code, OP_SAR, r, to_string(k));
+    }
+    if (d < 0) appendInstr(code, OP_NEG, r);
+}
+
+// 除以常数 d 所用的魔数与移位量：q = (x * multiplier 的高 32 位 [± x]) >> shift，负数商再加 1
+struct DivMagic {
+    int32_t multiplier;
+    int shift;
+};
+
+// |d| >= 2 且不是 2 的幂
+inline DivMagic divMagic(int32_t d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? 0u - (uint32_t)d : (uint32_t)d;
+    uint32_t t = two31 + ((uint32_t)d >> 31);
+    uint32_t anc = t - 1 - t % ad; // |nc|
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    int p = 31;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    uint32_t mag = q2 + 1;
+    return DivMagic{ (int32_t)(d < 0 ? 0u - mag : mag), p - 32 };
+}
+
+// edx = x / d，x 为 eax、edx 以外的寄存器且保持不变，eax 被改写
+inline void lowerDivMagic(vector<Instr>& code, const string& x, int32_t d) {
+    DivMagic mg = divMagic(d);
+    appendInstr(code, OP_MOV, "eax", to_string(mg.multiplier));
+    appendInstr(code, OP_IMUL, x); // edx:eax = eax * x
+    if (d > 0 && mg.multiplier < 0) appendInstr(code, OP_ADD, "edx", x);
+    if (d < 0 && mg.multiplier > 0) appendInstr(code, OP_SUB, "edx", x);
+    if (mg.shift > 0) appendInstr(code, OP_SAR, "edx", to_string(mg.shift));
+    appendInstr(code, OP_MOV, "eax", "edx");
+    appendInstr(code, OP_SHR, "eax", "31");
+    appendInstr(code, OP_ADD, "edx", "eax");
+}
+
+#endif // EMERGING_PEEPHOLE_H
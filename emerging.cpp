@@ -1,588 +1,1409 @@
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <vector>
-#include <map>
-#include <cctype>
-#include <cstdlib>
-#include <cstring>
-#include <algorithm>
-
-using namespace std;
-
-#define EMERGING_VERSION "1.0-win32"
-
-// ---------- ߺ ----------
-string getBaseName(const string& path) {
-    size_t start = path.find_last_of("/\\");
-    size_t end = path.find_last_of('.');
-    if (start == string::npos) start = 0; else start++;
-    if (end == string::npos || end < start) end = path.length();
-    return path.substr(start, end - start);
-}
-
-// ---------- ʷ ----------
-enum TokenType {
-    TOK_EOF, TOK_IDENT, TOK_NUMBER,
-    TOK_INT, TOK_PRINT, TOK_RETURN,
-    TOK_ASSIGN, TOK_SEMICOLON, TOK_LPAREN, TOK_RPAREN,
-    TOK_LBRACE, TOK_RBRACE, TOK_PLUS, TOK_MINUS,
-    TOK_MUL, TOK_DIV, TOK_COMMA, TOK_EXTERN,
-    TOK_STRING                    // ַAPIã
-};
-
-struct Token {
-    TokenType type;
-    string text;
-    int value;
-    string str;                   // ַ
-};
-
-class Lexer {
-    istream& in;
-    char ch;
-    Token token;
-    void nextChar() { if (in.get(ch)) {} else ch = EOF; }
-public:
-    Lexer(istream& is) : in(is), ch(' ') { nextChar(); }
-
-    Token nextToken() {
-        while (isspace(ch)) nextChar();
-        if (ch == EOF) return token = { TOK_EOF, "", 0 };
-
-        if (isalpha(ch) || ch == '_') {
-            string id;
-            while (isalnum(ch) || ch == '_') {
-                id += ch;
-                nextChar();
-            }
-            if (id == "int") return token = { TOK_INT, id, 0 };
-            if (id == "print") return token = { TOK_PRINT, id, 0 };
-            if (id == "return") return token = { TOK_RETURN, id, 0 };
-            if (id == "extern") return token = { TOK_EXTERN, id, 0 };
-            return token = { TOK_IDENT, id, 0 };
-        }
-
-        if (isdigit(ch)) {
-            int val = 0;
-            while (isdigit(ch)) {
-                val = val * 10 + (ch - '0');
-                nextChar();
-            }
-            return token = { TOK_NUMBER, "", val };
-        }
-
-        if (ch == '"') {
-            nextChar(); //  "
-            string str;
-            while (ch != '"' && ch != EOF) {
-                str += ch;
-                nextChar();
-            }
-            if (ch == '"') nextChar();
-            token = { TOK_STRING, "", 0 };
-            token.str = str;
-            return token;
-        }
-
-        char c = ch;
-        nextChar();
-        switch (c) {
-        case '=': return token = { TOK_ASSIGN, "=", 0 };
-        case ';': return token = { TOK_SEMICOLON, ";", 0 };
-        case '(': return token = { TOK_LPAREN, "(", 0 };
-        case ')': return token = { TOK_RPAREN, ")", 0 };
-        case '{': return token = { TOK_LBRACE, "{", 0 };
-        case '}': return token = { TOK_RBRACE, "}", 0 };
-        case '+': return token = { TOK_PLUS, "+", 0 };
-        case '-': return token = { TOK_MINUS, "-", 0 };
-        case '*': return token = { TOK_MUL, "*", 0 };
-        case '/': return token = { TOK_DIV, "/", 0 };
-        case ',': return token = { TOK_COMMA, ",", 0 };
-        default: cerr << "δַ֪: " << c << endl; exit(1);
-        }
-    }
-
-    Token current() const { return token; }
-    void advance() { nextToken(); }
-    bool check(TokenType t) const { return token.type == t; }
-    bool match(TokenType t) { if (check(t)) { advance(); return true; } return false; }
-    void expect(TokenType t, const string& msg) {
-        if (!check(t)) { cerr << "﷨:  " << msg << endl; exit(1); }
-    }
-};
-
-// ---------- ű ----------
-struct Symbol {
-    string name;
-    bool isGlobal;
-    bool isExtern;      // Ƿⲿ
-    int offset;          // ֲƫ
-};
-
-class SymbolTable {
-    map<string, Symbol> locals;
-    vector<string> globals;
-    vector<string> externs;   // ⲿ
-public:
-    void addGlobal(const string& name) {
-        globals.push_back(name);
-    }
-
-    void addExtern(const string& name) {
-        externs.push_back(name);
-    }
-
-    void beginFunction() { locals.clear(); }
-
-    void addLocal(const string& name, int offset) {
-        locals[name] = { name, false, false, offset };
-    }
-
-    Symbol* lookup(const string& name) {
-        auto it = locals.find(name);
-        if (it != locals.end()) return &it->second;
-        for (size_t i = 0; i < globals.size(); ++i) {
-            if (globals[i] == name) {
-                static Symbol gsym;
-                gsym = { name, true, false, (int)i * 4 };
-                return &gsym;
-            }
-        }
-        for (size_t i = 0; i < externs.size(); ++i) {
-            if (externs[i] == name) {
-                static Symbol esym;
-                esym = { name, true, true, 0 };
-                return &esym;
-            }
-        }
-        return nullptr;
-    }
-
-    const vector<string>& getGlobals() const { return globals; }
-    const vector<string>& getExterns() const { return externs; }
-};
-
-// ---------- 32λģʽ ----------
-class CodeGen {
-    ofstream& out;
-    int localCount;
-    string currentFunc;
-    vector<string> stringLiterals;   // ռַ
-    map<string, string> stringLabels; // ַ -> ǩ
-public:
-    CodeGen(ofstream& os) : out(os), localCount(0) {}
-
-    string newStringLabel() {
-        static int n = 0;
-        return "str" + to_string(n++);
-    }
-
-    void prolog() {
-        out << "; Emerging v" << EMERGING_VERSION << "\n";
-        out << "bits 32\n";
-        out << "section .text\n\n";
-        out << "extern _ExitProcess@4\n";
-        out << "extern _MessageBoxA@16\n";  // API
-        out << "\n";
-        out << "global _start\n";
-        out << "_start:\n";
-        out << "    call main\n";
-        out << "    push eax\n";
-        out << "    call _ExitProcess@4\n\n";
-    }
-
-    void beginFunction(const string& name) {
-        currentFunc = name;
-        localCount = 0;
-        out << name << ":\n";
-        out << "    push ebp\n";
-        out << "    mov ebp, esp\n";
-        out << "    sub esp, " << localCount * 4 << "\n"; // Ժ
-    }
-
-    void addLocal(const string& name) {
-        localCount++;
-        // ռںʱ
-    }
-
-    void endFunction() {
-        // ջռ
-        out << ".return_" << currentFunc << ":\n";
-        out << "    mov esp, ebp\n";
-        out << "    pop ebp\n";
-        out << "    ret\n\n";
-    }
-
-    void emit(const string& code) { out << code << "\n"; }
-
-    void emitString(const string& str) {
-        string label;
-        auto it = stringLabels.find(str);
-        if (it == stringLabels.end()) {
-            label = newStringLabel();
-            stringLabels[str] = label;
-        }
-        else {
-            label = it->second;
-        }
-        out << "    push " << label << "\n";  // ѹַַ
-    }
-
-    void emitDataSection(const vector<string>& globals, const vector<string>& externs) {
-        out << "\nsection .data\n";
-        for (const string& g : globals) {
-            out << "_g_" << g << " dd 0\n";
-        }
-        // ַ
-        for (auto& p : stringLabels) {
-            out << p.second << " db '" << p.first << "', 0\n";
-        }
-        out << "\n";
-
-        // ǣ
-        if (!externs.empty()) {
-            out << "; :\n";
-            for (const string& e : externs) {
-                out << "; extern " << e << "\n";
-            }
-        }
-    }
-};
-
-// ---------- ﷨ ----------
-class Parser {
-    Lexer& lex;
-    SymbolTable syms;
-    CodeGen& cg;
-    string currentFunction;
-    int localCounter;
-public:
-    Parser(Lexer& l, CodeGen& gen) : lex(l), cg(gen), localCounter(0) {}
-
-    void parseProgram() {
-        cg.prolog();
-        while (!lex.check(TOK_EOF)) {
-            if (lex.check(TOK_EXTERN)) {
-                parseExtern();
-            }
-            else if (lex.check(TOK_INT)) {
-                lex.advance(); // 'int'
-                if (lex.check(TOK_IDENT)) {
-                    string name = lex.current().text;
-                    lex.advance();
-                    if (lex.check(TOK_LPAREN)) {
-                        parseFunction(name);
-                    }
-                    else if (lex.check(TOK_SEMICOLON)) {
-                        syms.addGlobal(name);
-                        lex.advance(); // ';'
-                    }
-                    else {
-                        cerr << "﷨: ȱ ;  (\n";
-                        exit(1);
-                    }
-                }
-                else {
-                    cerr << "﷨: ʶ\n";
-                    exit(1);
-                }
-            }
-            else {
-                cerr << "﷨: ֻ֧intextern\n";
-                exit(1);
-            }
-        }
-        cg.emitDataSection(syms.getGlobals(), syms.getExterns());
-    }
-
-    void parseExtern() {
-        lex.advance(); // 'extern'
-        lex.expect(TOK_INT, "'int'");
-        lex.advance(); // 'int'
-        lex.expect(TOK_IDENT, "");
-        string name = lex.current().text;
-        lex.advance();
-        lex.expect(TOK_LPAREN, "'('");
-        lex.advance();
-        // 򻯣ԣ
-        while (!lex.check(TOK_RPAREN)) {
-            if (lex.check(TOK_INT)) lex.advance();
-            if (lex.check(TOK_IDENT)) lex.advance();
-            if (lex.check(TOK_COMMA)) lex.advance();
-        }
-        lex.expect(TOK_RPAREN, "')'");
-        lex.advance();
-        lex.expect(TOK_SEMICOLON, "';'");
-        lex.advance();
-        syms.addExtern(name);
-    }
-
-    void parseFunction(const string& name) {
-        currentFunction = name;
-        syms.beginFunction();
-        localCounter = 0;
-        lex.expect(TOK_LPAREN, "'('");
-        lex.advance(); // '('
-        lex.expect(TOK_RPAREN, "')'");
-        lex.advance(); // ')'
-        lex.expect(TOK_LBRACE, "'{'");
-        lex.advance(); // '{'
-
-        cg.beginFunction(name);
-
-        while (!lex.check(TOK_RBRACE) && !lex.check(TOK_EOF)) {
-            parseStatement();
-        }
-
-        lex.expect(TOK_RBRACE, "'}'");
-        lex.advance(); // '}'
-
-        cg.endFunction();
-    }
-
-    void parseStatement() {
-        if (lex.check(TOK_INT)) {
-            lex.advance(); // 'int'
-            lex.expect(TOK_IDENT, "");
-            string varName = lex.current().text;
-            lex.advance();
-            int offset = -4 - 4 * localCounter++;
-            syms.addLocal(varName, offset);
-            // ѡʼ
-            if (lex.check(TOK_ASSIGN)) {
-                lex.advance(); // '='
-                parseExpression();
-                Symbol* s = syms.lookup(varName);
-                cg.emit("    mov [ebp" + to_string(s->offset) + "], eax");
-            }
-            lex.expect(TOK_SEMICOLON, "';'");
-            lex.advance(); // ';'
-        }
-        else if (lex.check(TOK_IDENT)) {
-            string varName = lex.current().text;
-            lex.advance(); // ident
-            Symbol* s = syms.lookup(varName);
-            if (!s) { cerr << "δ: " << varName << endl; exit(1); }
-            if (s->isExtern) {
-                // 
-                lex.expect(TOK_LPAREN, "'('");
-                lex.advance(); // '('
-                // ѹջ
-                vector<int> args;
-                while (!lex.check(TOK_RPAREN)) {
-                    parseExpression(); //  eax
-                    cg.emit("    push eax");
-                    if (lex.check(TOK_COMMA)) lex.advance();
-                }
-                lex.expect(TOK_RPAREN, "')'");
-                lex.advance(); // ')'
-                lex.expect(TOK_SEMICOLON, "';'");
-                lex.advance(); // ';'
-                cg.emit("    call _" + varName);
-                cg.emit("    add esp, " + to_string(args.size() * 4));
-            }
-            else {
-                // ֵ
-                lex.expect(TOK_ASSIGN, "'='");
-                lex.advance(); // '='
-                parseExpression();
-                lex.expect(TOK_SEMICOLON, "';'");
-                lex.advance(); // ';'
-                if (s->isGlobal) {
-                    cg.emit("    mov [_g_" + varName + "], eax");
-                }
-                else {
-                    cg.emit("    mov [ebp" + to_string(s->offset) + "], eax");
-                }
-            }
-        }
-        else if (lex.check(TOK_PRINT)) {
-            lex.advance(); // print
-            lex.expect(TOK_LPAREN, "'('");
-            lex.advance(); // '('
-            parseExpression(); //  eax
-            lex.expect(TOK_RPAREN, "')'");
-            lex.advance(); // ')'
-            lex.expect(TOK_SEMICOLON, "';'");
-            lex.advance(); // ';'
-            // ɶ printf ĵã extern int printf(...)
-            cg.emit("    push eax");
-            cg.emit("    push format"); // 趨ʽַ
-            cg.emit("    call _printf");
-            cg.emit("    add esp, 8");
-        }
-        else if (lex.check(TOK_RETURN)) {
-            lex.advance(); // return
-            parseExpression();
-            lex.expect(TOK_SEMICOLON, "';'");
-            lex.advance(); // ';'
-            cg.emit("    jmp .return_" + currentFunction);
-        }
-        else if (lex.check(TOK_STRING)) {
-            // ַΪʽ
-            string str = lex.current().str;
-            lex.advance();
-            cg.emitString(str);
-        }
-        else {
-            cerr << "﷨: δ֪" << endl;
-            exit(1);
-        }
-    }
-
-    void parseExpression() {
-        parseTerm();
-        while (lex.check(TOK_PLUS) || lex.check(TOK_MINUS)) {
-            Token op = lex.current();
-            lex.advance();
-            parseTerm();
-            if (op.type == TOK_PLUS) {
-                cg.emit("    add eax, [esp]");
-                cg.emit("    add esp, 4");
-            }
-            else {
-                cg.emit("    mov ebx, [esp]");
-                cg.emit("    add esp, 4");
-                cg.emit("    sub ebx, eax");
-                cg.emit("    mov eax, ebx");
-            }
-        }
-    }
-
-    void parseTerm() {
-        parseFactor();
-        while (lex.check(TOK_MUL) || lex.check(TOK_DIV)) {
-            Token op = lex.current();
-            lex.advance();
-            cg.emit("    push eax");
-            parseFactor();
-            cg.emit("    pop ebx");
-            if (op.type == TOK_MUL) {
-                cg.emit("    imul eax, ebx");
-            }
-            else {
-                cg.emit("    cdq");
-                cg.emit("    idiv ebx");
-            }
-        }
-    }
-
-    void parseFactor() {
-        if (lex.check(TOK_NUMBER)) {
-            int val = lex.current().value;
-            cg.emit("    mov eax, " + to_string(val));
-            lex.advance();
-        }
-        else if (lex.check(TOK_IDENT)) {
-            string name = lex.current().text;
-            lex.advance();
-            Symbol* s = syms.lookup(name);
-            if (!s) { cerr << "δ: " << name << endl; exit(1); }
-            if (s->isGlobal) {
-                cg.emit("    mov eax, [_g_" + name + "]");
-            }
-            else {
-                cg.emit("    mov eax, [ebp" + to_string(s->offset) + "]");
-            }
-        }
-        else if (lex.check(TOK_STRING)) {
-            // ֱַݶеıǩ
-            string str = lex.current().str;
-            lex.advance();
-            cg.emitString(str);
-        }
-        else if (lex.check(TOK_LPAREN)) {
-            lex.advance(); // '('
-            parseExpression();
-            lex.expect(TOK_RPAREN, "')'");
-            lex.advance(); // ')'
-        }
-        else {
-            cerr << "﷨: " << endl;
-            exit(1);
-        }
-    }
-};
-
-// ----------  ----------
-int main(int argc, char* argv[]) {
-    string srcFile;
-    string outFile;
-    bool versionOnly = false;
-
-    for (int i = 1; i < argc; ++i) {
-        string arg = argv[i];
-        if (arg == "--version") {
-            cout << "Emerging compiler version " << EMERGING_VERSION << endl;
-            versionOnly = true;
-            break;
-        }
-        else if (arg == "-o") {
-            if (i + 1 < argc) {
-                outFile = argv[++i];
-            }
-            else {
-                cerr << ": -o ѡȱٲ" << endl;
-                return 1;
-            }
-        }
-        else if (arg[0] == '-') {
-            cerr << "δ֪ѡ: " << arg << endl;
-            return 1;
-        }
-        else {
-            if (!srcFile.empty()) {
-                cerr << ": ָֻһԴļ" << endl;
-                return 1;
-            }
-            srcFile = arg;
-        }
-    }
-
-    if (versionOnly) return 0;
-
-    if (srcFile.empty()) {
-        cerr << "÷: emerging.exe [--version] [-o output.exe] <Դļ.emg>" << endl;
-        return 1;
-    }
-
-    ifstream in(srcFile);
-    if (!in) {
-        cerr << "޷Դļ: " << srcFile << endl;
-        return 1;
-    }
-
-    string baseName = getBaseName(srcFile);
-    string asmFile = baseName + ".asm";
-    if (outFile.empty()) {
-        outFile = baseName + ".exe";
-    }
-
-    ofstream out(asmFile);
-    if (!out) {
-        cerr << "޷ļ: " << asmFile << endl;
-        return 1;
-    }
-
-    Lexer lex(in);
-    CodeGen cg(out);
-    Parser parser(lex, cg);
-    parser.parseProgram();
-
-    out.close();
-    cout << ": " << asmFile << endl;
-
-    //  linker.exe л
-    string linkerCmd = "linker.exe " + asmFile + " " + outFile;
-    cout << "ִ: " << linkerCmd << endl;
-    int ret = system(linkerCmd.c_str());
-    if (ret != 0) {
-        cerr << "ʧ" << endl;
-        return 1;
-    }
-
-    cout << "ɹɿִļ: " << outFile << endl;
-    return 0;
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+
+#include "common/header_cache.h"
+#include "common/peephole.h"
+
+using namespace std;
+
+#define EMERGING_VERSION "1.0-win32"
+
+// ---------- 工具函数 ----------
+string getBaseName(const string& path) {
+    size_t start = path.find_last_of("/\\");
+    size_t end = path.find_last_of('.');
+    if (start == string::npos) start = 0; else start++;
+    if (end == string::npos || end < start) end = path.length();
+    return path.substr(start, end - start);
+}
+
+// ---------- 词法分析 ----------
+enum TokenType {
+    TOK_EOF, TOK_IDENT, TOK_NUMBER,
+    TOK_INT, TOK_PRINT, TOK_RETURN,
+    TOK_ASSIGN, TOK_SEMICOLON, TOK_LPAREN, TOK_RPAREN,
+    TOK_LBRACE, TOK_RBRACE, TOK_PLUS, TOK_MINUS,
+    TOK_MUL, TOK_DIV, TOK_COMMA, TOK_EXTERN,
+    TOK_STRING,                   // 字符串字面量（用于API调用）
+    TOK_INCLUDE, TOK_DEFINE,      // 预处理指令：#include 携带路径，#define 后跟两个标识符
+    TOK_ELLIPSIS, TOK_AMP,        // 仅出现在 extern 参数表中
+    TOK_COUNT                     // 记号种类数
+};
+
+// Token 不持有字符串：标识符和字符串内容用驻留编号，原文用源码区间表示
+struct Token {
+    TokenType type;
+    SymId sym;                    // 标识符或字符串内容的驻留编号
+    int value;
+    uint32_t offset;              // 源码区间
+    uint32_t length;
+};
+
+// 关键字表：新增关键字只需在此加一行，哈希冲突会在编译期报错
+struct Keyword {
+    const char* name;
+    TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    { "int", TOK_INT },
+    { "print", TOK_PRINT },
+    { "return", TOK_RETURN },
+    { "extern", TOK_EXTERN },
+};
+constexpr size_t KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+constexpr unsigned KEYWORD_SLOTS = 32; // 2的幂
+
+constexpr size_t keywordLength(const char* s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+// 首字符 + 末字符 + 长度，对当前关键字集合是完美哈希
+constexpr unsigned keywordHash(const char* s, size_t n) {
+    return ((unsigned char)s[0] + (unsigned char)s[n - 1] + (unsigned)n) & (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable {
+    signed char index[KEYWORD_SLOTS]; // 槽 -> KEYWORDS 下标，-1 为空
+    unsigned char length[KEYWORD_SLOTS];
+    bool perfect;
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable t{};
+    for (unsigned i = 0; i < KEYWORD_SLOTS; ++i) t.index[i] = -1;
+    t.perfect = true;
+    for (size_t k = 0; k < KEYWORD_COUNT; ++k) {
+        size_t n = keywordLength(KEYWORDS[k].name);
+        unsigned h = keywordHash(KEYWORDS[k].name, n);
+        if (t.index[h] >= 0) t.perfect = false;
+        t.index[h] = (signed char)k;
+        t.length[h] = (unsigned char)n;
+    }
+    return t;
+}
+
+constexpr KeywordTable KEYWORD_TABLE = buildKeywordTable();
+static_assert(KEYWORD_TABLE.perfect, "关键字哈希冲突，请调整 keywordHash 或 KEYWORD_SLOTS");
+
+// 标识符分类：一次哈希加一次定长比较，不分配内存
+inline TokenType lookupKeyword(const char* s, size_t n) {
+    unsigned h = keywordHash(s, n);
+    int k = KEYWORD_TABLE.index[h];
+    if (k >= 0 && KEYWORD_TABLE.length[h] == n && memcmp(KEYWORDS[k].name, s, n) == 0)
+        return KEYWORDS[k].type;
+    return TOK_IDENT;
+}
+
+class Lexer {
+    const char* base;    // 源码起始
+    const char* p;       // 当前扫描位置
+    const char* end;     // 源码末尾
+    Token token;
+
+    static bool isIdentChar(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+    // 跳过空白和注释（// 行注释，/* */ 块注释）
+    void skipSpaceAndComments() {
+        while (p < end) {
+            if (isspace((unsigned char)*p)) {
+                ++p;
+            }
+            else if (*p == '/' && p + 1 < end && p[1] == '/') {
+                while (p < end && *p != '\n') ++p;
+            }
+            else if (*p == '/' && p + 1 < end && p[1] == '*') {
+                p += 2;
+                while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) ++p;
+                p = (p + 1 < end) ? p + 2 : end;
+            }
+            else break;
+        }
+    }
+
+    // 预处理指令，p 指向 '#' 之后
+    const Token& directive(const char* start) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        const char* name = p;
+        while (p < end && isIdentChar(*p)) ++p;
+        size_t n = p - name;
+        if (n == 7 && memcmp(name, "include", 7) == 0) {
+            while (p < end && (*p == ' ' || *p == '\t')) ++p;
+            if (p == end || (*p != '"' && *p != '<')) {
+                cerr << "语法错误: #include 后需要 \"文件\" 或 <文件>" << endl;
+                exit(1);
+            }
+            char close = (*p == '<') ? '>' : '"';
+            const char* path = ++p;
+            while (p < end && *p != close && *p != '\n') ++p;
+            if (p == end || *p != close) {
+                cerr << "语法错误: #include 文件名未闭合" << endl;
+                exit(1);
+            }
+            SymId sym = interner.intern(path, p - path);
+            ++p;
+            return make(TOK_INCLUDE, start, 0, sym);
+        }
+        if (n == 6 && memcmp(name, "define", 6) == 0) return make(TOK_DEFINE, start);
+        cerr << "未知的预处理指令: #" << string(name, n) << endl;
+        exit(1);
+    }
+
+    const Token& make(TokenType t, const char* start, int value = 0, SymId sym = 0) {
+        token = { t, sym, value, (uint32_t)(start - base), (uint32_t)(p - start) };
+        return token;
+    }
+public:
+    Lexer(const char* begin, const char* end) : base(begin), p(begin), end(end) { nextToken(); }
+
+    const Token& nextToken() {
+        skipSpaceAndComments();
+        const char* start = p;
+        if (p == end) return make(TOK_EOF, start);
+
+        if (isalpha((unsigned char)*p) || *p == '_') {
+            while (p < end && isIdentChar(*p)) ++p;
+            TokenType t = lookupKeyword(start, p - start);
+            if (t != TOK_IDENT) return make(t, start);
+            return make(TOK_IDENT, start, 0, interner.intern(start, p - start));
+        }
+
+        if (isdigit((unsigned char)*p)) {
+            int val = 0;
+            if (*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X')) {
+                p += 2;
+                unsigned hex = 0;
+                while (p < end && isxdigit((unsigned char)*p)) {
+                    hex = hex * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+                    ++p;
+                }
+                return make(TOK_NUMBER, start, (int)hex);
+            }
+            while (p < end && isdigit((unsigned char)*p)) {
+                val = val * 10 + (*p - '0');
+                ++p;
+            }
+            return make(TOK_NUMBER, start, val);
+        }
+
+        if (*p == '"') {
+            const char* s = ++p; // 跳过 "
+            while (p < end && *p != '"') ++p;
+            SymId content = interner.intern(s, p - s);
+            if (p < end) ++p;
+            return make(TOK_STRING, start, 0, content);
+        }
+
+        char c = *p++;
+        switch (c) {
+        case '=': return make(TOK_ASSIGN, start);
+        case ';': return make(TOK_SEMICOLON, start);
+        case '(': return make(TOK_LPAREN, start);
+        case ')': return make(TOK_RPAREN, start);
+        case '{': return make(TOK_LBRACE, start);
+        case '}': return make(TOK_RBRACE, start);
+        case '+': return make(TOK_PLUS, start);
+        case '-': return make(TOK_MINUS, start);
+        case '*': return make(TOK_MUL, start);
+        case '/': return make(TOK_DIV, start);
+        case ',': return make(TOK_COMMA, start);
+        case '&': return make(TOK_AMP, start);
+        case '#': return directive(start);
+        case '.':
+            if (p + 1 < end && p[0] == '.' && p[1] == '.') {
+                p += 2;
+                return make(TOK_ELLIPSIS, start);
+            }
+            cerr << "未知字符: " << c << endl; exit(1);
+        default: cerr << "未知字符: " << c << endl; exit(1);
+        }
+    }
+
+    const Token& current() const { return token; }
+    void advance() { nextToken(); }
+    bool check(TokenType t) const { return token.type == t; }
+};
+
+// ---------- 记号流 ----------
+// 整个文件预先切分成并列数组（结构数组），语法分析按下标访问，可任意前瞻和回溯
+class TokenStream {
+    vector<uint8_t> kinds;
+    vector<uint32_t> offsets;
+    vector<uint32_t> lengths;
+    vector<int32_t> values;   // 数字的值，或标识符/字符串/头文件路径的驻留编号
+    size_t pos;               // 当前记号下标
+    TokenType cur;            // 当前记号类型（缓存，check 不必访问数组）
+public:
+    TokenStream(const char* begin, const char* end) : pos(0), cur(TOK_EOF) {
+        size_t guess = (size_t)(end - begin) / 2 + 1; // 记号平均不短于2字节，避免反复扩容
+        kinds.reserve(guess);
+        offsets.reserve(guess);
+        lengths.reserve(guess);
+        values.reserve(guess);
+        Lexer lex(begin, end);
+        while (true) {
+            const Token& tok = lex.current();
+            kinds.push_back((uint8_t)tok.type);
+            offsets.push_back(tok.offset);
+            lengths.push_back(tok.length);
+            values.push_back(tok.type == TOK_NUMBER ? tok.value : (int32_t)tok.sym);
+            if (tok.type == TOK_EOF) break;
+            lex.advance();
+        }
+        cur = (TokenType)kinds[0];
+    }
+
+    // 越过末尾的下标都视为最后的 EOF
+    TokenType kind(size_t ahead = 0) const { return (TokenType)kinds[min(pos + ahead, kinds.size() - 1)]; }
+    int value() const { return values[pos]; }
+    SymId sym() const { return (SymId)values[pos]; }
+
+    void advance() { if (cur != TOK_EOF) cur = (TokenType)kinds[++pos]; }
+    bool check(TokenType t) const { return cur == t; }
+    bool match(TokenType t) { if (check(t)) { advance(); return true; } return false; }
+    void expect(TokenType t, const string& msg) {
+        if (!check(t)) { cerr << "语法错误: 期望 " << msg << endl; exit(1); }
+    }
+};
+
+// ---------- 符号表 ----------
+struct Symbol {
+    SymId name;
+    bool isGlobal;
+    bool isExtern;      // 是否是外部函数
+    int offset;          // 局部变量偏移（由栈传入的形参为正）
+    int params;          // 本文件定义的函数的形参个数，变量和外部函数为 -1
+};
+
+// 以驻留编号为键的开放寻址表。记录存放在 deque 中，扩容只重建槽位，
+// 返回的 Symbol* 在表被清空之前始终有效
+class SymbolMap {
+    deque<Symbol> records;
+    vector<uint32_t> slots; // 存 记录下标+1，0 表示空槽
+
+    // 驻留编号基本连续，乘以奇数常量后低位仍互不相同，分布足够均匀
+    static size_t hashId(SymId id) { return (size_t)(id * 2654435761u); }
+
+    void insertSlot(uint32_t rec) {
+        size_t mask = slots.size() - 1;
+        size_t i = hashId(records[rec].name) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = rec + 1;
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, 0);
+        for (uint32_t rec = 0; rec < records.size(); ++rec) insertSlot(rec);
+    }
+
+public:
+    SymbolMap() { rehash(16); }
+
+    Symbol* find(SymId name) {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hashId(name) & mask; slots[i]; i = (i + 1) & mask) {
+            Symbol& s = records[slots[i] - 1];
+            if (s.name == name) return &s;
+        }
+        return nullptr;
+    }
+
+    // 调用者保证 name 尚未登记
+    Symbol* insert(const Symbol& sym) {
+        records.push_back(sym);
+        uint32_t rec = (uint32_t)records.size() - 1;
+        if (records.size() * 2 > slots.size()) rehash(slots.size() * 2);
+        else insertSlot(rec);
+        return &records.back();
+    }
+
+    void clear() {
+        if (records.empty()) return;
+        records.clear();
+        fill(slots.begin(), slots.end(), 0);
+    }
+};
+
+// 局部变量每个函数一张表；全局变量与外部函数共用一个命名空间
+class SymbolTable {
+    SymbolMap locals;
+    SymbolMap globals;
+    vector<SymId> globalNames;  // 按声明顺序，用于生成数据段
+    vector<int> globalInits;    // 全局变量初值，与 globalNames 对应
+    vector<SymId> externNames;
+    map<SymId, SymId> aliases;  // #define 别名 -> 目标名
+public:
+    void addGlobal(SymId name, int init = 0) {
+        if (globals.find(name)) {
+            cerr << "重复定义的全局符号: " << interner.str(name) << endl;
+            exit(1);
+        }
+        globals.insert({ name, true, false, (int)globalNames.size() * 4, -1 });
+        globalNames.push_back(name);
+        globalInits.push_back(init);
+    }
+
+    void addExtern(SymId name) {
+        if (Symbol* s = globals.find(name)) {
+            if (s->isExtern) return; // 重复声明同一个外部函数
+            cerr << "重复定义的全局符号: " << interner.str(name) << endl;
+            exit(1);
+        }
+        globals.insert({ name, true, true, 0, -1 });
+        externNames.push_back(name);
+    }
+
+    void addFunction(SymId name, int params) {
+        if (globals.find(name)) {
+            cerr << "重复定义的全局符号: " << interner.str(name) << endl;
+            exit(1);
+        }
+        globals.insert({ name, true, false, 0, params });
+    }
+
+    void beginFunction() { locals.clear(); }
+
+    Symbol* lookupLocal(SymId name) { return locals.find(name); }
+
+    void addLocal(SymId name, int offset) {
+        if (Symbol* s = locals.find(name)) s->offset = offset; // 同名再次声明时使用新位置
+        else locals.insert({ name, false, false, offset, -1 });
+    }
+
+    void addAlias(SymId name, SymId target) { aliases[name] = target; }
+
+    // 返回的指针在当前函数结束前有效（全局符号始终有效）。
+    // 别名解析到目标符号，调用方应使用 Symbol::name 作为实际名字
+    Symbol* lookup(SymId name) {
+        if (Symbol* s = locals.find(name)) return s;
+        return lookupGlobal(name);
+    }
+
+    Symbol* lookupGlobal(SymId name) {
+        if (Symbol* s = globals.find(name)) return s;
+        auto it = aliases.find(name);
+        return it != aliases.end() ? globals.find(it->second) : nullptr;
+    }
+
+    const vector<SymId>& getGlobals() const { return globalNames; }
+    const vector<int>& getGlobalInits() const { return globalInits; }
+    const vector<SymId>& getExterns() const { return externNames; }
+};
+
+// ---------- 代码生成器（32位模式） ----------
+// 函数体先收集为指令序列，函数结束时经窥孔优化后输出；文件头和数据段直接输出
+class CodeGen {
+    ofstream& out;
+    int localCount;                  // 当前函数占用的栈槽数
+    int declaredCount;               // 当前函数声明的局部变量数（含寄存器传来的形参）
+    SymId currentFunc;
+    size_t frameInstr;               // 序言中 sub esp 指令的下标
+    map<SymId, string> stringLabels; // 字符串内容 -> 标签名
+    vector<Instr> code;              // 当前函数的指令序列
+    Peephole peephole;
+
+    struct FrameStat {
+        SymId name;
+        int declared;   // 每个局部变量各占一个槽时的字节数
+        int bytes;      // 实际的局部变量区字节数
+        bool omitted;   // 省略了帧指针
+    };
+    vector<FrameStat> frameStats;
+public:
+    CodeGen(ofstream& os) : out(os), localCount(0), declaredCount(0), currentFunc(0), frameInstr(0) {}
+
+    const Peephole& peepholeStats() const { return peephole; }
+
+    void printFrameStats(ostream& os) const {
+        os << "栈帧大小:\n";
+        for (const FrameStat& f : frameStats) {
+            os << "  " << interner.str(f.name) << ": " << f.bytes << " 字节（逐个分配 " << f.declared << " 字节）";
+            if (f.omitted) os << "，省略帧指针";
+            os << "\n";
+        }
+    }
+
+    string newStringLabel() {
+        static int n = 0;
+        return "str" + to_string(n++);
+    }
+
+    void prolog() {
+        out << "; 由Emerging编译器生成 v" << EMERGING_VERSION << "\n";
+        out << "bits 32\n";
+        out << "section .text\n\n";
+        out << "extern _ExitProcess@4\n";
+        out << "extern _MessageBoxA@16\n";  // 常用API
+        out << "\n";
+        out << "global _start\n";
+        out << "_start:\n";
+        out << "    call main\n";
+        out << "    push eax\n";
+        out << "    call _ExitProcess@4\n\n";
+    }
+
+    void beginFunction(SymId name) {
+        currentFunc = name;
+        localCount = 0;
+        declaredCount = 0;
+        code.clear();
+        emit(OP_LABEL, interner.str(name));
+        emit(OP_PUSH, "ebp");
+        emit(OP_MOV, "ebp", "esp");
+        frameInstr = code.size();
+        emit(OP_SUB, "esp", "0"); // 局部变量数在函数结束时才知道，届时修正
+    }
+
+    // reused 表示沿用了同名旧变量的栈槽
+    void addLocal(bool reused) {
+        declaredCount++;
+        if (!reused) localCount++;
+        // 空间分配在函数结束时调整
+    }
+
+    void endFunction() {
+        // 调整栈空间：局部变量在 esp 之下会被压栈和函数调用覆盖
+        bool omit = omitFramePointer();
+        if (localCount > 0) code[frameInstr].b = to_string(localCount * 4);
+        else code[frameInstr].op = OP_NONE;
+        if (omit) {
+            code[frameInstr - 2].op = OP_NONE; // push ebp
+            code[frameInstr - 1].op = OP_NONE; // mov ebp, esp
+        }
+        frameStats.push_back({ currentFunc, declaredCount * 4, localCount * 4, omit });
+        emit(OP_LABEL, string(".return_") + interner.str(currentFunc));
+        if (!omit) {
+            emit(OP_MOV, "esp", "ebp");
+            emit(OP_POP, "ebp");
+        }
+        emit(OP_RET);
+        peephole.run(code);
+        writeInstrs(out, code);
+        out << "\n";
+    }
+
+    void emit(Opcode op, string a = string(), string b = string(), string c = string()) {
+        code.push_back(Instr{ op, CC_E, move(a), move(b), move(c) });
+    }
+
+    vector<Instr>& instrs() { return code; } // 供乘除常数的指令选择直接追加
+
+    // 不调用函数、没有局部变量、不按 ebp 访问形参的函数不建立栈帧。
+    // 函数体是直线代码，顺序跟踪压栈深度，每处 return 和函数末尾都要回到 0，返回前就不必从 ebp 恢复 esp
+    bool omitFramePointer() const {
+        if (localCount > 0) return false;
+        string returnLabel = string(".return_") + interner.str(currentFunc);
+        int depth = 0;
+        for (size_t i = frameInstr + 1; i < code.size(); ++i) {
+            const Instr& in = code[i];
+            if (in.op == OP_CALL || in.op == OP_RAW) return false;
+            if (mentionsGpr(in.a, 6) || mentionsGpr(in.b, 6) || mentionsGpr(in.c, 6)) return false;
+            if (in.op == OP_PUSH) depth++;
+            else if (in.op == OP_POP) depth--;
+            else if (in.op == OP_JMP && in.a == returnLabel && depth != 0) return false;
+            else if (gprIndex(in.a) == 7) return false; // 其他改写 esp 的指令
+        }
+        return depth == 0;
+    }
+
+    // 变量的内存操作数；sized 时带 dword（idiv 等单操作数指令需要）
+    static string symbolOperand(const Symbol* s, bool sized = false) {
+        string prefix = sized ? "dword " : "";
+        if (s->isGlobal) return prefix + "[_g_" + interner.str(s->name) + "]";
+        return prefix + (s->offset < 0 ? "[ebp" : "[ebp+") + to_string(s->offset) + "]";
+    }
+
+    const string& stringLabel(SymId str) {
+        auto it = stringLabels.find(str);
+        if (it == stringLabels.end()) {
+            it = stringLabels.emplace(str, newStringLabel()).first;
+        }
+        return it->second;
+    }
+
+    void emitString(SymId str) {
+        emit(OP_PUSH, stringLabel(str));  // 压入字符串地址
+    }
+
+    void emitDataSection(const vector<SymId>& globals, const vector<int>& inits, const vector<SymId>& externs) {
+        out << "\nsection .data\n";
+        for (size_t i = 0; i < globals.size(); ++i) {
+            out << "_g_" << interner.str(globals[i]) << " dd " << inits[i] << "\n";
+        }
+        // 输出字符串常量
+        for (auto& p : stringLabels) {
+            out << p.second << " db '" << interner.str(p.first) << "', 0\n";
+        }
+        out << "\n";
+
+        // 输出导入表（由链接器处理，这里仅作标记）
+        if (!externs.empty()) {
+            out << "; 导入符号:\n";
+            for (SymId e : externs) {
+                out << "; extern " << interner.str(e) << "\n";
+            }
+        }
+    }
+};
+
+// ---------- 语法分析器 ----------
+// 二元运算符优先级表（均为左结合），新增运算符只需在此加一行并在 reduce 中生成指令
+struct BinaryOperator {
+    TokenType token;
+    uint8_t prec;
+};
+
+constexpr BinaryOperator BINARY_OPERATORS[] = {
+    { TOK_PLUS, 1 },
+    { TOK_MINUS, 1 },
+    { TOK_MUL, 2 },
+    { TOK_DIV, 2 },
+};
+
+// 按记号类型直接索引，0 表示不是二元运算符（'(' 也是 0，可作栈中分隔）
+struct PrecedenceTable {
+    uint8_t prec[TOK_COUNT];
+};
+
+constexpr PrecedenceTable buildPrecedenceTable() {
+    PrecedenceTable t{};
+    for (const BinaryOperator& b : BINARY_OPERATORS) t.prec[b.token] = b.prec;
+    return t;
+}
+
+constexpr PrecedenceTable PRECEDENCE = buildPrecedenceTable();
+
+// 表达式树：解析时先把整条表达式建成一棵小树（建树时即折叠常数、化简恒等式），
+// 解析完再按 Sethi-Ullman 编号在寄存器中求值。节点只在一条表达式内有效
+enum ExprKind : uint8_t { EXPR_CONST, EXPR_VAR, EXPR_STRING, EXPR_BINARY, EXPR_CALL };
+
+struct ExprNode {
+    ExprKind kind;
+    uint8_t op;        // BINARY: 运算符记号
+    uint8_t need;      // 不溢出到栈所需的寄存器数
+    int value;         // CONST: 值
+    uint32_t left;     // BINARY: 左子节点下标；CALL: 实参在 callArgs 中的起点
+    uint32_t right;    // BINARY: 右子节点下标；CALL: 实参个数
+    const Symbol* sym; // VAR: 变量；CALL: 被调函数，调用在前、定义在后时为空
+    SymId str;         // STRING: 字符串内容；CALL: 函数名
+    bool effects;      // 子树含函数调用（可能改写全局变量），求值顺序不能调换
+};
+
+// 表达式求值用的寄存器：eax 存放结果，ecx/edx 是调用者保存的临时寄存器
+enum Reg : uint8_t { REG_EAX, REG_ECX, REG_EDX, REG_COUNT };
+const char* const REG_NAMES[REG_COUNT] = { "eax", "ecx", "edx" };
+const Reg SCRATCH[REG_COUNT] = { REG_EAX, REG_ECX, REG_EDX };
+
+// 本文件定义的函数前两个实参经 ecx、edx 传递（同 fastcall），其余从右到左压栈、调用方清栈
+const Reg ARG_REGS[] = { REG_ECX, REG_EDX };
+const uint32_t REG_PARAMS = 2;
+
+class Parser {
+    TokenStream& toks;
+    SymbolTable syms;
+    CodeGen& cg;
+    HeaderCache& headers;
+    string sourceDir;  // 当前源文件所在目录，用于解析 #include
+    SymId currentFunction;
+    int localCounter;
+    vector<uint8_t> operators; // 表达式解析的运算符栈（TOK_LPAREN 为括号分隔）
+    vector<uint32_t> operands; // 表达式解析的操作数栈（节点下标）
+    vector<ExprNode> nodes;    // 当前表达式的树节点
+    vector<uint32_t> callArgs; // 当前表达式中各调用的实参（节点下标），每个调用连续存放
+    vector<uint32_t> spine;    // evalNode 沿左链下行时待完成的二元运算
+    struct ForwardCall {
+        SymId name;
+        uint32_t argc;
+    };
+    vector<ForwardCall> forwardCalls; // 调用在前、定义在后的函数，程序结束时核对
+public:
+    Parser(TokenStream& t, CodeGen& gen, HeaderCache& h, const string& dir)
+        : toks(t), cg(gen), headers(h), sourceDir(dir), currentFunction(0), localCounter(0) {}
+
+    void parseProgram() {
+        cg.prolog();
+        while (!toks.check(TOK_EOF)) {
+            if (toks.check(TOK_INT) && toks.kind(1) == TOK_IDENT && toks.kind(2) == TOK_LPAREN) {
+                toks.advance(); // 'int'
+                SymId name = toks.sym();
+                toks.advance();
+                parseFunction(name);
+            }
+            else {
+                applyDecl(parseDecl(), sourceDir);
+            }
+        }
+        for (const ForwardCall& c : forwardCalls) {
+            Symbol* s = syms.lookupGlobal(c.name);
+            if (!s || s->params < 0) {
+                cerr << "未定义的函数: " << interner.str(c.name) << "（外部函数须在调用前声明）" << endl;
+                exit(1);
+            }
+            checkArgCount(s, c.argc);
+        }
+        cg.emitDataSection(syms.getGlobals(), syms.getGlobalInits(), syms.getExterns());
+    }
+
+    // 头文件只允许声明，结果交给调用方（并写入预编译缓存）
+    void parseHeader(vector<Decl>& decls) {
+        while (!toks.check(TOK_EOF)) {
+            decls.push_back(parseDecl());
+        }
+    }
+
+    // 顶层声明：#include、#define、extern 函数、int 全局变量（可带常量初值）
+    Decl parseDecl() {
+        Decl d = { DECL_GLOBAL, 0, 0, 0 };
+        if (toks.check(TOK_INCLUDE)) {
+            d.kind = DECL_INCLUDE;
+            d.name = toks.sym();
+            toks.advance();
+            return d;
+        }
+        if (toks.check(TOK_DEFINE)) {
+            toks.advance(); // '#define'
+            toks.expect(TOK_IDENT, "别名");
+            d.kind = DECL_ALIAS;
+            d.name = toks.sym();
+            toks.advance();
+            toks.expect(TOK_IDENT, "别名目标");
+            d.target = toks.sym();
+            toks.advance();
+            return d;
+        }
+        if (toks.check(TOK_EXTERN)) {
+            parseExtern(d);
+            return d;
+        }
+        if (!toks.check(TOK_INT)) {
+            cerr << "语法错误: 只支持int声明、extern或预处理指令\n";
+            exit(1);
+        }
+        toks.advance(); // 'int'
+        toks.expect(TOK_IDENT, "标识符");
+        d.name = toks.sym();
+        toks.advance();
+        if (toks.match(TOK_ASSIGN)) {
+            d.value = parseConstant();
+        }
+        if (!toks.check(TOK_SEMICOLON)) {
+            cerr << "语法错误: 函数或变量定义后缺少 ; 或 (\n";
+            exit(1);
+        }
+        toks.advance(); // ';'
+        return d;
+    }
+
+    // 全局变量初值：可带负号的整数常量
+    int parseConstant() {
+        bool negative = toks.match(TOK_MINUS);
+        toks.expect(TOK_NUMBER, "常量");
+        int value = toks.value();
+        toks.advance();
+        return negative ? -value : value;
+    }
+
+    void applyDecl(const Decl& d, const string& fromDir) {
+        switch (d.kind) {
+        case DECL_EXTERN:  syms.addExtern(d.name); break;
+        case DECL_GLOBAL:  syms.addGlobal(d.name, d.value); break;
+        case DECL_ALIAS:   syms.addAlias(d.name, d.target); break;
+        case DECL_INCLUDE: includeHeader(d.name, fromDir); break;
+        }
+    }
+
+    void includeHeader(SymId name, const string& fromDir) {
+        string path;
+        if (!headers.resolve(interner.str(name), fromDir, path)) {
+            cerr << "找不到头文件: " << interner.str(name) << endl;
+            exit(1);
+        }
+        if (!headers.markIncluded(path)) return;
+        string text;
+        if (!readSourceFile(path, text)) {
+            cerr << "无法读取头文件: " << path << endl;
+            exit(1);
+        }
+        uint64_t hash = HeaderCache::hashContent(text);
+        vector<Decl> decls;
+        if (!headers.load(path, hash, decls)) {
+            TokenStream headerToks(text.data(), text.data() + text.size());
+            Parser sub(headerToks, cg, headers, dirName(path));
+            sub.parseHeader(decls);
+            headers.save(path, hash, decls);
+        }
+        string dir = dirName(path);
+        for (const Decl& d : decls) applyDecl(d, dir);
+    }
+
+    // extern int name(参数...); 参数只做跳过，也接受 extern int name;
+    void parseExtern(Decl& d) {
+        toks.advance(); // 'extern'
+        toks.expect(TOK_INT, "'int'");
+        toks.advance(); // 'int'
+        toks.expect(TOK_IDENT, "函数名");
+        d.kind = DECL_EXTERN;
+        d.name = toks.sym();
+        toks.advance();
+        if (toks.match(TOK_LPAREN)) {
+            // 解析参数（简化，忽略类型与名字）
+            while (!toks.check(TOK_RPAREN) && !toks.check(TOK_EOF)) toks.advance();
+            toks.expect(TOK_RPAREN, "')'");
+            toks.advance();
+        }
+        toks.expect(TOK_SEMICOLON, "';'");
+        toks.advance();
+    }
+
+    // int name ( [int a {, int b}] ) { ... }
+    void parseFunction(SymId name) {
+        currentFunction = name;
+        syms.beginFunction();
+        localCounter = 0;
+        toks.expect(TOK_LPAREN, "'('");
+        toks.advance(); // '('
+        vector<SymId> params;
+        if (!toks.check(TOK_RPAREN)) {
+            do {
+                toks.expect(TOK_INT, "参数类型 'int'");
+                toks.advance();
+                toks.expect(TOK_IDENT, "参数名");
+                if (find(params.begin(), params.end(), toks.sym()) != params.end()) {
+                    cerr << "重复的参数名: " << interner.str(toks.sym()) << endl;
+                    exit(1);
+                }
+                params.push_back(toks.sym());
+                toks.advance();
+            } while (toks.match(TOK_COMMA));
+        }
+        toks.expect(TOK_RPAREN, "')'");
+        toks.advance(); // ')'
+        toks.expect(TOK_LBRACE, "'{'");
+        toks.advance(); // '{'
+        syms.addFunction(name, (int)params.size()); // 先登记，函数体内可以递归调用
+
+        cg.beginFunction(name);
+        // 寄存器传来的形参存进局部变量槽；其余就在调用方压栈的位置，[ebp+8] 起
+        for (uint32_t k = 0; k < params.size(); ++k) {
+            if (k < REG_PARAMS) {
+                declareLocal(params[k]);
+                cg.emit(OP_MOV, CodeGen::symbolOperand(syms.lookup(params[k])), REG_NAMES[ARG_REGS[k]]);
+            }
+            else syms.addLocal(params[k], 8 + 4 * (int)(k - REG_PARAMS));
+        }
+
+        while (!toks.check(TOK_RBRACE) && !toks.check(TOK_EOF)) {
+            parseStatement();
+        }
+
+        toks.expect(TOK_RBRACE, "'}'");
+        toks.advance(); // '}'
+
+        cg.endFunction();
+    }
+
+    // 没有块作用域，同名变量再次声明后旧变量再也访问不到，新变量直接沿用它的栈槽
+    void declareLocal(SymId name) {
+        Symbol* old = syms.lookupLocal(name);
+        bool reused = old && old->offset < 0;
+        if (!reused) syms.addLocal(name, -4 - 4 * localCounter++);
+        cg.addLocal(reused);
+    }
+
+    void parseStatement() {
+        if (toks.check(TOK_INT)) {
+            toks.advance(); // 'int'
+            toks.expect(TOK_IDENT, "变量名");
+            SymId varName = toks.sym();
+            toks.advance();
+            declareLocal(varName);
+            // 可选初始化
+            if (toks.check(TOK_ASSIGN)) {
+                toks.advance(); // '='
+                parseExpression();
+                cg.emit(OP_MOV, CodeGen::symbolOperand(syms.lookup(varName)), "eax");
+            }
+            toks.expect(TOK_SEMICOLON, "';'");
+            toks.advance(); // ';'
+        }
+        else if (toks.check(TOK_IDENT) && toks.kind(1) == TOK_LPAREN) {
+            // 函数调用语句，丢弃返回值
+            SymId name = toks.sym();
+            toks.advance(); // ident
+            size_t nodeBase = nodes.size();
+            size_t argBase = callArgs.size();
+            evaluate(parseCall(name), nodeBase, argBase);
+            toks.expect(TOK_SEMICOLON, "';'");
+            toks.advance(); // ';'
+        }
+        else if (toks.check(TOK_IDENT)) {
+            SymId varName = toks.sym();
+            toks.advance(); // ident
+            Symbol* s = syms.lookup(varName);
+            if (!s) { cerr << "未定义变量: " << interner.str(varName) << endl; exit(1); }
+            if (s->isExtern || s->params >= 0) { cerr << "不能给函数赋值: " << interner.str(varName) << endl; exit(1); }
+            // 赋值
+            toks.expect(TOK_ASSIGN, "'='");
+            toks.advance(); // '='
+            parseExpression();
+            toks.expect(TOK_SEMICOLON, "';'");
+            toks.advance(); // ';'
+            cg.emit(OP_MOV, CodeGen::symbolOperand(s), "eax");
+        }
+        else if (toks.check(TOK_PRINT)) {
+            toks.advance(); // print
+            toks.expect(TOK_LPAREN, "'('");
+            toks.advance(); // '('
+            parseExpression(); // 结果在 eax
+            toks.expect(TOK_RPAREN, "')'");
+            toks.advance(); // ')'
+            toks.expect(TOK_SEMICOLON, "';'");
+            toks.advance(); // ';'
+            // 生成对 printf 的调用（需有 extern int printf(...)）
+            cg.emit(OP_PUSH, "eax");
+            cg.emit(OP_PUSH, "format"); // 需定义格式字符串
+            cg.emit(OP_CALL, "_printf");
+            cg.emit(OP_ADD, "esp", "8");
+        }
+        else if (toks.check(TOK_RETURN)) {
+            toks.advance(); // return
+            parseExpression();
+            toks.expect(TOK_SEMICOLON, "';'");
+            toks.advance(); // ';'
+            cg.emit(OP_JMP, string(".return_") + interner.str(currentFunction));
+        }
+        else if (toks.check(TOK_STRING)) {
+            // 字符串作为表达式处理
+            SymId str = toks.sym();
+            toks.advance();
+            cg.emitString(str);
+        }
+        else {
+            cerr << "语法错误: 未知语句" << endl;
+            exit(1);
+        }
+    }
+
+    // 解析一条表达式并生成代码，结果在 eax
+    void parseExpression() {
+        size_t nodeBase = nodes.size();
+        size_t argBase = callArgs.size();
+        evaluate(parseTree(), nodeBase, argBase);
+    }
+
+    // 为建好的表达式树生成代码，然后丢弃这条表达式的节点
+    void evaluate(uint32_t root, size_t nodeBase, size_t argBase) {
+        evalNode(root, SCRATCH, REG_COUNT);
+        nodes.resize(nodeBase);
+        callArgs.resize(argBase);
+    }
+
+    // 表达式解析：优先级爬升，运算符用显式栈，括号也只压栈，不随优先级层数递归
+    // （只有函数调用的实参递归解析）。返回表达式树的根
+    uint32_t parseTree() {
+        size_t opBase = operators.size();
+        int depth = 0; // 本表达式中尚未闭合的 '(' 数
+        while (true) {
+            while (toks.match(TOK_LPAREN)) {
+                operators.push_back(TOK_LPAREN);
+                depth++;
+            }
+            parseFactor(); // 操作数入栈
+            while (depth > 0 && toks.match(TOK_RPAREN)) {
+                reduce(opBase, 1);
+                operators.pop_back(); // '('
+                depth--;
+            }
+            TokenType op = toks.kind();
+            int prec = PRECEDENCE.prec[op];
+            if (prec == 0) break;
+            reduce(opBase, prec);
+            operators.push_back((uint8_t)op);
+            toks.advance();
+        }
+        if (depth > 0) toks.expect(TOK_RPAREN, "')'"); // 括号未闭合
+        reduce(opBase, 1);
+        uint32_t root = operands.back();
+        operands.pop_back();
+        return root;
+    }
+
+    // 归约栈顶优先级不低于 minPrec 的运算符
+    void reduce(size_t opBase, int minPrec) {
+        while (operators.size() > opBase) {
+            TokenType op = (TokenType)operators.back();
+            if (PRECEDENCE.prec[op] < minPrec) break;
+            operators.pop_back();
+            uint32_t right = operands.back();
+            operands.pop_back();
+            operands.back() = makeBinary(op, operands.back(), right);
+        }
+    }
+
+    // 编译期求值，按32位补码回绕；除数为0或 INT_MIN/-1 不折叠，留给运行时照常出错
+    static bool fold(TokenType op, int l, int r, int& v) {
+        uint32_t ul = (uint32_t)l, ur = (uint32_t)r;
+        switch (op) {
+        case TOK_PLUS:  v = (int)(ul + ur); return true;
+        case TOK_MINUS: v = (int)(ul - ur); return true;
+        case TOK_MUL:   v = (int)(ul * ur); return true;
+        case TOK_DIV:
+            if (r == 0 || (l == INT32_MIN && r == -1)) return false;
+            v = l / r; return true;
+        default: return false;
+        }
+    }
+
+    uint32_t addNode(const ExprNode& n) {
+        nodes.push_back(n);
+        return (uint32_t)nodes.size() - 1;
+    }
+
+    uint32_t constant(int v) { return addNode(ExprNode{ EXPR_CONST, 0, 1, v, 0, 0, nullptr, 0, false }); }
+
+    bool isLeaf(uint32_t i) const { return nodes[i].kind <= EXPR_STRING; }
+    bool isConst(uint32_t i, int c) const { return nodes[i].kind == EXPR_CONST && nodes[i].value == c; }
+
+    // 建二元运算节点。两侧都是常数直接折叠；化简 x+0、x-0、x*1、x/1、x*0
+    // （被乘以0的一侧不含函数调用时可以整个丢掉）
+    uint32_t makeBinary(TokenType op, uint32_t l, uint32_t r) {
+        int v;
+        if (nodes[l].kind == EXPR_CONST && nodes[r].kind == EXPR_CONST &&
+            fold(op, nodes[l].value, nodes[r].value, v)) {
+            return constant(v);
+        }
+        switch (op) {
+        case TOK_PLUS:
+            if (isConst(r, 0)) return l;
+            if (isConst(l, 0)) return r;
+            break;
+        case TOK_MINUS:
+            if (isConst(r, 0)) return l;
+            break;
+        case TOK_MUL:
+            if (isConst(r, 1)) return l;
+            if (isConst(l, 1)) return r;
+            if ((isConst(l, 0) && !nodes[r].effects) || (isConst(r, 0) && !nodes[l].effects)) return constant(0);
+            break;
+        case TOK_DIV:
+            if (isConst(r, 1)) return l;
+            break;
+        default:
+            break;
+        }
+        uint8_t ln = nodes[l].need;
+        uint8_t rn = isLeaf(r) ? 0 : nodes[r].need;
+        uint8_t need = ln == rn ? ln + 1 : max(ln, rn);
+        bool effects = nodes[l].effects || nodes[r].effects;
+        return addNode(ExprNode{ EXPR_BINARY, (uint8_t)op, need, 0, l, r, nullptr, 0, effects });
+    }
+
+    // 函数调用 name(实参, ...)：各实参单独建树。名字尚未声明时当作后面定义的函数，
+    // 实参个数留到程序结束时核对；外部函数必须先声明
+    uint32_t parseCall(SymId name) {
+        Symbol* s = syms.lookup(name);
+        if (s && !s->isExtern && s->params < 0) { cerr << "不是函数: " << interner.str(name) << endl; exit(1); }
+        toks.advance(); // '('
+        vector<uint32_t> args;
+        if (!toks.check(TOK_RPAREN)) {
+            do args.push_back(parseTree()); while (toks.match(TOK_COMMA));
+        }
+        toks.expect(TOK_RPAREN, "')'");
+        toks.advance(); // ')'
+        uint32_t argc = (uint32_t)args.size();
+        if (s) checkArgCount(s, argc);
+        else forwardCalls.push_back({ name, argc });
+        uint8_t need = 1;
+        for (uint32_t a : args) need = max(need, nodes[a].need);
+        uint32_t start = (uint32_t)callArgs.size();
+        callArgs.insert(callArgs.end(), args.begin(), args.end());
+        return addNode(ExprNode{ EXPR_CALL, 0, need, 0, start, argc, s, s ? s->name : name, true }); // 别名已解析到实际函数名
+    }
+
+    static void checkArgCount(const Symbol* s, uint32_t argc) {
+        if (s->params >= 0 && (uint32_t)s->params != argc) {
+            cerr << "函数 " << interner.str(s->name) << " 需要 " << s->params << " 个参数，传入了 " << argc << " 个" << endl;
+            exit(1);
+        }
+    }
+
+    // 因子入操作数栈
+    void parseFactor() {
+        if (toks.check(TOK_NUMBER)) {
+            operands.push_back(constant(toks.value()));
+            toks.advance();
+        }
+        else if (toks.check(TOK_IDENT)) {
+            SymId name = toks.sym();
+            toks.advance();
+            if (toks.check(TOK_LPAREN)) {
+                operands.push_back(parseCall(name));
+                return;
+            }
+            Symbol* s = syms.lookup(name);
+            if (!s) { cerr << "未定义变量: " << interner.str(name) << endl; exit(1); }
+            if (s->isExtern || s->params >= 0) { cerr << "函数名不能作为值: " << interner.str(name) << endl; exit(1); }
+            operands.push_back(addNode(ExprNode{ EXPR_VAR, 0, 1, 0, 0, 0, s, 0, false }));
+        }
+        else if (toks.check(TOK_STRING)) {
+            // 字符串直接量：值为其在数据段中的标签地址
+            operands.push_back(addNode(ExprNode{ EXPR_STRING, 0, 1, 0, 0, 0, nullptr, toks.sym(), false }));
+            toks.advance();
+        }
+        else {
+            cerr << "语法错误: 期望因子" << endl;
+            exit(1);
+        }
+    }
+
+    // ---- 表达式求值 ----
+    // 较重的子树先算，另一侧用剩下的寄存器；右操作数是叶子时直接作指令操作数。
+    // 寄存器只剩一个时退回栈：两侧依次压栈，左值取回寄存器，右值以 [esp] 为操作数
+
+    // 叶子作指令操作数：常数、变量内存操作数或字符串标签；sized 时内存操作数带 dword（idiv）
+    string leafOperand(const ExprNode& leaf, bool sized = false) {
+        switch (leaf.kind) {
+        case EXPR_CONST:  return to_string(leaf.value);
+        case EXPR_VAR:    return CodeGen::symbolOperand(leaf.sym, sized);
+        default:          return cg.stringLabel(leaf.str);
+        }
+    }
+
+    // 把节点 i 的值算进 regs[0]；regs[0..n) 可以随意改写，其余寄存器保持不变。
+    // 长的 a+b+c+... 是左深的树：先用同样寄存器算左侧的运算沿左链一直走到底，
+    // 算完最底下的节点再由下往上完成各层，调用栈不随链长加深
+    void evalNode(uint32_t i, const Reg* regs, int n) {
+        size_t base = spine.size();
+        while (leftFirst(i, n)) {
+            spine.push_back(i);
+            i = nodes[i].left;
+        }
+        const ExprNode& e = nodes[i];
+        if (e.kind == EXPR_CALL) evalCall(e, regs, n);
+        else if (isLeaf(i)) cg.emit(OP_MOV, REG_NAMES[regs[0]], leafOperand(e));
+        else if (e.op == TOK_DIV) evalDivide(e, regs, n);
+        else evalBinary(i, regs, n, false);
+        while (spine.size() > base) {
+            evalBinary(spine.back(), regs, n, true);
+            spine.pop_back();
+        }
+    }
+
+    // 加法、乘法可交换：叶子（尤其是常数）换到右边直接作操作数。
+    // 另一侧有函数调用时变量不能换到调用之后读取
+    bool swapsOperands(const ExprNode& e) const {
+        uint32_t a = e.left, b = e.right;
+        bool swapLeaf = isLeaf(a) && (!isLeaf(b) || (nodes[a].kind == EXPR_CONST && nodes[b].kind != EXPR_CONST));
+        return e.op != TOK_MINUS && swapLeaf && (!nodes[b].effects || nodes[a].kind != EXPR_VAR);
+    }
+
+    // 两侧都不是叶子时编号大的一侧先算（有函数调用时保持从左到右）
+    bool rightFirst(uint32_t a, uint32_t b) const {
+        return nodes[b].need > nodes[a].need && !nodes[a].effects && !nodes[b].effects;
+    }
+
+    // 二元运算 i 是否先用同样的 regs[0..n) 算不交换的左侧
+    bool leftFirst(uint32_t i, int n) const {
+        const ExprNode& e = nodes[i];
+        if (e.kind != EXPR_BINARY || e.op == TOK_DIV || swapsOperands(e)) return false;
+        return isLeaf(e.right) || n < 2 || !rightFirst(e.left, e.right);
+    }
+
+    // 加、减、乘；leftDone 表示左值已经在 regs[0] 中
+    void evalBinary(uint32_t i, const Reg* regs, int n, bool leftDone) {
+        const ExprNode& e = nodes[i];
+        uint32_t a = e.left, b = e.right;
+        TokenType op = (TokenType)e.op;
+        if (swapsOperands(e)) swap(a, b);
+
+        const char* r = REG_NAMES[regs[0]];
+        Opcode opcode = op == TOK_PLUS ? OP_ADD : op == TOK_MINUS ? OP_SUB : OP_IMUL;
+        if (isLeaf(b)) {
+            if (!leftDone) evalNode(a, regs, n);
+            if (op == TOK_MUL && nodes[b].kind != EXPR_VAR) {
+                // 立即数乘法：常数先试移位、lea 等序列，否则用三操作数形式
+                if (nodes[b].kind != EXPR_CONST ||
+                    !lowerMulConst(cg.instrs(), r, n >= 2 ? REG_NAMES[regs[1]] : "", nodes[b].value)) {
+                    cg.emit(OP_IMUL, r, r, leafOperand(nodes[b]));
+                }
+            }
+            else {
+                cg.emit(opcode, r, leafOperand(nodes[b]));
+            }
+            return;
+        }
+        if (n >= 2) {
+            evalOperands(a, b, regs, n, leftDone);
+            cg.emit(opcode, r, REG_NAMES[regs[1]]);
+            return;
+        }
+        evalOnStack(a, b, regs[0], leftDone);
+        cg.emit(opcode, r, "dword [esp]");
+        cg.emit(OP_ADD, "esp", "8");
+    }
+
+    // 两侧都不是叶子：左值进 regs[0]，右值进 regs[1]
+    void evalOperands(uint32_t a, uint32_t b, const Reg* regs, int n, bool leftDone) {
+        Reg rest[REG_COUNT];
+        if (rightFirst(a, b)) {
+            rest[0] = regs[1];
+            rest[1] = regs[0];
+            copy(regs + 2, regs + n, rest + 2);
+            evalNode(b, rest, n);
+            rest[0] = regs[0];
+            copy(regs + 2, regs + n, rest + 1);
+            evalNode(a, rest, n - 1);
+        }
+        else {
+            if (!leftDone) evalNode(a, regs, n);
+            evalNode(b, regs + 1, n - 1);
+        }
+    }
+
+    // 函数调用，返回值在 eax。本文件定义的函数前两个实参放在 ecx、edx，其余实参与外部函数一样
+    // 按 cdecl 从右到左压栈、调用方清栈。被调函数会改写全部三个求值寄存器，
+    // regs 以外保存着外层中间值的先压栈保存
+    void evalCall(const ExprNode& e, const Reg* regs, int n) {
+        bool external = e.sym && e.sym->isExtern;
+        uint32_t argc = e.right;
+        uint32_t inRegs = external ? 0 : min(argc, REG_PARAMS);
+        vector<Reg> saved;
+        for (Reg r : SCRATCH) {
+            if (find(regs, regs + n, r) != regs + n) continue;
+            saved.push_back(r);
+            cg.emit(OP_PUSH, REG_NAMES[r]);
+        }
+        bool effects = false;
+        for (uint32_t k = 0; k < argc; ++k) effects = effects || nodes[callArgs[e.left + k]].effects;
+        if (!effects) {
+            // 实参没有副作用：从右到左算一个压一个
+            for (uint32_t k = argc; k-- > 0;) {
+                uint32_t a = callArgs[e.left + k];
+                if (isLeaf(a)) cg.emit(OP_PUSH, leafOperand(nodes[a], true));
+                else {
+                    evalNode(a, SCRATCH, REG_COUNT);
+                    cg.emit(OP_PUSH, "eax");
+                }
+            }
+        }
+        else {
+            // 实参含调用：从左到右求值，依次存入预留的栈空间
+            cg.emit(OP_SUB, "esp", to_string(4 * argc));
+            for (uint32_t k = 0; k < argc; ++k) {
+                evalNode(callArgs[e.left + k], SCRATCH, REG_COUNT);
+                cg.emit(OP_MOV, k ? "[esp+" + to_string(4 * k) + "]" : "[esp]", "eax");
+            }
+        }
+        for (uint32_t k = 0; k < inRegs; ++k) cg.emit(OP_POP, REG_NAMES[ARG_REGS[k]]);
+        cg.emit(OP_CALL, string(external ? "_" : "") + interner.str(e.str));
+        if (argc > inRegs) cg.emit(OP_ADD, "esp", to_string(4 * (argc - inRegs)));
+        if (regs[0] != REG_EAX) cg.emit(OP_MOV, REG_NAMES[regs[0]], "eax");
+        for (size_t k = saved.size(); k-- > 0;) cg.emit(OP_POP, REG_NAMES[saved[k]]);
+    }
+
+    // 只剩一个寄存器：[esp+4] 为左值、[esp] 为右值，左值取回 r
+    void evalOnStack(uint32_t a, uint32_t b, Reg r, bool leftDone) {
+        if (!leftDone) evalNode(a, &r, 1);
+        cg.emit(OP_PUSH, REG_NAMES[r]);
+        evalNode(b, &r, 1);
+        cg.emit(OP_PUSH, REG_NAMES[r]);
+        cg.emit(OP_MOV, REG_NAMES[r], "[esp+4]");
+    }
+
+    // idiv 固定使用 edx:eax。eax、edx 都可改写时被除数直接算进 eax，
+    // 除数是变量直接作操作数，否则先放进 ecx；寄存器不够时两侧压栈，以栈上的除数做除法。
+    // 除数是常数时先试不用 idiv 的序列
+    void evalDivide(const ExprNode& e, const Reg* regs, int n) {
+        Reg r = regs[0];
+        bool eaxFree = find(regs, regs + n, REG_EAX) != regs + n;
+        bool edxFree = find(regs, regs + n, REG_EDX) != regs + n;
+        bool ecxFree = find(regs, regs + n, REG_ECX) != regs + n;
+        const ExprNode& divisor = nodes[e.right];
+        if (divisor.kind == EXPR_CONST && evalDivideConst(e, regs, n, eaxFree, edxFree, ecxFree)) return;
+        if (eaxFree && edxFree && (divisor.kind == EXPR_VAR || (ecxFree && isLeaf(e.right)))) {
+            Reg eaxFirst[REG_COUNT] = { REG_EAX };
+            int m = 1;
+            for (int k = 0; k < n; ++k) {
+                if (regs[k] != REG_EAX) eaxFirst[m++] = regs[k];
+            }
+            evalNode(e.left, eaxFirst, n);
+            if (divisor.kind == EXPR_VAR) {
+                cg.emit(OP_CDQ);
+                cg.emit(OP_IDIV, leafOperand(divisor, true));
+            }
+            else {
+                cg.emit(OP_MOV, "ecx", leafOperand(divisor));
+                cg.emit(OP_CDQ);
+                cg.emit(OP_IDIV, "ecx");
+            }
+            if (r != REG_EAX) cg.emit(OP_MOV, REG_NAMES[r], "eax");
+            return;
+        }
+        evalNode(e.left, regs, n);
+        cg.emit(OP_PUSH, REG_NAMES[r]);
+        evalNode(e.right, regs, n);
+        cg.emit(OP_PUSH, REG_NAMES[r]);
+        int saved = 0;
+        if (!eaxFree) { cg.emit(OP_PUSH, "eax"); saved += 4; }
+        if (!edxFree) { cg.emit(OP_PUSH, "edx"); saved += 4; }
+        cg.emit(OP_MOV, "eax", "[esp+" + to_string(saved + 4) + "]");
+        cg.emit(OP_CDQ);
+        cg.emit(OP_IDIV, "dword [esp+" + to_string(saved) + "]");
+        if (r != REG_EAX) cg.emit(OP_MOV, REG_NAMES[r], "eax");
+        if (!edxFree) cg.emit(OP_POP, "edx");
+        if (!eaxFree) cg.emit(OP_POP, "eax");
+        cg.emit(OP_ADD, "esp", "8");
+    }
+
+    // 除以常数：±2^k 在 regs[0] 中移位，要一个临时寄存器；其他除数乘魔数。
+    // 三个寄存器都可改写时被除数算进 ecx；否则被除数是变量就直接作操作数，
+    // 不是变量则算好后压栈，被占用的 eax、edx 临时保存。条件不满足返回 false
+    bool evalDivideConst(const ExprNode& e, const Reg* regs, int n, bool eaxFree, bool edxFree, bool ecxFree) {
+        int d = nodes[e.right].value;
+        uint32_t m = d < 0 ? 0u - (uint32_t)d : (uint32_t)d;
+        Reg r = regs[0];
+        if (isPowerOfTwo(m)) {
+            if (m > 1 && n < 2) return false;
+            evalNode(e.left, regs, n);
+            lowerDivPowerOfTwo(cg.instrs(), REG_NAMES[r], m > 1 ? REG_NAMES[regs[1]] : "", d);
+            return true;
+        }
+        if (m == 0) return false;
+        const ExprNode& dividend = nodes[e.left];
+        bool isVar = dividend.kind == EXPR_VAR;
+        if (eaxFree && edxFree && ecxFree && !isVar) {
+            static const Reg ECX_FIRST[REG_COUNT] = { REG_ECX, REG_EAX, REG_EDX };
+            evalNode(e.left, ECX_FIRST, REG_COUNT);
+            lowerDivMagic(cg.instrs(), "ecx", d);
+            if (r != REG_EDX) cg.emit(OP_MOV, REG_NAMES[r], "edx");
+            return true;
+        }
+        string operand;
+        if (isVar) operand = leafOperand(dividend, true);
+        else {
+            evalNode(e.left, regs, n);
+            cg.emit(OP_PUSH, REG_NAMES[r]);
+        }
+        int saved = 0;
+        if (!eaxFree) { cg.emit(OP_PUSH, "eax"); saved += 4; }
+        if (!edxFree) { cg.emit(OP_PUSH, "edx"); saved += 4; }
+        if (!isVar) operand = "dword [esp+" + to_string(saved) + "]";
+        lowerDivMagic(cg.instrs(), operand, d);
+        if (r != REG_EDX) cg.emit(OP_MOV, REG_NAMES[r], "edx");
+        if (!edxFree) cg.emit(OP_POP, "edx");
+        if (!eaxFree) cg.emit(OP_POP, "eax");
+        if (!isVar) cg.emit(OP_LEA, "esp", "[esp+4]");
+        return true;
+    }
+};
+
+// ---------- 主函数 ----------
+int main(int argc, char* argv[]) {
+    string srcFile;
+    string outFile;
+    bool versionOnly = false;
+    bool peepholeStats = false;
+    bool frameStats = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--version") {
+            cout << "Emerging compiler version " << EMERGING_VERSION << endl;
+            versionOnly = true;
+            break;
+        }
+        else if (arg == "--peephole-stats") {
+            peepholeStats = true;
+        }
+        else if (arg == "--frame-stats") {
+            frameStats = true;
+        }
+        else if (arg == "-o") {
+            if (i + 1 < argc) {
+                outFile = argv[++i];
+            }
+            else {
+                cerr << "错误: -o 选项缺少参数" << endl;
+                return 1;
+            }
+        }
+        else if (arg[0] == '-') {
+            cerr << "未知选项: " << arg << endl;
+            return 1;
+        }
+        else {
+            if (!srcFile.empty()) {
+                cerr << "错误: 只能指定一个源文件" << endl;
+                return 1;
+            }
+            srcFile = arg;
+        }
+    }
+
+    if (versionOnly) return 0;
+
+    if (srcFile.empty()) {
+        cerr << "用法: emerging.exe [--version] [--peephole-stats] [--frame-stats] [-o output.exe] <源文件.emg>" << endl;
+        return 1;
+    }
+
+    string source;
+    if (!readSourceFile(srcFile, source)) {
+        cerr << "无法打开源文件: " << srcFile << endl;
+        return 1;
+    }
+
+    string baseName = getBaseName(srcFile);
+    string asmFile = baseName + ".asm";
+    if (outFile.empty()) {
+        outFile = baseName + ".exe";
+    }
+
+    ofstream out(asmFile);
+    if (!out) {
+        cerr << "无法创建汇编文件: " << asmFile << endl;
+        return 1;
+    }
+
+    // 头文件搜索顺序：源文件目录、编译器所在目录下的 include、当前目录下的 include
+    HeaderCache headers;
+    headers.addSearchDir(dirName(argv[0]) + "include/");
+    headers.addSearchDir("include/");
+
+    TokenStream toks(source.data(), source.data() + source.size());
+    CodeGen cg(out);
+    Parser parser(toks, cg, headers, dirName(srcFile));
+    parser.parseProgram();
+    if (peepholeStats) cg.peepholeStats().printStats(cerr);
+    if (frameStats) cg.printFrameStats(cerr);
+
+    out.close();
+    cout << "汇编代码已生成: " << asmFile << endl;
+
+    // 调用 linker.exe 进行汇编和链接
+    string linkerCmd = "linker.exe " + asmFile + " " + outFile;
+    cout << "执行: " << linkerCmd << endl;
+    int ret = system(linkerCmd.c_str());
+    if (ret != 0) {
+        cerr << "链接失败" << endl;
+        return 1;
+    }
+
+    cout << "编译成功，生成可执行文件: " << outFile << endl;
+    return 0;
 }
\ No newline at end of file
@@ -1,748 +1,4713 @@
-// emerging.cpp - EmergingԱ (i686汾)
-// ÷: i686-emerging.exe [--version] input.emg [output.asm]
-// ɻ룬nasm -f elf32
-
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <vector>
-#include <map>
-#include <memory>
-#include <cctype>
-#include <cstdlib>
-
-using namespace std;
-
-// ---------- 汾Ϣ ----------
-const string VERSION = "i686 Emerging ԰汾1.0.0";
-
-// ---------- н ----------
-void printVersionAndExit() {
-    cout << VERSION << endl;
-    exit(0);
-}
-
-// ---------- ʷ ----------
-enum TokenType {
-    TOKEN_EOF, TOKEN_IDENT, TOKEN_NUMBER,
-    TOKEN_INT, TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_RETURN,
-    TOKEN_ASSIGN, TOKEN_EQ, TOKEN_NE, TOKEN_LT, TOKEN_LE, TOKEN_GT, TOKEN_GE,
-    TOKEN_PLUS, TOKEN_MINUS, TOKEN_MUL, TOKEN_DIV,
-    TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_LBRACE, TOKEN_RBRACE,
-    TOKEN_SEMICOLON, TOKEN_UNKNOWN
-};
-
-struct Token {
-    TokenType type;
-    string text;
-    int intVal;
-    Token(TokenType t = TOKEN_UNKNOWN, const string& txt = "", int v = 0)
-        : type(t), text(txt), intVal(v) {
-    }
-};
-
-class Lexer {
-    istream& in;
-    char cur;
-    int line, col;
-public:
-    Lexer(istream& is) : in(is), cur(0), line(1), col(0) { nextChar(); }
-
-    Token nextToken() {
-        while (isspace(cur)) nextChar();
-        if (cur == 0) return Token(TOKEN_EOF, "EOF");
-        if (isalpha(cur) || cur == '_') return readIdent();
-        if (isdigit(cur)) return readNumber();
-        if (cur == '/') {
-            nextChar();
-            if (cur == '/') { skipLineComment(); return nextToken(); }
-            if (cur == '*') { skipBlockComment(); return nextToken(); }
-            return Token(TOKEN_DIV, "/");
-        }
-        char ch = cur;
-        nextChar();
-        switch (ch) {
-        case '=':
-            if (cur == '=') { nextChar(); return Token(TOKEN_EQ, "=="); }
-            return Token(TOKEN_ASSIGN, "=");
-        case '!':
-            if (cur == '=') { nextChar(); return Token(TOKEN_NE, "!="); }
-            return Token(TOKEN_UNKNOWN, "!");
-        case '<':
-            if (cur == '=') { nextChar(); return Token(TOKEN_LE, "<="); }
-            return Token(TOKEN_LT, "<");
-        case '>':
-            if (cur == '=') { nextChar(); return Token(TOKEN_GE, ">="); }
-            return Token(TOKEN_GT, ">");
-        case '+': return Token(TOKEN_PLUS, "+");
-        case '-': return Token(TOKEN_MINUS, "-");
-        case '*': return Token(TOKEN_MUL, "*");
-        case '(': return Token(TOKEN_LPAREN, "(");
-        case ')': return Token(TOKEN_RPAREN, ")");
-        case '{': return Token(TOKEN_LBRACE, "{");
-        case '}': return Token(TOKEN_RBRACE, "}");
-        case ';': return Token(TOKEN_SEMICOLON, ";");
-        default: return Token(TOKEN_UNKNOWN, string(1, ch));
-        }
-    }
-
-private:
-    void nextChar() {
-        if (in.get(cur)) {
-            if (cur == '\n') { line++; col = 0; }
-            else col++;
-        }
-        else cur = 0;
-    }
-
-    Token readIdent() {
-        string ident;
-        while (isalnum(cur) || cur == '_') {
-            ident += cur;
-            nextChar();
-        }
-        if (ident == "int") return Token(TOKEN_INT, ident);
-        if (ident == "if") return Token(TOKEN_IF, ident);
-        if (ident == "else") return Token(TOKEN_ELSE, ident);
-        if (ident == "while") return Token(TOKEN_WHILE, ident);
-        if (ident == "return") return Token(TOKEN_RETURN, ident);
-        return Token(TOKEN_IDENT, ident);
-    }
-
-    Token readNumber() {
-        string num;
-        while (isdigit(cur)) {
-            num += cur;
-            nextChar();
-        }
-        int val = atoi(num.c_str());
-        return Token(TOKEN_NUMBER, num, val);
-    }
-
-    void skipLineComment() {
-        while (cur != '\n' && cur != 0) nextChar();
-    }
-
-    void skipBlockComment() {
-        nextChar(); //  '*'
-        while (true) {
-            if (cur == 0) break;
-            if (cur == '*') {
-                nextChar();
-                if (cur == '/') { nextChar(); break; }
-            }
-            else nextChar();
-        }
-    }
-};
-
-// ---------- ﷨ ----------
-struct Expr;
-struct Stmt;
-struct Function;
-
-struct Expr {
-    virtual ~Expr() {}
-};
-
-struct IntConst : Expr {
-    int value;
-    IntConst(int v) : value(v) {}
-};
-
-struct VarRef : Expr {
-    string name;
-    VarRef(const string& n) : name(n) {}
-};
-
-enum BinOp { BIN_ADD, BIN_SUB, BIN_MUL, BIN_DIV, BIN_LT, BIN_LE, BIN_GT, BIN_GE, BIN_EQ, BIN_NE };
-
-// Զ帳ֵ루öֵͻ
-const BinOp BIN_ASSIGN = static_cast<BinOp>(100);
-
-struct BinaryOp : Expr {
-    BinOp op;
-    unique_ptr<Expr> left, right;
-    BinaryOp(BinOp o, unique_ptr<Expr> l, unique_ptr<Expr> r) : op(o), left(move(l)), right(move(r)) {}
-};
-
-struct Stmt {
-    virtual ~Stmt() {}
-};
-
-struct AssignStmt : Stmt {
-    string var;
-    unique_ptr<Expr> rhs;
-    AssignStmt(const string& v, unique_ptr<Expr> e) : var(v), rhs(move(e)) {}
-};
-
-struct IfStmt : Stmt {
-    unique_ptr<Expr> cond;
-    unique_ptr<Stmt> thenStmt;
-    unique_ptr<Stmt> elseStmt;
-    IfStmt(unique_ptr<Expr> c, unique_ptr<Stmt> t, unique_ptr<Stmt> e = nullptr)
-        : cond(move(c)), thenStmt(move(t)), elseStmt(move(e)) {
-    }
-};
-
-struct WhileStmt : Stmt {
-    unique_ptr<Expr> cond;
-    unique_ptr<Stmt> body;
-    WhileStmt(unique_ptr<Expr> c, unique_ptr<Stmt> b) : cond(move(c)), body(move(b)) {}
-};
-
-struct ReturnStmt : Stmt {
-    unique_ptr<Expr> expr;
-    ReturnStmt(unique_ptr<Expr> e) : expr(move(e)) {}
-};
-
-struct BlockStmt : Stmt {
-    vector<unique_ptr<Stmt>> stmts;
-};
-
-// ڵ㣬ڴ
-struct DeclStmt : Stmt {
-    string var;
-    DeclStmt(const string& v) : var(v) {}
-};
-
-struct Function {
-    string name;
-    vector<string> params; // ݲֲ֧
-    unique_ptr<BlockStmt> body;
-};
-
-struct Program {
-    vector<unique_ptr<Function>> functions;
-};
-
-// ---------- ű ----------
-struct Symbol {
-    int offset; // ջƫƣebpֵ
-    Symbol(int off = 0) : offset(off) {}
-};
-
-class Scope {
-    vector<map<string, Symbol>> scopes;
-    int stackSize; // ǰֲռֽ
-public:
-    Scope() : stackSize(0) { push(); }
-
-    void push() { scopes.emplace_back(); }
-    void pop() { scopes.pop_back(); }
-
-    bool declare(const string& name) {
-        if (scopes.back().count(name)) return false; // ظ
-        stackSize += 4;
-        scopes.back()[name] = Symbol(-stackSize);
-        return true;
-    }
-
-    Symbol* lookup(const string& name) {
-        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-            auto f = it->find(name);
-            if (f != it->end()) return &f->second;
-        }
-        return nullptr;
-    }
-
-    int totalStackSize() const { return stackSize; }
-};
-
-// ---------- ﷨ ----------
-class Parser {
-    Lexer& lex;
-    Token curTok;
-public:
-    Parser(Lexer& l) : lex(l) { curTok = lex.nextToken(); }
-
-    unique_ptr<Program> parse() {
-        auto prog = make_unique<Program>();
-        while (curTok.type != TOKEN_EOF) {
-            if (curTok.type == TOKEN_INT) {
-                prog->functions.push_back(parseFunction());
-            }
-            else {
-                error("expected 'int' for function");
-            }
-        }
-        return prog;
-    }
-
-private:
-    void advance() { curTok = lex.nextToken(); }
-    bool check(TokenType tt) { return curTok.type == tt; }
-    bool match(TokenType tt) {
-        if (check(tt)) { advance(); return true; }
-        return false;
-    }
-    void expect(TokenType tt, const string& msg) {
-        if (!match(tt)) error(msg);
-    }
-
-    [[noreturn]] void error(const string& msg) {
-        cerr << "﷨: " << msg << "  '" << curTok.text << "' \n";
-        exit(1);
-    }
-
-    // int name ( ) { ... }
-    unique_ptr<Function> parseFunction() {
-        expect(TOKEN_INT, "Ҫ 'int'");
-        if (curTok.type != TOKEN_IDENT) error("Ҫ");
-        string name = curTok.text;
-        advance();
-        expect(TOKEN_LPAREN, "Ҫ '('");
-        expect(TOKEN_RPAREN, "Ҫ ')'");
-        expect(TOKEN_LBRACE, "Ҫ '{'");
-        auto body = parseBlock();
-        auto func = make_unique<Function>();
-        func->name = name;
-        func->body = move(body);
-        return func;
-    }
-
-    // 䣺{ ... }
-    unique_ptr<BlockStmt> parseBlock() {
-        auto block = make_unique<BlockStmt>();
-        while (!check(TOKEN_RBRACE) && !check(TOKEN_EOF)) {
-            block->stmts.push_back(parseStmt());
-        }
-        expect(TOKEN_RBRACE, "Ҫ '}'");
-        return block;
-    }
-
-    // 
-    unique_ptr<Stmt> parseStmt() {
-        if (check(TOKEN_INT)) {
-            advance(); // int
-            if (curTok.type != TOKEN_IDENT) error("Ҫ");
-            string var = curTok.text;
-            advance();
-            expect(TOKEN_SEMICOLON, "Ҫ ';' ");
-            return make_unique<DeclStmt>(var);
-        }
-        if (check(TOKEN_IF)) return parseIf();
-        if (check(TOKEN_WHILE)) return parseWhile();
-        if (check(TOKEN_RETURN)) return parseReturn();
-        if (check(TOKEN_LBRACE)) return parseBlock();
-        return parseExpressionStmt();
-    }
-
-    unique_ptr<Stmt> parseIf() {
-        advance(); // 'if'
-        expect(TOKEN_LPAREN, "Ҫ '('  if ");
-        auto cond = parseExpr();
-        expect(TOKEN_RPAREN, "Ҫ ')' ");
-        auto thenStmt = parseStmt();
-        unique_ptr<Stmt> elseStmt;
-        if (match(TOKEN_ELSE)) {
-            elseStmt = parseStmt();
-        }
-        return make_unique<IfStmt>(move(cond), move(thenStmt), move(elseStmt));
-    }
-
-    unique_ptr<Stmt> parseWhile() {
-        advance(); // 'while'
-        expect(TOKEN_LPAREN, "Ҫ '('  while ");
-        auto cond = parseExpr();
-        expect(TOKEN_RPAREN, "Ҫ ')' ");
-        auto body = parseStmt();
-        return make_unique<WhileStmt>(move(cond), move(body));
-    }
-
-    unique_ptr<Stmt> parseReturn() {
-        advance(); // 'return'
-        auto expr = parseExpr();
-        expect(TOKEN_SEMICOLON, "Ҫ ';'  return ");
-        return make_unique<ReturnStmt>(move(expr));
-    }
-
-    // ʽ䣺expr ;
-    unique_ptr<Stmt> parseExpressionStmt() {
-        auto expr = parseExpr();
-        expect(TOKEN_SEMICOLON, "Ҫ ';'");
-        // ʽǸֵ
-        if (auto assign = dynamic_cast<BinaryOp*>(expr.get())) {
-            if (assign->op == BIN_ASSIGN) {
-                // ȡֵ
-                if (auto leftVar = dynamic_cast<VarRef*>(assign->left.get())) {
-                    string var = leftVar->name;
-                    unique_ptr<Expr> rhs = move(assign->right);
-                    auto stmt = make_unique<AssignStmt>(var, move(rhs));
-                    return stmt;
-                }
-            }
-        }
-        // ʽԣ纯ãݲ֧֣
-        error("ֻиֵʽΪ");
-        return nullptr;
-    }
-
-    // ʽȼ
-    unique_ptr<Expr> parseExpr() { return parseAssignment(); }
-
-    unique_ptr<Expr> parseAssignment() {
-        auto left = parseEquality();
-        if (match(TOKEN_ASSIGN)) {
-            auto right = parseAssignment();
-            // ֵڵ㣨ΪԪ㣬ֵӦΪVarRef
-            if (auto var = dynamic_cast<VarRef*>(left.get())) {
-                auto node = make_unique<BinaryOp>(BIN_ASSIGN, move(left), move(right));
-                return node;
-            }
-            else {
-                error("ֵ߱Ǳ");
-            }
-        }
-        return left;
-    }
-
-    unique_ptr<Expr> parseEquality() {
-        auto left = parseRelational();
-        while (true) {
-            if (match(TOKEN_EQ)) {
-                auto right = parseRelational();
-                left = make_unique<BinaryOp>(BIN_EQ, move(left), move(right));
-            }
-            else if (match(TOKEN_NE)) {
-                auto right = parseRelational();
-                left = make_unique<BinaryOp>(BIN_NE, move(left), move(right));
-            }
-            else break;
-        }
-        return left;
-    }
-
-    unique_ptr<Expr> parseRelational() {
-        auto left = parseAdditive();
-        while (true) {
-            if (match(TOKEN_LT)) {
-                auto right = parseAdditive();
-                left = make_unique<BinaryOp>(BIN_LT, move(left), move(right));
-            }
-            else if (match(TOKEN_LE)) {
-                auto right = parseAdditive();
-                left = make_unique<BinaryOp>(BIN_LE, move(left), move(right));
-            }
-            else if (match(TOKEN_GT)) {
-                auto right = parseAdditive();
-                left = make_unique<BinaryOp>(BIN_GT, move(left), move(right));
-            }
-            else if (match(TOKEN_GE)) {
-                auto right = parseAdditive();
-                left = make_unique<BinaryOp>(BIN_GE, move(left), move(right));
-            }
-            else break;
-        }
-        return left;
-    }
-
-    unique_ptr<Expr> parseAdditive() {
-        auto left = parseMultiplicative();
-        while (true) {
-            if (match(TOKEN_PLUS)) {
-                auto right = parseMultiplicative();
-                left = make_unique<BinaryOp>(BIN_ADD, move(left), move(right));
-            }
-            else if (match(TOKEN_MINUS)) {
-                auto right = parseMultiplicative();
-                left = make_unique<BinaryOp>(BIN_SUB, move(left), move(right));
-            }
-            else break;
-        }
-        return left;
-    }
-
-    unique_ptr<Expr> parseMultiplicative() {
-        auto left = parsePrimary();
-        while (true) {
-            if (match(TOKEN_MUL)) {
-                auto right = parsePrimary();
-                left = make_unique<BinaryOp>(BIN_MUL, move(left), move(right));
-            }
-            else if (match(TOKEN_DIV)) {
-                auto right = parsePrimary();
-                left = make_unique<BinaryOp>(BIN_DIV, move(left), move(right));
-            }
-            else break;
-        }
-        return left;
-    }
-
-    unique_ptr<Expr> parsePrimary() {
-        if (match(TOKEN_NUMBER)) {
-            return make_unique<IntConst>(curTok.intVal);
-        }
-        if (match(TOKEN_IDENT)) {
-            return make_unique<VarRef>(curTok.text);
-        }
-        if (match(TOKEN_LPAREN)) {
-            auto expr = parseExpr();
-            expect(TOKEN_RPAREN, "Ҫ ')'");
-            return expr;
-        }
-        error("Ҫʽ");
-        return nullptr;
-    }
-};
-
-// ----------  ----------
-class CodeGenerator {
-    ostream& out;
-    Scope* globalScope; // ʵֻҪ򻯣Ϊÿ
-public:
-    CodeGenerator(ostream& os) : out(os), globalScope(nullptr) {}
-
-    void generate(Program* prog) {
-        out << "; EmergingɵĻ (NASM﷨)\n";
-        out << "section .text\n";
-        out << "global _start\n\n";
-        out << "_start:\n";
-        out << "    call main\n";
-        out << "    mov ebx, eax\n";
-        out << "    mov eax, 1\n";
-        out << "    int 0x80\n\n";
-
-        for (auto& func : prog->functions) {
-            generateFunction(func.get());
-        }
-    }
-
-private:
-    void generateFunction(Function* func) {
-        out << func->name << ":\n";
-        out << "    push ebp\n";
-        out << "    mov ebp, esp\n";
-
-        Scope localScope;
-        globalScope = &localScope; // ڱ
-        // һ飺ռоֲͨеDeclStmt
-        int stackSize = collectDeclarations(func->body.get(), localScope);
-        if (stackSize > 0) {
-            out << "    sub esp, " << stackSize << "\n";
-        }
-
-        // ɺ
-        generateBlock(func->body.get(), localScope);
-
-        // ĩβreturn 0׼Ҫreturnû򷵻0
-        // ûһreturn
-        out << "    leave\n";
-        out << "    ret\n\n";
-    }
-
-    int collectDeclarations(Stmt* stmt, Scope& scope) {
-        int size = 0;
-        if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
-            scope.push();
-            for (auto& s : block->stmts) {
-                size += collectDeclarations(s.get(), scope);
-            }
-            scope.pop();
-        }
-        else if (auto decl = dynamic_cast<DeclStmt*>(stmt)) {
-            // 
-            scope.declare(decl->var);
-            size += 4;
-        }
-        else if (auto ifs = dynamic_cast<IfStmt*>(stmt)) {
-            size += collectDeclarations(ifs->thenStmt.get(), scope);
-            if (ifs->elseStmt) size += collectDeclarations(ifs->elseStmt.get(), scope);
-        }
-        else if (auto whiles = dynamic_cast<WhileStmt*>(stmt)) {
-            size += collectDeclarations(whiles->body.get(), scope);
-        }
-        // ע⣺AssignStmtReturnStmtû
-        return size;
-    }
-
-    void generateBlock(BlockStmt* block, Scope& scope) {
-        scope.push();
-        for (auto& s : block->stmts) {
-            generateStmt(s.get(), scope);
-        }
-        scope.pop();
-    }
-
-    void generateStmt(Stmt* stmt, Scope& scope) {
-        if (auto assign = dynamic_cast<AssignStmt*>(stmt)) {
-            generateAssign(assign, scope);
-        }
-        else if (auto ifs = dynamic_cast<IfStmt*>(stmt)) {
-            generateIf(ifs, scope);
-        }
-        else if (auto whiles = dynamic_cast<WhileStmt*>(stmt)) {
-            generateWhile(whiles, scope);
-        }
-        else if (auto ret = dynamic_cast<ReturnStmt*>(stmt)) {
-            generateReturn(ret, scope);
-        }
-        else if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
-            generateBlock(block, scope);
-        }
-        else if (auto decl = dynamic_cast<DeclStmt*>(stmt)) {
-            // collectд޴
-        }
-    }
-
-    void generateAssign(AssignStmt* assign, Scope& scope) {
-        generateExpr(assign->rhs.get(), scope); // eax
-        Symbol* sym = scope.lookup(assign->var);
-        if (!sym) { cerr << "δı: " << assign->var << endl; exit(1); }
-        out << "    mov [ebp" << showpos << sym->offset << noshowpos << "], eax\n";
-    }
-
-    void generateIf(IfStmt* ifs, Scope& scope) {
-        static int labelCounter = 0;
-        int id = labelCounter++;
-        string labelElse = ".Lelse" + to_string(id);
-        string labelEnd = ".Lend" + to_string(id);
-
-        generateCondition(ifs->cond.get(), scope, labelElse); // Ϊתelse
-        generateStmt(ifs->thenStmt.get(), scope);
-        out << "    jmp " << labelEnd << "\n";
-        out << labelElse << ":\n";
-        if (ifs->elseStmt) generateStmt(ifs->elseStmt.get(), scope);
-        out << labelEnd << ":\n";
-    }
-
-    void generateWhile(WhileStmt* whiles, Scope& scope) {
-        static int labelCounter = 0;
-        int id = labelCounter++;
-        string labelStart = ".Lstart" + to_string(id);
-        string labelEnd = ".Lend" + to_string(id);
-
-        out << labelStart << ":\n";
-        generateCondition(whiles->cond.get(), scope, labelEnd);
-        generateStmt(whiles->body.get(), scope);
-        out << "    jmp " << labelStart << "\n";
-        out << labelEnd << ":\n";
-    }
-
-    void generateReturn(ReturnStmt* ret, Scope& scope) {
-        generateExpr(ret->expr.get(), scope); // ֵeax
-        out << "    leave\n";
-        out << "    ret\n";
-    }
-
-    // ɣΪ٣תlabel
-    void generateCondition(Expr* cond, Scope& scope, const string& falseLabel) {
-        // 򻯣ǱȽϱʽ
-        if (auto bin = dynamic_cast<BinaryOp*>(cond)) {
-            if (bin->op >= BIN_LT && bin->op <= BIN_NE) {
-                generateExpr(bin->left.get(), scope); // ֵeax
-                out << "    push eax\n";
-                generateExpr(bin->right.get(), scope); // ֵeax
-                out << "    pop ebx\n";
-                out << "    cmp ebx, eax\n";
-                const char* jcc = nullptr;
-                switch (bin->op) {
-                case BIN_LT: jcc = "jge"; break; // >=ңСڣ
-                case BIN_LE: jcc = "jg"; break;
-                case BIN_GT: jcc = "jle"; break;
-                case BIN_GE: jcc = "jl"; break;
-                case BIN_EQ: jcc = "jne"; break;
-                case BIN_NE: jcc = "je"; break;
-                default: break;
-                }
-                out << "    " << jcc << " " << falseLabel << "\n";
-                return;
-            }
-        }
-        // ǱȽϱʽֵΪ0Ϊ٣0Ϊ
-        generateExpr(cond, scope);
-        out << "    cmp eax, 0\n";
-        out << "    je " << falseLabel << "\n";
-    }
-
-    void generateExpr(Expr* expr, Scope& scope) {
-        if (auto num = dynamic_cast<IntConst*>(expr)) {
-            out << "    mov eax, " << num->value << "\n";
-        }
-        else if (auto var = dynamic_cast<VarRef*>(expr)) {
-            Symbol* sym = scope.lookup(var->name);
-            if (!sym) { cerr << "δı: " << var->name << endl; exit(1); }
-            out << "    mov eax, [ebp" << showpos << sym->offset << noshowpos << "]\n";
-        }
-        else if (auto bin = dynamic_cast<BinaryOp*>(expr)) {
-            if (bin->op == BIN_ASSIGN) {
-                // ֵֵɣȻeax
-                generateExpr(bin->right.get(), scope);
-                if (auto leftVar = dynamic_cast<VarRef*>(bin->left.get())) {
-                    Symbol* sym = scope.lookup(leftVar->name);
-                    if (!sym) { cerr << "δı: " << leftVar->name << endl; exit(1); }
-                    out << "    mov [ebp" << showpos << sym->offset << noshowpos << "], eax\n";
-                }
-                else {
-                    cerr << "ЧĸֵĿ\n"; exit(1);
-                }
-            }
-            else {
-                // Ԫ
-                generateExpr(bin->left.get(), scope);
-                out << "    push eax\n";
-                generateExpr(bin->right.get(), scope);
-                out << "    pop ebx\n";
-                switch (bin->op) {
-                case BIN_ADD: out << "    add eax, ebx\n"; break;
-                case BIN_SUB: out << "    sub ebx, eax\n    mov eax, ebx\n"; break; // ebx - eax
-                case BIN_MUL: out << "    imul eax, ebx\n"; break;
-                case BIN_DIV: out << "    xchg eax, ebx\n    cdq\n    idiv ebx\n"; break; // ebx / eax -> eax
-                default:
-                    // Ƚ㣬زֵ0/1
-                    out << "    cmp ebx, eax\n";
-                    const char* setcc = nullptr;
-                    switch (bin->op) {
-                    case BIN_LT: setcc = "setl"; break;
-                    case BIN_LE: setcc = "setle"; break;
-                    case BIN_GT: setcc = "setg"; break;
-                    case BIN_GE: setcc = "setge"; break;
-                    case BIN_EQ: setcc = "sete"; break;
-                    case BIN_NE: setcc = "setne"; break;
-                    default: break;
-                    }
-                    out << "    xor eax, eax\n";
-                    out << "    " << setcc << " al\n";
-                    break;
-                }
-            }
-        }
-    }
-};
-
-int main(int argc, char* argv[]) {
-    // в
-    if (argc >= 2 && string(argv[1]) == "--version") {
-        printVersionAndExit();
-    }
-    if (argc < 2) {
-        cerr << "÷: " << argv[0] << " [--version] <ļ.emg> [ļ.asm]\n";
-        return 1;
-    }
-    string infile = argv[1];
-    string outfile = (argc > 2) ? argv[2] : (infile + ".asm");
-
-    ifstream in(infile);
-    if (!in) {
-        cerr << "޷ļ: " << infile << endl;
-        return 1;
-    }
-
-    Lexer lex(in);
-    Parser parser(lex);
-    auto prog = parser.parse();
-
-    ofstream out(outfile);
-    if (!out) {
-        cerr << "޷ļ: " << outfile << endl;
-        return 1;
-    }
-
-    CodeGenerator cg(out);
-    cg.generate(prog.get());
-
-    cout << "д " << outfile << endl;
-    cout << "ִ: nasm -f elf32 " << outfile << " -o " << infile << ".o" << endl;
-    return 0;
+// emerging.cpp - Emerging语言编译器 (i686版本)
+// 用法: i686-emerging.exe [--version] [-O0|-O1|-O2] [-funroll-loops[=N]] [-finline-limit=N] [-fno-inline] [-fno-licm] [-mregparm=N] [--dump-ir] [--peephole-stats] [--frame-stats] input.emg [output.asm]
+// 生成汇编代码，需用nasm -f elf32编译
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <memory>
+#include <new>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "../common/header_cache.h"
+#include "../common/peephole.h"
+
+using namespace std;
+
+// ---------- 版本信息 ----------
+const string VERSION = "i686 Emerging 编程语言版本1.0.0";
+
+// ---------- 命令行解析 ----------
+void printVersionAndExit() {
+    cout << VERSION << endl;
+    exit(0);
+}
+
+// ---------- 扫描加速 ----------
+// 空白与注释是生成头文件中占比最高的部分，这里按16/32字节块扫描。
+// 运行时根据CPU选择 AVX2 / SSE2 / 标量实现；所有实现都把 NUL 视为源码结束，
+// 并统计跳过部分中的换行数。
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define EMG_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define EMG_TARGET(isa)
+#else
+#define EMG_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+struct ScanKernels {
+    const char* name;
+    // 返回第一个非空白字符的位置，lines 累加跳过的换行数
+    const char* (*skipSpace)(const char* p, const char* end, int& lines);
+    // 返回下一个 '\n' 或 NUL 的位置
+    const char* (*findLineEnd)(const char* p, const char* end);
+    // 返回下一个 "*/" 中 '*' 或 NUL 的位置，lines 累加跳过的换行数
+    const char* (*findBlockEnd)(const char* p, const char* end, int& lines);
+};
+
+inline bool isSpaceByte(char c) { return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t'; }
+
+inline int countBits(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+}
+
+inline int lowestBit(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+const char* skipSpaceScalar(const char* p, const char* end, int& lines) {
+    while (p < end && isSpaceByte(*p)) {
+        if (*p == '\n') lines++;
+        ++p;
+    }
+    return p;
+}
+
+const char* findLineEndScalar(const char* p, const char* end) {
+    while (p < end && *p != '\n' && *p != 0) ++p;
+    return p;
+}
+
+const char* findBlockEndScalar(const char* p, const char* end, int& lines) {
+    while (p < end && *p != 0) {
+        if (*p == '*' && p + 1 < end && p[1] == '/') return p;
+        if (*p == '\n') lines++;
+        ++p;
+    }
+    return p;
+}
+
+#ifdef EMG_SCAN_X86
+// 低于 "第一个命中位" 的掩码，用于统计命中之前的换行
+inline uint32_t bitsBelow(int i) { return i >= 32 ? 0xFFFFFFFFu : ((1u << i) - 1); }
+
+EMG_TARGET("sse2") const char* skipSpaceSSE2(const char* p, const char* end, int& lines) {
+    // 多数空白只是单个空格，先按标量处理前两个字节，较长的空白（缩进、空行）才按块扫描
+    for (int i = 0; i < 2; ++i) {
+        if (p == end || !isSpaceByte(*p)) return p;
+        if (*p == '\n') lines++;
+        ++p;
+    }
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4), nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        __m128i t = _mm_sub_epi8(b, tab); // '\t'..'\r' -> 0..4
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(b, space), _mm_cmpeq_epi8(_mm_min_epu8(t, four), t));
+        uint32_t stop = ~(uint32_t)_mm_movemask_epi8(ws) & 0xFFFF;
+        uint32_t nls = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, nl));
+        if (stop) {
+            int i = lowestBit(stop);
+            lines += countBits(nls & bitsBelow(i));
+            return p + i;
+        }
+        lines += countBits(nls);
+        p += 16;
+    }
+    return skipSpaceScalar(p, end, lines);
+}
+
+EMG_TARGET("sse2") const char* findLineEndSSE2(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        uint32_t hit = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, nl), _mm_cmpeq_epi8(b, zero)));
+        if (hit) return p + lowestBit(hit);
+        p += 16;
+    }
+    return findLineEndScalar(p, end);
+}
+
+EMG_TARGET("sse2") const char* findBlockEndSSE2(const char* p, const char* end, int& lines) {
+    const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/');
+    const __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+    while (end - p >= 17) { // 多读一个字节用于匹配 '/'
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        __m128i next = _mm_loadu_si128((const __m128i*)(p + 1));
+        __m128i close = _mm_and_si128(_mm_cmpeq_epi8(b, star), _mm_cmpeq_epi8(next, slash));
+        uint32_t hit = (uint32_t)_mm_movemask_epi8(_mm_or_si128(close, _mm_cmpeq_epi8(b, zero)));
+        uint32_t nls = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, nl));
+        if (hit) {
+            int i = lowestBit(hit);
+            lines += countBits(nls & bitsBelow(i));
+            return p + i;
+        }
+        lines += countBits(nls);
+        p += 16;
+    }
+    return findBlockEndScalar(p, end, lines);
+}
+
+EMG_TARGET("avx2") const char* skipSpaceAVX2(const char* p, const char* end, int& lines) {
+    // 多数空白只是单个空格，先按标量处理前两个字节，较长的空白（缩进、空行）才按块扫描
+    for (int i = 0; i < 2; ++i) {
+        if (p == end || !isSpaceByte(*p)) return p;
+        if (*p == '\n') lines++;
+        ++p;
+    }
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4), nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)p);
+        __m256i t = _mm256_sub_epi8(b, tab);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(b, space), _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t));
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(ws);
+        uint32_t nls = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+        if (stop) {
+            int i = lowestBit(stop);
+            lines += countBits(nls & bitsBelow(i));
+            return p + i;
+        }
+        lines += countBits(nls);
+        p += 32;
+    }
+    return skipSpaceSSE2(p, end, lines);
+}
+
+EMG_TARGET("avx2") const char* findLineEndAVX2(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t hit = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(b, nl), _mm256_cmpeq_epi8(b, zero)));
+        if (hit) return p + lowestBit(hit);
+        p += 32;
+    }
+    return findLineEndSSE2(p, end);
+}
+
+EMG_TARGET("avx2") const char* findBlockEndAVX2(const char* p, const char* end, int& lines) {
+    const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/');
+    const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+    while (end - p >= 33) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)p);
+        __m256i next = _mm256_loadu_si256((const __m256i*)(p + 1));
+        __m256i close = _mm256_and_si256(_mm256_cmpeq_epi8(b, star), _mm256_cmpeq_epi8(next, slash));
+        uint32_t hit = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(close, _mm256_cmpeq_epi8(b, zero)));
+        uint32_t nls = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+        if (hit) {
+            int i = lowestBit(hit);
+            lines += countBits(nls & bitsBelow(i));
+            return p + i;
+        }
+        lines += countBits(nls);
+        p += 32;
+    }
+    return findBlockEndSSE2(p, end, lines);
+}
+
+// CPUID 检测：AVX2 还需要操作系统开启 YMM 状态保存
+void detectSimd(bool& sse2, bool& avx2) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, 0);
+    int maxLeaf = r[0];
+    __cpuid(r, 1);
+    sse2 = (r[3] & (1 << 26)) != 0;
+    bool osYmm = (r[2] & (1 << 27)) && (r[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    avx2 = false;
+    if (osYmm && maxLeaf >= 7) {
+        __cpuidex(r, 7, 0);
+        avx2 = (r[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    sse2 = __builtin_cpu_supports("sse2");
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+const ScanKernels SCAN_SCALAR = { "scalar", skipSpaceScalar, findLineEndScalar, findBlockEndScalar };
+#ifdef EMG_SCAN_X86
+const ScanKernels SCAN_SSE2 = { "sse2", skipSpaceSSE2, findLineEndSSE2, findBlockEndSSE2 };
+const ScanKernels SCAN_AVX2 = { "avx2", skipSpaceAVX2, findLineEndAVX2, findBlockEndAVX2 };
+#endif
+
+const ScanKernels& selectScanKernels() {
+#ifdef EMG_SCAN_X86
+    bool sse2 = false, avx2 = false;
+    detectSimd(sse2, avx2);
+    if (avx2 && sse2) return SCAN_AVX2;
+    if (sse2) return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& k = selectScanKernels();
+    return k;
+}
+
+// ---------- 词法分析 ----------
+enum TokenType {
+    TOKEN_EOF, TOKEN_IDENT, TOKEN_NUMBER,
+    TOKEN_INT, TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_RETURN, TOKEN_EXTERN, TOKEN_INLINE,
+    TOKEN_ASSIGN, TOKEN_EQ, TOKEN_NE, TOKEN_LT, TOKEN_LE, TOKEN_GT, TOKEN_GE,
+    TOKEN_PLUS, TOKEN_MINUS, TOKEN_MUL, TOKEN_DIV,
+    TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_LBRACE, TOKEN_RBRACE,
+    TOKEN_SEMICOLON, TOKEN_COMMA,
+    TOKEN_INCLUDE, TOKEN_DEFINE,  // 预处理指令：#include 携带路径，#define 后跟两个标识符
+    TOKEN_ELLIPSIS, TOKEN_AMP,    // 仅出现在 extern 参数表中
+    TOKEN_UNKNOWN
+};
+
+// Token 不持有字符串：标识符用驻留编号，原文用源码区间表示
+struct Token {
+    TokenType type;
+    SymId sym;       // 标识符的驻留编号
+    int intVal;
+    uint32_t offset; // 源码区间
+    uint32_t length;
+    Token(TokenType t = TOKEN_UNKNOWN, uint32_t off = 0, uint32_t len = 0, int v = 0, SymId id = 0)
+        : type(t), sym(id), intVal(v), offset(off), length(len) {
+    }
+};
+
+// 关键字表：新增关键字只需在此加一行，哈希冲突会在编译期报错
+struct Keyword {
+    const char* name;
+    TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    { "int", TOKEN_INT },
+    { "if", TOKEN_IF },
+    { "else", TOKEN_ELSE },
+    { "while", TOKEN_WHILE },
+    { "return", TOKEN_RETURN },
+    { "extern", TOKEN_EXTERN },
+    { "inline", TOKEN_INLINE },
+};
+constexpr size_t KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+constexpr unsigned KEYWORD_SLOTS = 32; // 2的幂
+
+constexpr size_t keywordLength(const char* s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+// 首字符 + 末字符 + 长度，对当前关键字集合是完美哈希
+constexpr unsigned keywordHash(const char* s, size_t n) {
+    return ((unsigned char)s[0] + (unsigned char)s[n - 1] + (unsigned)n) & (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable {
+    signed char index[KEYWORD_SLOTS]; // 槽 -> KEYWORDS 下标，-1 为空
+    unsigned char length[KEYWORD_SLOTS];
+    bool perfect;
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable t{};
+    for (unsigned i = 0; i < KEYWORD_SLOTS; ++i) t.index[i] = -1;
+    t.perfect = true;
+    for (size_t k = 0; k < KEYWORD_COUNT; ++k) {
+        size_t n = keywordLength(KEYWORDS[k].name);
+        unsigned h = keywordHash(KEYWORDS[k].name, n);
+        if (t.index[h] >= 0) t.perfect = false;
+        t.index[h] = (signed char)k;
+        t.length[h] = (unsigned char)n;
+    }
+    return t;
+}
+
+constexpr KeywordTable KEYWORD_TABLE = buildKeywordTable();
+static_assert(KEYWORD_TABLE.perfect, "关键字哈希冲突，请调整 keywordHash 或 KEYWORD_SLOTS");
+
+// 标识符分类：一次哈希加一次定长比较，不分配内存
+inline TokenType lookupKeyword(const char* s, size_t n) {
+    unsigned h = keywordHash(s, n);
+    int k = KEYWORD_TABLE.index[h];
+    if (k >= 0 && KEYWORD_TABLE.length[h] == n && memcmp(KEYWORDS[k].name, s, n) == 0)
+        return KEYWORDS[k].type;
+    return TOKEN_IDENT;
+}
+
+class Lexer {
+    const char* base; // 源码起始
+    const char* p;    // 当前扫描位置
+    const char* end;  // 源码末尾
+    int line;
+    const ScanKernels& scan;
+public:
+    Lexer(const char* begin, const char* end, const ScanKernels& kernels = scanKernels())
+        : base(begin), p(begin), end(end), line(1), scan(kernels) {
+    }
+
+    Token nextToken() {
+        skipSpaceAndComments();
+        const char* start = p;
+        if (cur() == 0) return make(TOKEN_EOF, start);
+        if (isalpha((unsigned char)cur()) || cur() == '_') return readIdent();
+        if (isdigit((unsigned char)cur())) return readNumber();
+        char ch = *p++;
+        switch (ch) {
+        case '/': return make(TOKEN_DIV, start);
+        case '=':
+            if (cur() == '=') { ++p; return make(TOKEN_EQ, start); }
+            return make(TOKEN_ASSIGN, start);
+        case '!':
+            if (cur() == '=') { ++p; return make(TOKEN_NE, start); }
+            return make(TOKEN_UNKNOWN, start);
+        case '<':
+            if (cur() == '=') { ++p; return make(TOKEN_LE, start); }
+            return make(TOKEN_LT, start);
+        case '>':
+            if (cur() == '=') { ++p; return make(TOKEN_GE, start); }
+            return make(TOKEN_GT, start);
+        case '+': return make(TOKEN_PLUS, start);
+        case '-': return make(TOKEN_MINUS, start);
+        case '*': return make(TOKEN_MUL, start);
+        case '(': return make(TOKEN_LPAREN, start);
+        case ')': return make(TOKEN_RPAREN, start);
+        case '{': return make(TOKEN_LBRACE, start);
+        case '}': return make(TOKEN_RBRACE, start);
+        case ';': return make(TOKEN_SEMICOLON, start);
+        case ',': return make(TOKEN_COMMA, start);
+        case '&': return make(TOKEN_AMP, start);
+        case '#': return directive(start);
+        case '.':
+            if (p + 1 < end && p[0] == '.' && p[1] == '.') { p += 2; return make(TOKEN_ELLIPSIS, start); }
+            return make(TOKEN_UNKNOWN, start);
+        default: return make(TOKEN_UNKNOWN, start);
+        }
+    }
+
+private:
+    // 源码末尾（或文件中的 NUL 字符）视为结束
+    char cur() const { return p < end ? *p : 0; }
+
+    Token make(TokenType t, const char* start, int v = 0, SymId id = 0) const {
+        return Token(t, (uint32_t)(start - base), (uint32_t)(p - start), v, id);
+    }
+
+    // 连续的空白和注释在一个循环里跳过，不递归
+    void skipSpaceAndComments() {
+        while (true) {
+            p = scan.skipSpace(p, end, line);
+            if (cur() != '/' || p + 1 >= end) return;
+            if (p[1] == '/') skipLineComment();
+            else if (p[1] == '*') skipBlockComment();
+            else return;
+        }
+    }
+
+    Token readIdent() {
+        const char* start = p;
+        while (p < end && (isalnum((unsigned char)*p) || *p == '_')) ++p;
+        TokenType t = lookupKeyword(start, p - start);
+        if (t != TOKEN_IDENT) return make(t, start);
+        return make(TOKEN_IDENT, start, 0, interner.intern(start, p - start));
+    }
+
+    Token readNumber() {
+        const char* start = p;
+        if (*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X')) {
+            p += 2;
+            unsigned hex = 0;
+            while (p < end && isxdigit((unsigned char)*p)) {
+                hex = hex * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+                ++p;
+            }
+            return make(TOKEN_NUMBER, start, (int)hex);
+        }
+        int val = 0;
+        while (p < end && isdigit((unsigned char)*p)) {
+            val = val * 10 + (*p - '0');
+            ++p;
+        }
+        return make(TOKEN_NUMBER, start, val);
+    }
+
+    // 预处理指令，p 指向 '#' 之后
+    Token directive(const char* start) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        const char* name = p;
+        while (p < end && (isalnum((unsigned char)*p) || *p == '_')) ++p;
+        size_t n = p - name;
+        if (n == 7 && memcmp(name, "include", 7) == 0) {
+            while (p < end && (*p == ' ' || *p == '\t')) ++p;
+            if (cur() != '"' && cur() != '<') {
+                cerr << "语法错误: 第 " << line << " 行 #include 后需要 \"文件\" 或 <文件>\n";
+                exit(1);
+            }
+            char close = (*p == '<') ? '>' : '"';
+            const char* path = ++p;
+            while (p < end && *p != close && *p != '\n') ++p;
+            if (cur() != close) {
+                cerr << "语法错误: 第 " << line << " 行 #include 文件名未闭合\n";
+                exit(1);
+            }
+            SymId sym = interner.intern(path, p - path);
+            ++p;
+            return make(TOKEN_INCLUDE, start, 0, sym);
+        }
+        if (n == 6 && memcmp(name, "define", 6) == 0) return make(TOKEN_DEFINE, start);
+        cerr << "语法错误: 第 " << line << " 行未知的预处理指令 #" << string(name, n) << "\n";
+        exit(1);
+    }
+
+    void skipLineComment() {
+        p = scan.findLineEnd(p + 2, end);
+    }
+
+    void skipBlockComment() {
+        p = scan.findBlockEnd(p + 2, end, line); // 跳过 "/*"
+        if (cur() == '*') p += 2;
+    }
+};
+
+// ---------- 记号流 ----------
+// 整个文件预先切分成并列数组（结构数组），语法分析按下标访问，可任意前瞻和回溯
+class TokenStream {
+    const char* base;
+    vector<uint8_t> kinds;
+    vector<uint32_t> offsets;
+    vector<uint32_t> lengths;
+    vector<int32_t> values; // 数字的值，或标识符/头文件路径的驻留编号
+public:
+    TokenStream(const char* begin, const char* end) : base(begin) {
+        size_t guess = (size_t)(end - begin) / 2 + 1; // 记号平均不短于2字节，避免反复扩容
+        kinds.reserve(guess);
+        offsets.reserve(guess);
+        lengths.reserve(guess);
+        values.reserve(guess);
+        Lexer lex(begin, end);
+        while (true) {
+            Token tok = lex.nextToken();
+            kinds.push_back((uint8_t)tok.type);
+            offsets.push_back(tok.offset);
+            lengths.push_back(tok.length);
+            values.push_back(tok.type == TOKEN_IDENT || tok.type == TOKEN_INCLUDE ? (int32_t)tok.sym : tok.intVal);
+            if (tok.type == TOKEN_EOF) break;
+        }
+    }
+
+    // 越过末尾的下标都视为最后的 EOF
+    size_t size() const { return kinds.size(); }
+    TokenType kind(size_t i) const { return (TokenType)kinds[min(i, kinds.size() - 1)]; }
+    int value(size_t i) const { return values[min(i, values.size() - 1)]; }
+    SymId sym(size_t i) const { return (SymId)value(i); }
+
+    // 取回记号原文（仅用于错误信息）
+    string text(size_t i) const {
+        if (kind(i) == TOKEN_EOF) return "EOF";
+        return string(base + offsets[i], lengths[i]);
+    }
+};
+
+// ---------- 内存池 ----------
+// 语法树节点从内存池顺序分配，整棵树随内存池一次性释放。
+// 节点不持有任何需要析构的资源，因此不逐个调用析构函数。
+class Arena {
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    vector<unique_ptr<char[]>> chunks;
+    char* cur;
+    char* limit;
+public:
+    Arena() : cur(nullptr), limit(nullptr) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+        if (!cur || p + size > (uintptr_t)limit) {
+            size_t n = size + align > CHUNK_SIZE ? size + align : CHUNK_SIZE;
+            chunks.emplace_back(new char[n]);
+            cur = chunks.back().get();
+            limit = cur + n;
+            p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur = (char*)(p + size);
+        return (void*)p;
+    }
+
+    template<class T, class... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    }
+
+    // 将临时数组复制进内存池，返回池内地址（n 为 0 时返回空指针）
+    template<class T>
+    T* copyArray(const T* src, size_t n) {
+        if (n == 0) return nullptr;
+        T* dst = (T*)allocate(sizeof(T) * n, alignof(T));
+        memcpy(dst, src, sizeof(T) * n);
+        return dst;
+    }
+};
+
+// ---------- 抽象语法树 ----------
+// 所有节点由 Arena 分配，节点之间以裸指针相连，不负责释放子节点
+// 节点以 kind 字段标明具体类型，各遍历按 kind 做 switch 分派，不依赖 RTTI
+struct Expr;
+struct Stmt;
+struct Function;
+
+enum ExprKind : uint8_t { EXPR_INT, EXPR_VAR, EXPR_BINARY, EXPR_CALL };
+enum StmtKind : uint8_t { STMT_ASSIGN, STMT_IF, STMT_WHILE, STMT_RETURN, STMT_BLOCK, STMT_DECL, STMT_EXPR };
+
+struct Expr {
+    ExprKind kind;
+    explicit Expr(ExprKind k) : kind(k) {}
+};
+
+// 按 kind 检查并转换节点类型，类型不符返回空指针（取代 dynamic_cast）
+template<class T, class Base>
+T* as(Base* node) {
+    return (node && node->kind == T::KIND) ? static_cast<T*>(node) : nullptr;
+}
+
+struct IntConst : Expr {
+    static const ExprKind KIND = EXPR_INT;
+    int value;
+    IntConst(int v) : Expr(KIND), value(v) {}
+};
+
+struct VarRef : Expr {
+    static const ExprKind KIND = EXPR_VAR;
+    SymId name;
+    VarRef(SymId n) : Expr(KIND), name(n) {}
+};
+
+enum BinOp { BIN_ADD, BIN_SUB, BIN_MUL, BIN_DIV, BIN_LT, BIN_LE, BIN_GT, BIN_GE, BIN_EQ, BIN_NE };
+
+// 自定义赋值操作码（不与枚举值冲突）
+const BinOp BIN_ASSIGN = static_cast<BinOp>(100);
+
+struct BinaryOp : Expr {
+    static const ExprKind KIND = EXPR_BINARY;
+    BinOp op;
+    Expr* left;
+    Expr* right;
+    BinaryOp(BinOp o, Expr* l, Expr* r) : Expr(KIND), op(o), left(l), right(r) {}
+};
+
+// 函数调用：被调函数是本文件定义的函数或 extern 声明的外部函数，参数从左到右求值
+struct CallExpr : Expr {
+    static const ExprKind KIND = EXPR_CALL;
+    SymId name;
+    Expr** args;    // 池内数组
+    uint32_t argCount;
+    CallExpr(SymId n, Expr** a, uint32_t c) : Expr(KIND), name(n), args(a), argCount(c) {}
+    Expr** begin() const { return args; }
+    Expr** end() const { return args + argCount; }
+};
+
+struct Stmt {
+    StmtKind kind;
+    explicit Stmt(StmtKind k) : kind(k) {}
+};
+
+struct AssignStmt : Stmt {
+    static const StmtKind KIND = STMT_ASSIGN;
+    SymId var;
+    Expr* rhs;
+    AssignStmt(SymId v, Expr* e) : Stmt(KIND), var(v), rhs(e) {}
+};
+
+struct IfStmt : Stmt {
+    static const StmtKind KIND = STMT_IF;
+    Expr* cond;
+    Stmt* thenStmt;
+    Stmt* elseStmt;
+    IfStmt(Expr* c, Stmt* t, Stmt* e = nullptr) : Stmt(KIND), cond(c), thenStmt(t), elseStmt(e) {}
+};
+
+struct WhileStmt : Stmt {
+    static const StmtKind KIND = STMT_WHILE;
+    Expr* cond;
+    Stmt* body;
+    WhileStmt(Expr* c, Stmt* b) : Stmt(KIND), cond(c), body(b) {}
+};
+
+struct ReturnStmt : Stmt {
+    static const StmtKind KIND = STMT_RETURN;
+    Expr* expr;
+    ReturnStmt(Expr* e) : Stmt(KIND), expr(e) {}
+};
+
+struct BlockStmt : Stmt {
+    static const StmtKind KIND = STMT_BLOCK;
+    Stmt** stmts;   // 池内数组
+    uint32_t count;
+    BlockStmt(Stmt** s, uint32_t n) : Stmt(KIND), stmts(s), count(n) {}
+    Stmt** begin() const { return stmts; }
+    Stmt** end() const { return stmts + count; }
+};
+
+// 声明语句节点，用于处理变量声明
+struct DeclStmt : Stmt {
+    static const StmtKind KIND = STMT_DECL;
+    SymId var;
+    DeclStmt(SymId v) : Stmt(KIND), var(v) {}
+};
+
+// 表达式语句，只用于丢弃返回值的函数调用：f(x);
+struct ExprStmt : Stmt {
+    static const StmtKind KIND = STMT_EXPR;
+    Expr* expr;
+    ExprStmt(Expr* e) : Stmt(KIND), expr(e) {}
+};
+
+struct Function {
+    SymId name;
+    SymId* params;        // 池内数组，按书写顺序
+    uint32_t paramCount;
+    BlockStmt* body;
+    bool inlineHint;      // 带 inline 关键字，内联时放宽大小限制
+    Function(SymId n, SymId* p, uint32_t pc, BlockStmt* b, bool hint)
+        : name(n), params(p), paramCount(pc), body(b), inlineHint(hint) {}
+};
+
+// 一次编译的全部语法树：节点都在 arena 中，Program 析构时整体释放
+struct Program {
+    Arena arena;
+    vector<Function*> functions;
+    vector<Decl> decls; // 全局变量与外部函数（含头文件引入的），按出现顺序
+};
+
+// ---------- 语法树遍历 ----------
+// 表达式可以任意长（上万项的 a+b+...），各遍用显式栈遍历，调用栈的深度与表达式的大小无关
+
+// 前序访问表达式的每个节点：父节点先于子节点，子节点从左到右（赋值的左侧也访问）。
+// visit(e) 返回 false 时不进入 e 的子节点
+template<class Visit>
+void walkExpr(const Expr* root, Visit visit) {
+    vector<const Expr*> stack(1, root);
+    while (!stack.empty()) {
+        const Expr* e = stack.back();
+        stack.pop_back();
+        if (!visit(e)) continue;
+        if (auto bin = as<const BinaryOp>(e)) {
+            stack.push_back(bin->right);
+            stack.push_back(bin->left);
+        }
+        else if (auto call = as<const CallExpr>(e)) {
+            for (uint32_t k = call->argCount; k-- > 0;) stack.push_back(call->args[k]);
+        }
+    }
+}
+
+// 后序遍历表达式：子节点都处理完后调用 leave(e, kids)，kids 依次是各子节点的结果
+// （二元运算为左、右，调用为各实参），返回值作为 e 的结果。R 为 Expr* 时即重建语法树
+template<class R, class Node, class Leave>
+R postOrderExpr(Node* root, Leave leave) {
+    vector<pair<Node*, bool>> stack(1, make_pair(root, false)); // second 表示子节点已经入栈
+    vector<R> results;
+    while (!stack.empty()) {
+        Node* e = stack.back().first;
+        uint32_t n = 0;
+        if (e->kind == EXPR_BINARY) n = 2;
+        else if (auto call = as<const CallExpr>(e)) n = call->argCount;
+        if (n > 0 && !stack.back().second) {
+            stack.back().second = true;
+            if (auto bin = as<const BinaryOp>(e)) {
+                stack.push_back(make_pair(bin->right, false));
+                stack.push_back(make_pair(bin->left, false));
+            }
+            else {
+                auto call = static_cast<const CallExpr*>(e);
+                for (uint32_t k = n; k-- > 0;) stack.push_back(make_pair(call->args[k], false));
+            }
+            continue;
+        }
+        stack.pop_back();
+        R r = leave(e, results.data() + results.size() - n);
+        results.resize(results.size() - n);
+        results.push_back(r);
+    }
+    return results.back();
+}
+
+// 语句自身的表达式（赋值的右值、条件、返回值、表达式语句），没有时为空指针
+inline Expr* stmtExpr(const Stmt* s) {
+    switch (s->kind) {
+    case STMT_ASSIGN: return static_cast<const AssignStmt*>(s)->rhs;
+    case STMT_IF:     return static_cast<const IfStmt*>(s)->cond;
+    case STMT_WHILE:  return static_cast<const WhileStmt*>(s)->cond;
+    case STMT_RETURN: return static_cast<const ReturnStmt*>(s)->expr;
+    case STMT_EXPR:   return static_cast<const ExprStmt*>(s)->expr;
+    default:          return nullptr;
+    }
+}
+
+// 前序访问语句树中的每条语句，子语句按书写顺序；visit(s) 返回 false 时不进入 s 的子语句
+template<class Visit>
+void walkStmt(const Stmt* root, Visit visit) {
+    vector<const Stmt*> stack(1, root);
+    while (!stack.empty()) {
+        const Stmt* s = stack.back();
+        stack.pop_back();
+        if (!visit(s)) continue;
+        switch (s->kind) {
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            if (ifs->elseStmt) stack.push_back(ifs->elseStmt);
+            stack.push_back(ifs->thenStmt);
+            break;
+        }
+        case STMT_WHILE:
+            stack.push_back(static_cast<const WhileStmt*>(s)->body);
+            break;
+        case STMT_BLOCK: {
+            auto block = static_cast<const BlockStmt*>(s);
+            for (uint32_t k = block->count; k-- > 0;) stack.push_back(block->stmts[k]);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// ---------- 扁平语法树 ----------
+// 代码生成前把函数体展开成连续数组，子节点以32位下标引用。
+// 语句按前序排列，end 为整棵子树之后的下标，遍历整个函数即顺序扫描数组；
+// 表达式按后序排列（左、右、父；调用是各实参、调用），根下标记录在所属语句中。
+const uint32_t FLAT_NONE = 0xFFFFFFFFu;
+
+struct FlatExpr {
+    ExprKind kind;
+    uint8_t op;   // BinOp，仅 EXPR_BINARY 使用
+    uint32_t a;   // INT: 值；VAR: 变量；BINARY: 左操作数下标；CALL: 函数名
+    uint32_t b;   // BINARY: 右操作数下标；CALL: callArgs 中的起点，先存个数再存各实参下标
+};
+
+struct FlatStmt {
+    StmtKind kind;
+    uint32_t a;   // ASSIGN/DECL: 变量；IF/WHILE: 条件；RETURN: 返回值表达式；EXPR: 表达式
+    uint32_t b;   // ASSIGN: 右值表达式；IF: else 分支语句（没有则为 FLAT_NONE）
+    uint32_t end; // 子树之后的下标；then 分支、循环体、块内首条语句都紧跟在父语句之后
+};
+
+struct FlatFunction {
+    SymId name;
+    vector<SymId> params;
+    vector<FlatStmt> stmts; // stmts[0] 是函数体块
+    vector<FlatExpr> exprs;
+    vector<uint32_t> callArgs;
+    vector<Expr*> nodes; // 各表达式对应的语法树节点，SSA 优化据此把结论写回语法树
+
+    // 由语法树展开；数组容量在多次调用间复用
+    void build(const Function* func) {
+        name = func->name;
+        params.assign(func->params, func->params + func->paramCount);
+        stmts.clear();
+        exprs.clear();
+        callArgs.clear();
+        nodes.clear();
+        addStmt(func->body);
+    }
+
+    int32_t intValue(uint32_t e) const { return (int32_t)exprs[e].a; }
+    uint32_t argCount(uint32_t e) const { return callArgs[exprs[e].b]; }
+    uint32_t arg(uint32_t e, uint32_t k) const { return callArgs[exprs[e].b + 1 + k]; }
+
+    // 子树占据 [firstOf(e), e] 一段连续下标，起点是沿最左的子节点走到底的叶子（或无参调用）
+    uint32_t firstOf(uint32_t e) const {
+        while (true) {
+            if (exprs[e].kind == EXPR_BINARY) e = exprs[e].a;
+            else if (exprs[e].kind == EXPR_CALL && argCount(e) > 0) e = arg(e, 0);
+            else return e;
+        }
+    }
+
+private:
+    // 展开表达式用的工作栈，容量在多次调用间复用
+    vector<pair<Expr*, bool>> pending;       // 待输出的节点，second 表示子节点已经入栈
+    vector<uint32_t> done;                   // 已输出子树的根下标，按从左到右的顺序
+
+    // 用显式栈做后序展开，不随表达式深度递归：节点第一次到栈顶时把子节点压进去，
+    // 子节点全部输出后再次到栈顶时输出自己，这时它各子树的根下标正好在 done 栈顶
+    uint32_t addExpr(Expr* root) {
+        pending.push_back(make_pair(root, false));
+        while (!pending.empty()) {
+            Expr* expr = pending.back().first;
+            bool inner = expr->kind == EXPR_BINARY || expr->kind == EXPR_CALL;
+            if (inner && !pending.back().second) {
+                pending.back().second = true;
+                if (auto bin = as<const BinaryOp>(expr)) {
+                    pending.push_back(make_pair(bin->right, false));
+                    pending.push_back(make_pair(bin->left, false));
+                }
+                else {
+                    auto call = static_cast<const CallExpr*>(expr);
+                    for (uint32_t k = call->argCount; k-- > 0;) pending.push_back(make_pair(call->args[k], false));
+                }
+                continue;
+            }
+            pending.pop_back();
+            FlatExpr fe = { expr->kind, 0, 0, 0 };
+            switch (expr->kind) {
+            case EXPR_INT: fe.a = (uint32_t)static_cast<const IntConst*>(expr)->value; break;
+            case EXPR_VAR: fe.a = static_cast<const VarRef*>(expr)->name; break;
+            case EXPR_BINARY:
+                fe.op = (uint8_t)static_cast<const BinaryOp*>(expr)->op;
+                fe.b = done.back();
+                done.pop_back();
+                fe.a = done.back();
+                done.pop_back();
+                break;
+            case EXPR_CALL: {
+                auto call = static_cast<const CallExpr*>(expr);
+                fe.a = call->name;
+                fe.b = (uint32_t)callArgs.size();
+                callArgs.push_back(call->argCount);
+                callArgs.insert(callArgs.end(), done.end() - call->argCount, done.end());
+                done.resize(done.size() - call->argCount);
+                break;
+            }
+            }
+            exprs.push_back(fe);
+            nodes.push_back(expr);
+            done.push_back((uint32_t)exprs.size() - 1);
+        }
+        uint32_t index = done.back();
+        done.pop_back();
+        return index;
+    }
+
+    void addStmt(const Stmt* stmt) {
+        uint32_t idx = (uint32_t)stmts.size();
+        FlatStmt fs = { stmt->kind, 0, FLAT_NONE, 0 };
+        stmts.push_back(fs);
+        switch (stmt->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<const AssignStmt*>(stmt);
+            stmts[idx].a = assign->var;
+            stmts[idx].b = addExpr(assign->rhs);
+            break;
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(stmt);
+            stmts[idx].a = addExpr(ifs->cond);
+            addStmt(ifs->thenStmt);
+            if (ifs->elseStmt) {
+                stmts[idx].b = (uint32_t)stmts.size();
+                addStmt(ifs->elseStmt);
+            }
+            break;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<const WhileStmt*>(stmt);
+            stmts[idx].a = addExpr(whiles->cond);
+            addStmt(whiles->body);
+            break;
+        }
+        case STMT_RETURN:
+            stmts[idx].a = addExpr(static_cast<const ReturnStmt*>(stmt)->expr);
+            break;
+        case STMT_BLOCK:
+            for (const Stmt* s : *static_cast<const BlockStmt*>(stmt)) addStmt(s);
+            break;
+        case STMT_DECL:
+            stmts[idx].a = static_cast<const DeclStmt*>(stmt)->var;
+            break;
+        case STMT_EXPR:
+            stmts[idx].a = addExpr(static_cast<const ExprStmt*>(stmt)->expr);
+            break;
+        }
+        stmts[idx].end = (uint32_t)stmts.size();
+    }
+};
+
+// ---------- 符号表与作用域 ----------
+// 可分配给局部变量的寄存器，按分配优先顺序排列：先用没有8位形式的 esi/edi，
+// 把 ebx/ecx/edx 尽量留给表达式求值（比较运算的 setcc 需要8位寄存器）。
+// eax 是表达式结果寄存器，不参与变量分配，排在最后
+enum Reg : int8_t { REG_NONE = -1, REG_ESI, REG_EDI, REG_EBX, REG_ECX, REG_EDX, REG_COUNT, REG_EAX = REG_COUNT };
+const char* const REG_NAMES[REG_COUNT + 1] = { "esi", "edi", "ebx", "ecx", "edx", "eax" };
+const char* const REG_LOW_NAMES[REG_COUNT + 1] = { nullptr, nullptr, "bl", "cl", "dl", "al" };
+
+inline bool isCalleeSaved(Reg r) { return r <= REG_EBX; }
+
+// 内部调用约定中依次传递前几个实参的寄存器（与 fastcall 相同）
+const Reg ARG_REGS[] = { REG_ECX, REG_EDX };
+const int MAX_REG_PARAMS = 2;
+
+struct Symbol {
+    int offset;  // 栈偏移（相对于ebp：栈槽为负，栈上传来的形参为正）
+    uint32_t id; // 函数内按声明顺序的编号
+    Reg reg;     // 分配到的寄存器，REG_NONE 表示在栈上
+    Symbol(int off = 0, uint32_t i = 0) : offset(off), id(i), reg(REG_NONE) {}
+};
+
+// 所有作用域共用一张开放寻址表：每个名字只占一个槽，槽中记录当前可见的绑定。
+// 声明按顺序追加到 bindings，它同时是撤销日志：pop 时把本层的绑定逐个撤销，
+// 恢复被遮蔽的外层绑定。push/pop 的代价只与本层声明数有关，lookup 只需一次探查
+const uint32_t NO_BINDING = 0xFFFFFFFFu;
+
+class Scope {
+    struct Binding {
+        SymId name;
+        uint32_t depth; // 所在作用域层数
+        uint32_t prev;  // 被遮蔽的外层绑定，没有则为 NO_BINDING
+        Symbol sym;
+    };
+    vector<Binding> bindings;
+    vector<uint32_t> scopeStart;  // 各层第一个绑定在 bindings 中的下标
+    vector<uint32_t> slotNames;   // 开放寻址表，存 编号+1，0 表示空槽；名字一旦登记不再删除
+    vector<uint32_t> slotBinding; // 名字当前可见的绑定，NO_BINDING 表示不可见
+    size_t slotCount;
+    int stackSize; // 当前局部变量占用总字节数
+
+    static size_t hashId(SymId id) { return (size_t)(id * 2654435761u); }
+
+    // 返回名字所在槽，不存在时返回空槽位置
+    size_t probe(SymId name) const {
+        size_t mask = slotNames.size() - 1;
+        size_t i = hashId(name) & mask;
+        while (slotNames[i] && slotNames[i] != name + 1) i = (i + 1) & mask;
+        return i;
+    }
+
+    void rehash(size_t capacity) {
+        vector<uint32_t> oldNames, oldBinding;
+        oldNames.swap(slotNames);
+        oldBinding.swap(slotBinding);
+        slotNames.assign(capacity, 0);
+        slotBinding.assign(capacity, NO_BINDING);
+        for (size_t i = 0; i < oldNames.size(); ++i) {
+            if (!oldNames[i]) continue;
+            size_t j = probe(oldNames[i] - 1);
+            slotNames[j] = oldNames[i];
+            slotBinding[j] = oldBinding[i];
+        }
+    }
+
+public:
+    Scope() : slotCount(0), stackSize(0) {
+        rehash(64);
+        push();
+    }
+
+    void push() { scopeStart.push_back((uint32_t)bindings.size()); }
+
+    void pop() {
+        uint32_t start = scopeStart.back();
+        scopeStart.pop_back();
+        while (bindings.size() > start) {
+            const Binding& b = bindings.back();
+            slotBinding[probe(b.name)] = b.prev;
+            bindings.pop_back();
+        }
+    }
+
+    bool declare(SymId name) {
+        size_t i = probe(name);
+        if (!slotNames[i]) {
+            if ((slotCount + 1) * 2 > slotNames.size()) {
+                rehash(slotNames.size() * 2);
+                i = probe(name);
+            }
+            slotNames[i] = name + 1;
+            slotBinding[i] = NO_BINDING;
+            slotCount++;
+        }
+        uint32_t prev = slotBinding[i];
+        uint32_t depth = (uint32_t)scopeStart.size();
+        if (prev != NO_BINDING && bindings[prev].depth == depth) return false; // 重复定义
+        stackSize += 4;
+        bindings.push_back({ name, depth, prev, Symbol(-stackSize, (uint32_t)stackSize / 4 - 1) });
+        slotBinding[i] = (uint32_t)bindings.size() - 1;
+        return true;
+    }
+
+    // 返回的指针在下一次 declare 之前有效
+    Symbol* lookup(SymId name) {
+        uint32_t b = slotBinding[probe(name)];
+        return b == NO_BINDING ? nullptr : &bindings[b].sym;
+    }
+
+    int totalStackSize() const { return stackSize; }
+};
+
+// ---------- 语法分析 ----------
+// 二元运算符表：优先级越大结合越紧。新增运算符只需在此加一行，不增加解析的递归层数
+struct BinaryOperator {
+    TokenType token;
+    BinOp op;
+    uint8_t prec;
+    bool rightAssoc;
+};
+
+constexpr BinaryOperator BINARY_OPERATORS[] = {
+    { TOKEN_ASSIGN, BIN_ASSIGN, 1, true },
+    { TOKEN_EQ, BIN_EQ, 2, false },
+    { TOKEN_NE, BIN_NE, 2, false },
+    { TOKEN_LT, BIN_LT, 3, false },
+    { TOKEN_LE, BIN_LE, 3, false },
+    { TOKEN_GT, BIN_GT, 3, false },
+    { TOKEN_GE, BIN_GE, 3, false },
+    { TOKEN_PLUS, BIN_ADD, 4, false },
+    { TOKEN_MINUS, BIN_SUB, 4, false },
+    { TOKEN_MUL, BIN_MUL, 5, false },
+    { TOKEN_DIV, BIN_DIV, 5, false },
+};
+
+// 按记号类型直接索引的运算符表，prec 为 0 表示不是二元运算符（'(' 也是 0，可作栈中分隔）
+struct OperatorTable {
+    uint8_t prec[TOKEN_UNKNOWN + 1];
+    uint8_t op[TOKEN_UNKNOWN + 1];
+    bool rightAssoc[TOKEN_UNKNOWN + 1];
+};
+
+constexpr OperatorTable buildOperatorTable() {
+    OperatorTable t{};
+    for (const BinaryOperator& b : BINARY_OPERATORS) {
+        t.prec[b.token] = b.prec;
+        t.op[b.token] = (uint8_t)b.op;
+        t.rightAssoc[b.token] = b.rightAssoc;
+    }
+    return t;
+}
+
+constexpr OperatorTable OPERATOR_TABLE = buildOperatorTable();
+
+class Parser {
+    const TokenStream& toks;
+    size_t pos;      // 当前记号下标
+    TokenType cur;   // 当前记号类型（缓存，check 不必访问数组）
+    Arena* arena;    // 当前 Program 的内存池
+    vector<Stmt*> pendingStmts; // 各层块语句共用的临时栈，块结束时复制进内存池
+    vector<Expr*> operands;     // 表达式解析的操作数栈
+    vector<Expr*> pendingArgs;  // 各层调用共用的实参临时栈，调用结束时复制进内存池
+    vector<uint8_t> operators;  // 表达式解析的运算符栈（记号类型，TOKEN_LPAREN 为括号分隔）
+    HeaderCache& headers;
+    string sourceDir;           // 当前源文件所在目录，用于解析 #include
+    map<SymId, SymId> aliases;  // #define 别名 -> 目标名
+public:
+    Parser(const TokenStream& t, HeaderCache& h, const string& dir)
+        : toks(t), pos(0), cur(t.kind(0)), arena(nullptr), headers(h), sourceDir(dir) {}
+
+    unique_ptr<Program> parse() {
+        auto prog = make_unique<Program>();
+        arena = &prog->arena;
+        while (!check(TOKEN_EOF)) {
+            if (check(TOKEN_INLINE) || (check(TOKEN_INT) && peek(1) == TOKEN_IDENT && peek(2) == TOKEN_LPAREN)) {
+                prog->functions.push_back(parseFunction());
+            }
+            else {
+                applyDecl(*prog, parseDecl(), sourceDir);
+            }
+        }
+        return prog;
+    }
+
+    // 头文件只允许声明，结果交给调用方（并写入预编译缓存）
+    void parseHeader(vector<Decl>& decls) {
+        while (!check(TOKEN_EOF)) {
+            decls.push_back(parseDecl());
+        }
+    }
+
+private:
+    void advance() { if (cur != TOKEN_EOF) cur = toks.kind(++pos); }
+    TokenType peek(size_t ahead) const { return toks.kind(pos + ahead); }
+    bool check(TokenType tt) const { return cur == tt; }
+    bool match(TokenType tt) {
+        if (check(tt)) { advance(); return true; }
+        return false;
+    }
+    void expect(TokenType tt, const string& msg) {
+        if (!match(tt)) error(msg);
+    }
+
+    [[noreturn]] void error(const string& msg) {
+        cerr << "语法错误: " << msg << " 在 '" << toks.text(pos) << "' 附近\n";
+        exit(1);
+    }
+
+    // 顶层声明：#include、#define、extern 函数、int 全局变量（可带常量初值）
+    Decl parseDecl() {
+        Decl d = { DECL_GLOBAL, 0, 0, 0 };
+        if (check(TOKEN_INCLUDE)) {
+            d.kind = DECL_INCLUDE;
+            d.name = toks.sym(pos);
+            advance();
+            return d;
+        }
+        if (match(TOKEN_DEFINE)) {
+            if (!check(TOKEN_IDENT)) error("需要别名");
+            d.kind = DECL_ALIAS;
+            d.name = toks.sym(pos);
+            advance();
+            if (!check(TOKEN_IDENT)) error("需要别名目标");
+            d.target = toks.sym(pos);
+            advance();
+            return d;
+        }
+        if (match(TOKEN_EXTERN)) {
+            // extern int name(参数...); 参数只做跳过，也接受 extern int name;
+            expect(TOKEN_INT, "需要 'int'");
+            if (!check(TOKEN_IDENT)) error("需要函数名");
+            d.kind = DECL_EXTERN;
+            d.name = toks.sym(pos);
+            advance();
+            if (match(TOKEN_LPAREN)) {
+                while (!check(TOKEN_RPAREN) && !check(TOKEN_EOF)) advance();
+                expect(TOKEN_RPAREN, "需要 ')'");
+            }
+            expect(TOKEN_SEMICOLON, "需要 ';'");
+            return d;
+        }
+        expect(TOKEN_INT, "需要 'int'、extern 或预处理指令");
+        if (!check(TOKEN_IDENT)) error("需要变量名");
+        d.name = toks.sym(pos);
+        advance();
+        if (match(TOKEN_ASSIGN)) {
+            // 全局变量初值：可带负号的整数常量
+            bool negative = match(TOKEN_MINUS);
+            if (!check(TOKEN_NUMBER)) error("全局变量初值必须是常量");
+            d.value = negative ? -toks.value(pos) : toks.value(pos);
+            advance();
+        }
+        expect(TOKEN_SEMICOLON, "需要 ';' 在声明后");
+        return d;
+    }
+
+    void applyDecl(Program& prog, const Decl& d, const string& fromDir) {
+        switch (d.kind) {
+        case DECL_EXTERN:
+        case DECL_GLOBAL:  prog.decls.push_back(d); break;
+        case DECL_ALIAS:   aliases[d.name] = d.target; break;
+        case DECL_INCLUDE: includeHeader(prog, d.name, fromDir); break;
+        }
+    }
+
+    void includeHeader(Program& prog, SymId name, const string& fromDir) {
+        string path;
+        if (!headers.resolve(interner.str(name), fromDir, path)) {
+            cerr << "找不到头文件: " << interner.str(name) << endl;
+            exit(1);
+        }
+        if (!headers.markIncluded(path)) return;
+        string text;
+        if (!readSourceFile(path, text)) {
+            cerr << "无法读取头文件: " << path << endl;
+            exit(1);
+        }
+        uint64_t hash = HeaderCache::hashContent(text);
+        vector<Decl> decls;
+        if (!headers.load(path, hash, decls)) {
+            TokenStream headerToks(text.data(), text.data() + text.size());
+            Parser sub(headerToks, headers, dirName(path));
+            sub.parseHeader(decls);
+            headers.save(path, hash, decls);
+        }
+        string dir = dirName(path);
+        for (const Decl& d : decls) applyDecl(prog, d, dir);
+    }
+
+    // 名字经 #define 别名替换
+    SymId resolveName(SymId name) const {
+        if (aliases.empty()) return name;
+        auto it = aliases.find(name);
+        return it != aliases.end() ? it->second : name;
+    }
+
+    // 函数解析：[inline] int name ( [int a {, int b}] ) { ... }
+    Function* parseFunction() {
+        bool hint = match(TOKEN_INLINE);
+        expect(TOKEN_INT, "需要 'int'");
+        if (!check(TOKEN_IDENT)) error("需要函数名");
+        SymId name = toks.sym(pos);
+        advance();
+        expect(TOKEN_LPAREN, "需要 '('");
+        vector<SymId> params;
+        if (!check(TOKEN_RPAREN)) {
+            do {
+                expect(TOKEN_INT, "需要参数类型 'int'");
+                if (!check(TOKEN_IDENT)) error("需要参数名");
+                SymId param = toks.sym(pos);
+                if (find(params.begin(), params.end(), param) != params.end()) error("重复的参数名");
+                params.push_back(param);
+                advance();
+            } while (match(TOKEN_COMMA));
+        }
+        expect(TOKEN_RPAREN, "需要 ')'");
+        expect(TOKEN_LBRACE, "需要 '{'");
+        BlockStmt* body = parseBlock();
+        return arena->make<Function>(name, arena->copyArray(params.data(), params.size()), (uint32_t)params.size(), body, hint);
+    }
+
+    // 块语句：{ ... }
+    BlockStmt* parseBlock() {
+        size_t mark = pendingStmts.size();
+        while (!check(TOKEN_RBRACE) && !check(TOKEN_EOF)) {
+            Stmt* stmt = parseStmt();
+            pendingStmts.push_back(stmt);
+        }
+        expect(TOKEN_RBRACE, "需要 '}'");
+        size_t n = pendingStmts.size() - mark;
+        Stmt** stmts = arena->copyArray(pendingStmts.data() + mark, n);
+        pendingStmts.resize(mark);
+        return arena->make<BlockStmt>(stmts, (uint32_t)n);
+    }
+
+    // 语句解析
+    Stmt* parseStmt() {
+        if (check(TOKEN_INT)) {
+            advance(); // 跳过int
+            if (!check(TOKEN_IDENT)) error("需要变量名");
+            SymId var = toks.sym(pos);
+            advance();
+            expect(TOKEN_SEMICOLON, "需要 ';' 在声明后");
+            return arena->make<DeclStmt>(var);
+        }
+        if (check(TOKEN_IF)) return parseIf();
+        if (check(TOKEN_WHILE)) return parseWhile();
+        if (check(TOKEN_RETURN)) return parseReturn();
+        if (match(TOKEN_LBRACE)) return parseBlock();
+        return parseExpressionStmt();
+    }
+
+    Stmt* parseIf() {
+        advance(); // 'if'
+        expect(TOKEN_LPAREN, "需要 '(' 在 if 后");
+        auto cond = parseExpr();
+        expect(TOKEN_RPAREN, "需要 ')' 在条件后");
+        auto thenStmt = parseStmt();
+        Stmt* elseStmt = nullptr;
+        if (match(TOKEN_ELSE)) {
+            elseStmt = parseStmt();
+        }
+        return arena->make<IfStmt>(cond, thenStmt, elseStmt);
+    }
+
+    Stmt* parseWhile() {
+        advance(); // 'while'
+        expect(TOKEN_LPAREN, "需要 '(' 在 while 后");
+        auto cond = parseExpr();
+        expect(TOKEN_RPAREN, "需要 ')' 在条件后");
+        auto body = parseStmt();
+        return arena->make<WhileStmt>(cond, body);
+    }
+
+    Stmt* parseReturn() {
+        advance(); // 'return'
+        auto expr = parseExpr();
+        expect(TOKEN_SEMICOLON, "需要 ';' 在 return 后");
+        return arena->make<ReturnStmt>(expr);
+    }
+
+    // 表达式语句：expr ;
+    Stmt* parseExpressionStmt() {
+        // 前瞻两个记号：name = expr ; 直接构造赋值语句
+        if (check(TOKEN_IDENT) && peek(1) == TOKEN_ASSIGN) {
+            SymId var = resolveName(toks.sym(pos));
+            advance();
+            advance();
+            auto rhs = parseExpr();
+            expect(TOKEN_SEMICOLON, "需要 ';'");
+            return arena->make<AssignStmt>(var, rhs);
+        }
+        auto expr = parseExpr();
+        expect(TOKEN_SEMICOLON, "需要 ';'");
+        // 表达式语句可能是赋值
+        if (auto assign = as<BinaryOp>(expr)) {
+            if (assign->op == BIN_ASSIGN) {
+                // 提取左值变量名
+                if (auto leftVar = as<VarRef>(assign->left)) {
+                    SymId var = leftVar->name;
+                    return arena->make<AssignStmt>(var, assign->right);
+                }
+            }
+        }
+        if (expr->kind == EXPR_CALL) return arena->make<ExprStmt>(expr);
+        error("只有赋值或函数调用可以作为语句");
+        return nullptr;
+    }
+
+    // 表达式解析：优先级爬升，操作数与运算符各用一个显式栈，括号也只压栈，不递归
+    Expr* parseExpr() {
+        size_t opBase = operators.size();
+        int depth = 0; // 本表达式中尚未闭合的 '(' 数
+        while (true) {
+            while (match(TOKEN_LPAREN)) {
+                operators.push_back(TOKEN_LPAREN);
+                depth++;
+            }
+            operands.push_back(parsePrimary());
+            while (depth > 0 && match(TOKEN_RPAREN)) {
+                reduce(opBase, 1);
+                operators.pop_back(); // '('
+                depth--;
+            }
+            int prec = OPERATOR_TABLE.prec[cur];
+            if (prec == 0) break;
+            // 左结合时同级先归约，右结合（赋值）时同级留待右侧
+            reduce(opBase, OPERATOR_TABLE.rightAssoc[cur] ? prec + 1 : prec);
+            operators.push_back((uint8_t)cur);
+            advance();
+        }
+        if (depth > 0) error("需要 ')'");
+        reduce(opBase, 1);
+        Expr* result = operands.back();
+        operands.pop_back();
+        return result;
+    }
+
+    // 归约栈顶优先级不低于 minPrec 的运算符，遇到 '(' 或本表达式的栈底停止
+    void reduce(size_t opBase, int minPrec) {
+        while (operators.size() > opBase) {
+            TokenType t = (TokenType)operators.back();
+            if (OPERATOR_TABLE.prec[t] < minPrec) break;
+            operators.pop_back();
+            Expr* right = operands.back();
+            operands.pop_back();
+            Expr* left = operands.back();
+            BinOp op = (BinOp)OPERATOR_TABLE.op[t];
+            // 构建赋值节点（作为二元运算，左值应为VarRef）
+            if (op == BIN_ASSIGN && left->kind != EXPR_VAR) error("赋值左边必须是变量");
+            operands.back() = arena->make<BinaryOp>(op, left, right);
+        }
+    }
+
+    // 调用：name ( [expr {, expr}] )，'(' 已读过。实参各是一条完整的表达式，
+    // 在操作数栈、运算符栈的当前栈顶之上解析，不影响外层表达式
+    Expr* parseCall(SymId name) {
+        size_t mark = pendingArgs.size();
+        if (!check(TOKEN_RPAREN)) {
+            do {
+                Expr* arg = parseExpr();
+                pendingArgs.push_back(arg);
+            } while (match(TOKEN_COMMA));
+        }
+        expect(TOKEN_RPAREN, "需要 ')' 在实参后");
+        size_t n = pendingArgs.size() - mark;
+        Expr** args = arena->copyArray(pendingArgs.data() + mark, n);
+        pendingArgs.resize(mark);
+        return arena->make<CallExpr>(name, args, (uint32_t)n);
+    }
+
+    Expr* parsePrimary() {
+        if (check(TOKEN_NUMBER)) {
+            int value = toks.value(pos);
+            advance();
+            return arena->make<IntConst>(value);
+        }
+        if (check(TOKEN_IDENT)) {
+            SymId name = resolveName(toks.sym(pos));
+            advance();
+            if (match(TOKEN_LPAREN)) return parseCall(name);
+            return arena->make<VarRef>(name);
+        }
+        error("需要基本表达式");
+        return nullptr;
+    }
+};
+
+// ---------- 常量折叠 ----------
+// 语法分析之后、代码生成之前在语法树上走一遍：
+// 常量子表达式直接求值；化简 x+0、x-0、x*1、x/1、x*0、x-x 及相邻常数的合并；
+// 条件为常数的 if/while 只保留会执行的分支，死分支整个删除。
+// 运算按32位补码回绕；除数为0或 INT_MIN/-1 不折叠，留给运行时照常出错。
+class ConstantFolder {
+    Arena& arena;
+public:
+    explicit ConstantFolder(Arena& a) : arena(a) {}
+
+    void run(Program* prog) {
+        for (Function* func : prog->functions) foldBlock(func->body);
+    }
+
+    // 以下几个判断 SSA 优化回写时也要用
+    static bool constValue(const Expr* e, int32_t& v) {
+        if (auto c = as<const IntConst>(e)) { v = c->value; return true; }
+        return false;
+    }
+
+    // 表达式整体丢弃是否安全：赋值和函数调用有副作用
+    static bool isPure(const Expr* e) {
+        bool pure = true;
+        walkExpr(e, [&](const Expr* n) {
+            if (n->kind == EXPR_CALL || (n->kind == EXPR_BINARY && static_cast<const BinaryOp*>(n)->op == BIN_ASSIGN)) pure = false;
+            return pure;
+        });
+        return pure;
+    }
+
+    // 死分支删除后，其中的裸声明（不在块内）原本会登记到外层作用域，这种分支保留不删
+    static bool leaksDecl(const Stmt* s) {
+        if (!s) return false;
+        switch (s->kind) {
+        case STMT_DECL:  return true;
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            return leaksDecl(ifs->thenStmt) || leaksDecl(ifs->elseStmt);
+        }
+        case STMT_WHILE: return leaksDecl(static_cast<const WhileStmt*>(s)->body);
+        default:         return false;
+        }
+    }
+
+    static bool evaluate(BinOp op, int32_t l, int32_t r, int32_t& v) {
+        uint32_t ul = (uint32_t)l, ur = (uint32_t)r;
+        switch (op) {
+        case BIN_ADD: v = (int32_t)(ul + ur); return true;
+        case BIN_SUB: v = (int32_t)(ul - ur); return true;
+        case BIN_MUL: v = (int32_t)(ul * ur); return true;
+        case BIN_DIV:
+            if (r == 0 || (l == INT32_MIN && r == -1)) return false;
+            v = l / r; return true;
+        case BIN_LT: v = l < r; return true;
+        case BIN_LE: v = l <= r; return true;
+        case BIN_GT: v = l > r; return true;
+        case BIN_GE: v = l >= r; return true;
+        case BIN_EQ: v = l == r; return true;
+        case BIN_NE: v = l != r; return true;
+        default: return false;
+        }
+    }
+
+private:
+    Expr* constant(int32_t v) { return arena.make<IntConst>(v); }
+
+    Expr* foldExpr(Expr* root) {
+        return postOrderExpr<Expr*>(root, [&](Expr* e, Expr** kids) -> Expr* {
+            if (auto call = as<CallExpr>(e)) {
+                copy(kids, kids + call->argCount, call->args);
+                return e;
+            }
+            auto bin = as<BinaryOp>(e);
+            if (!bin) return e;
+            bin->left = kids[0];
+            bin->right = kids[1];
+            if (bin->op == BIN_ASSIGN) return bin;
+            return simplify(bin);
+        });
+    }
+
+    Expr* simplify(BinaryOp* bin) {
+        int32_t l, r, v;
+        bool lc = constValue(bin->left, l), rc = constValue(bin->right, r);
+        if (lc && rc) {
+            return evaluate(bin->op, l, r, v) ? constant(v) : bin;
+        }
+        if (rc) {
+            if (r == 0 && (bin->op == BIN_ADD || bin->op == BIN_SUB)) return bin->left;
+            if (r == 1 && (bin->op == BIN_MUL || bin->op == BIN_DIV)) return bin->left;
+            if (r == 0 && bin->op == BIN_MUL && isPure(bin->left)) return constant(0);
+            return combine(bin, r);
+        }
+        if (lc) {
+            if (l == 0 && bin->op == BIN_ADD) return bin->right;
+            if (l == 1 && bin->op == BIN_MUL) return bin->right;
+            if (l == 0 && bin->op == BIN_MUL && isPure(bin->right)) return constant(0);
+            return bin;
+        }
+        // x-x、x==x 等：两侧是同一变量
+        auto lv = as<VarRef>(bin->left), rv = as<VarRef>(bin->right);
+        if (lv && rv && lv->name == rv->name) {
+            switch (bin->op) {
+            case BIN_SUB: case BIN_LT: case BIN_GT: case BIN_NE: return constant(0);
+            case BIN_LE: case BIN_GE: case BIN_EQ: return constant(1);
+            default: break;
+            }
+        }
+        return bin;
+    }
+
+    // (x ± c1) ± c2 合并为 x + c，(x * c1) * c2 合并为 x * c
+    Expr* combine(BinaryOp* bin, int32_t r) {
+        auto inner = as<BinaryOp>(bin->left);
+        int32_t c;
+        if (!inner || !constValue(inner->right, c)) return bin;
+        bool additive = bin->op == BIN_ADD || bin->op == BIN_SUB;
+        bool innerAdditive = inner->op == BIN_ADD || inner->op == BIN_SUB;
+        if (additive && innerAdditive) {
+            uint32_t sum = (inner->op == BIN_ADD ? (uint32_t)c : 0u - (uint32_t)c)
+                         + (bin->op == BIN_ADD ? (uint32_t)r : 0u - (uint32_t)r);
+            if (sum == 0) return inner->left;
+            inner->op = BIN_ADD;
+            inner->right = constant((int32_t)sum);
+            return inner;
+        }
+        if (bin->op == BIN_MUL && inner->op == BIN_MUL) {
+            inner->right = constant((int32_t)((uint32_t)c * (uint32_t)r));
+            return simplify(inner);
+        }
+        return bin;
+    }
+
+    void foldBlock(BlockStmt* block) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < block->count; ++i) {
+            if (Stmt* s = foldStmt(block->stmts[i])) block->stmts[n++] = s;
+        }
+        block->count = n;
+    }
+
+    // 嵌套位置（分支、循环体）不能为空，删掉的语句以空块代替
+    Stmt* foldChild(Stmt* s) {
+        Stmt* folded = foldStmt(s);
+        return folded ? folded : arena.make<BlockStmt>(nullptr, 0);
+    }
+
+    // 返回化简后的语句；返回空指针表示整条语句可以删除
+    Stmt* foldStmt(Stmt* s) {
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<AssignStmt*>(s);
+            assign->rhs = foldExpr(assign->rhs);
+            return s;
+        }
+        case STMT_RETURN: {
+            auto ret = static_cast<ReturnStmt*>(s);
+            ret->expr = foldExpr(ret->expr);
+            return s;
+        }
+        case STMT_EXPR: {
+            auto es = static_cast<ExprStmt*>(s);
+            es->expr = foldExpr(es->expr);
+            return s;
+        }
+        case STMT_BLOCK:
+            foldBlock(static_cast<BlockStmt*>(s));
+            return s;
+        case STMT_DECL:
+            return s;
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->cond = foldExpr(ifs->cond);
+            int32_t v;
+            if (constValue(ifs->cond, v) && !leaksDecl(v ? ifs->elseStmt : ifs->thenStmt)) {
+                Stmt* live = v ? ifs->thenStmt : ifs->elseStmt;
+                return live ? foldStmt(live) : nullptr;
+            }
+            ifs->thenStmt = foldChild(ifs->thenStmt);
+            if (ifs->elseStmt) ifs->elseStmt = foldStmt(ifs->elseStmt);
+            return s;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->cond = foldExpr(whiles->cond);
+            int32_t v;
+            if (constValue(whiles->cond, v) && v == 0 && !leaksDecl(whiles->body)) return nullptr;
+            whiles->body = foldChild(whiles->body);
+            return s;
+        }
+        }
+        return s;
+    }
+};
+
+// ---------- 函数内联 ----------
+// 调用展开成被调函数体的副本：实参依次赋给改名后的形参，函数体中的局部变量也换成新名字，
+// return e 改为给结果变量赋值，调用处改读结果变量。展开的语句放在调用所在语句之前：
+//   x = f(a) + 1;  =>  { int r; int p; p = a; { 函数体，return e 改为 r = e } x = r + 1; }
+// return 先改成结构化形式：if 的一个分支执行了 return 时，if 之后的语句移入另一分支；
+// 需要把后续语句复制到两个分支、或 return 在循环内的函数不内联。
+// 代价模型：函数体的节点数不超过阈值（-finline-limit=N）时内联，带 inline 的函数阈值放宽到 4 倍，
+// 全程序只有一处调用的总是内联；调用图环上的（递归）函数不内联。
+// 按调用图由底向上处理，被调函数先完成自身的内联。调用全部展开了的函数（main 除外）随之删除。
+// 调用提前到语句之前执行，因此语句中先于它求值、仍留在原处的部分不得读全局变量、
+// 不得含赋值或未展开的调用，实参也不得含赋值；while 条件中的调用不展开。
+int countExpr(const Expr* e) {
+    int n = 0;
+    walkExpr(e, [&](const Expr*) { n++; return true; });
+    return n;
+}
+
+// 语句的节点数，内联和循环展开用来估计代码量
+int countStmt(const Stmt* s) {
+    int n = 0;
+    walkStmt(s, [&](const Stmt* c) {
+        const Expr* e = stmtExpr(c);
+        n += 1 + (e ? countExpr(e) : 0);
+        return true;
+    });
+    return n;
+}
+
+class Inliner {
+    static const int HINT_FACTOR = 4;  // inline 函数的阈值倍数
+
+    struct Callee {
+        Function* func;
+        uint32_t calls;     // 全程序的调用点数（内联之前）
+        bool recursive;     // 在调用图的环上
+        bool expanded;      // 至少有一处调用被展开
+    };
+
+    Arena& arena;
+    int limit;
+    uint32_t tempCount;            // 临时变量编号，名字含 '.'，不会与源程序的标识符冲突
+    map<SymId, Callee> callees;
+    Function* caller;              // 正在处理的函数
+    Scope* scope;                  // 调用方当前可见的局部变量
+    vector<pair<SymId, SymId>> renames; // 复制函数体时的改名表，按作用域压栈
+    vector<SymId> freeNames;       // 复制函数体时遇到的非局部名字
+
+    struct HoistFrame {
+        Expr* e;
+        bool entered;  // 子节点已经入栈
+        bool movable;  // 调用：进入时此前求值的部分是否都可与它交换次序
+    };
+    vector<HoistFrame> hoistStack; // hoist 的工作栈
+    vector<Expr*> hoisted;         // hoist 已处理完的子树
+
+public:
+    Inliner(Arena& a, int sizeLimit) : arena(a), limit(sizeLimit), tempCount(0), caller(nullptr), scope(nullptr) {}
+
+    void run(Program* prog) {
+        for (Function* func : prog->functions) callees[func->name] = { func, 0, false, false };
+        map<SymId, vector<SymId>> graph;
+        for (Function* func : prog->functions) {
+            vector<SymId>& targets = graph[func->name];
+            collectCalls(func->body, targets);
+            for (SymId t : targets) {
+                auto it = callees.find(t);
+                if (it != callees.end()) it->second.calls++;
+            }
+        }
+
+        // 深度优先求后序，顺带标出环上的函数
+        map<SymId, uint8_t> state; // 0 未访问，1 在栈上，2 已完成
+        vector<SymId> stack, order;
+        for (Function* func : prog->functions) {
+            if (!state[func->name]) visit(func->name, graph, state, stack, order);
+        }
+        for (SymId name : order) inlineInto(callees[name].func);
+
+        // 重新统计调用点，删除已无调用的展开过的函数
+        vector<SymId> remaining;
+        for (Function* func : prog->functions) collectCalls(func->body, remaining);
+        sort(remaining.begin(), remaining.end());
+        SymId mainName = interner.intern("main");
+        auto dead = [&](Function* func) {
+            return func->name != mainName && callees[func->name].expanded &&
+                   !binary_search(remaining.begin(), remaining.end(), func->name);
+        };
+        prog->functions.erase(remove_if(prog->functions.begin(), prog->functions.end(), dead), prog->functions.end());
+    }
+
+private:
+    // ---- 调用图 ----
+    // 按求值顺序列出语句树中的调用
+    static void collectCalls(const Stmt* s, vector<SymId>& out) {
+        walkStmt(s, [&](const Stmt* c) {
+            if (const Expr* e = stmtExpr(c)) {
+                walkExpr(e, [&](const Expr* n) {
+                    if (auto call = as<const CallExpr>(n)) out.push_back(call->name);
+                    return true;
+                });
+            }
+            return true;
+        });
+    }
+
+    void visit(SymId name, const map<SymId, vector<SymId>>& graph, map<SymId, uint8_t>& state,
+               vector<SymId>& stack, vector<SymId>& order) {
+        state[name] = 1;
+        stack.push_back(name);
+        for (SymId t : graph.at(name)) {
+            if (!callees.count(t)) continue; // extern 或未定义，留给代码生成报错
+            uint8_t st = state[t];
+            if (st == 0) visit(t, graph, state, stack, order);
+            else if (st == 1) {
+                // 回边：栈上从 t 到栈顶的函数构成环
+                for (size_t k = stack.size(); k-- > 0;) {
+                    callees[stack[k]].recursive = true;
+                    if (stack[k] == t) break;
+                }
+            }
+        }
+        stack.pop_back();
+        state[name] = 2;
+        order.push_back(name);
+    }
+
+    // ---- 调用方的遍历 ----
+    void inlineInto(Function* func) {
+        Scope local;
+        scope = &local;
+        caller = func;
+        for (uint32_t k = 0; k < func->paramCount; ++k) local.declare(func->params[k]);
+        inlineStmt(func->body);
+        scope = nullptr;
+    }
+
+    Stmt* inlineStmt(Stmt* s) {
+        vector<Stmt*> pre; // 提前执行的展开语句
+        bool clean = true;
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<AssignStmt*>(s);
+            assign->rhs = hoist(assign->rhs, pre, clean);
+            return withPrefix(pre, s);
+        }
+        case STMT_EXPR: {
+            auto es = static_cast<ExprStmt*>(s);
+            es->expr = hoist(es->expr, pre, clean);
+            return withPrefix(pre, es->expr->kind == EXPR_VAR ? nullptr : s); // 只剩结果变量时整条丢弃
+        }
+        case STMT_RETURN: {
+            auto ret = static_cast<ReturnStmt*>(s);
+            ret->expr = hoist(ret->expr, pre, clean);
+            return withPrefix(pre, s);
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->cond = hoist(ifs->cond, pre, clean);
+            ifs->thenStmt = inlineStmt(ifs->thenStmt);
+            if (ifs->elseStmt) ifs->elseStmt = inlineStmt(ifs->elseStmt);
+            return withPrefix(pre, s);
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->body = inlineStmt(whiles->body);
+            return s;
+        }
+        case STMT_BLOCK: {
+            auto block = static_cast<BlockStmt*>(s);
+            scope->push();
+            for (uint32_t i = 0; i < block->count; ++i) block->stmts[i] = inlineStmt(block->stmts[i]);
+            scope->pop();
+            return s;
+        }
+        default:
+            scope->declare(static_cast<DeclStmt*>(s)->var);
+            return s;
+        }
+    }
+
+    Stmt* withPrefix(vector<Stmt*>& pre, Stmt* s) {
+        if (pre.empty()) return s;
+        if (s) pre.push_back(s);
+        return block(pre);
+    }
+
+    // 按求值顺序处理表达式，可展开的调用换成结果变量。
+    // clean 表示此前求值、留在原处的部分都可以与被提前的调用交换次序。
+    // 用显式栈做后序遍历：节点第一次到栈顶时压入子节点（赋值只有右侧），子节点都处理完后再处理自己
+    Expr* hoist(Expr* root, vector<Stmt*>& pre, bool& clean) {
+        hoistStack.push_back(HoistFrame{ root, false, false });
+        while (!hoistStack.empty()) {
+            HoistFrame& f = hoistStack.back();
+            Expr* e = f.e;
+            if (!f.entered && (e->kind == EXPR_CALL || e->kind == EXPR_BINARY)) {
+                f.entered = true;
+                if (auto call = as<CallExpr>(e)) {
+                    f.movable = clean;
+                    for (uint32_t k = call->argCount; k-- > 0;) hoistStack.push_back(HoistFrame{ call->args[k], false, false });
+                }
+                else {
+                    auto bin = static_cast<BinaryOp*>(e);
+                    hoistStack.push_back(HoistFrame{ bin->right, false, false });
+                    if (bin->op != BIN_ASSIGN) hoistStack.push_back(HoistFrame{ bin->left, false, false });
+                }
+                continue;
+            }
+            bool movable = f.movable;
+            hoistStack.pop_back();
+            switch (e->kind) {
+            case EXPR_VAR:
+                if (!scope->lookup(static_cast<VarRef*>(e)->name)) clean = false; // 全局变量可能被调用改写
+                break;
+            case EXPR_CALL: {
+                auto call = static_cast<CallExpr*>(e);
+                copy(hoisted.end() - call->argCount, hoisted.end(), call->args);
+                hoisted.resize(hoisted.size() - call->argCount);
+                SymId result;
+                if (movable && expand(call, pre, result)) {
+                    clean = true; // 实参随调用一起移走了
+                    e = arena.make<VarRef>(result);
+                }
+                else clean = false;
+                break;
+            }
+            case EXPR_BINARY: {
+                auto bin = static_cast<BinaryOp*>(e);
+                bin->right = hoisted.back();
+                hoisted.pop_back();
+                if (bin->op == BIN_ASSIGN) clean = false;
+                else {
+                    bin->left = hoisted.back();
+                    hoisted.pop_back();
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            hoisted.push_back(e);
+        }
+        Expr* result = hoisted.back();
+        hoisted.pop_back();
+        return result;
+    }
+
+    // ---- 展开 ----
+    Function* choose(const CallExpr* call) {
+        auto it = callees.find(call->name);
+        if (it == callees.end()) return nullptr;
+        const Callee& c = it->second;
+        Function* func = c.func;
+        if (func == caller || c.recursive || func->paramCount != call->argCount) return nullptr;
+        for (const Expr* arg : *call) {
+            if (hasAssign(arg)) return nullptr;
+        }
+        int budget = func->inlineHint ? limit * HINT_FACTOR : limit;
+        if (c.calls != 1 && countStmt(func->body) > budget) return nullptr;
+        if (!canLower(func->body->begin(), func->body->end(), true)) return nullptr;
+        return func;
+    }
+
+    bool expand(CallExpr* call, vector<Stmt*>& pre, SymId& result) {
+        Function* func = choose(call);
+        if (!func) return false;
+        renames.clear();
+        freeNames.clear();
+        vector<SymId> params;
+        for (uint32_t k = 0; k < func->paramCount; ++k) {
+            params.push_back(fresh());
+            renames.push_back(make_pair(func->params[k], params.back()));
+        }
+        Stmt* body = cloneStmt(func->body);
+        // 被调函数用到的全局变量在调用处被同名局部变量遮蔽时不能展开
+        for (SymId name : freeNames) {
+            if (scope->lookup(name)) return false;
+        }
+        result = fresh();
+        pre.push_back(arena.make<DeclStmt>(result));
+        for (uint32_t k = 0; k < func->paramCount; ++k) {
+            pre.push_back(arena.make<DeclStmt>(params[k]));
+            pre.push_back(arena.make<AssignStmt>(params[k], call->args[k]));
+        }
+        lower(pre, &body, &body + 1, vector<Stmt*>(), result);
+        callees[func->name].expanded = true;
+        return true;
+    }
+
+    SymId fresh() { return interner.intern("inline." + to_string(tempCount++)); }
+
+    static bool hasAssign(const Expr* e) {
+        bool found = false;
+        walkExpr(e, [&](const Expr* n) {
+            auto bin = as<const BinaryOp>(n);
+            found = found || (bin && bin->op == BIN_ASSIGN);
+            return !found;
+        });
+        return found;
+    }
+
+    static bool hasReturn(const Stmt* s) {
+        switch (s->kind) {
+        case STMT_RETURN: return true;
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            return hasReturn(ifs->thenStmt) || (ifs->elseStmt && hasReturn(ifs->elseStmt));
+        }
+        case STMT_WHILE: return hasReturn(static_cast<const WhileStmt*>(s)->body);
+        case STMT_BLOCK:
+            for (const Stmt* c : *static_cast<const BlockStmt*>(s)) {
+                if (hasReturn(c)) return true;
+            }
+            return false;
+        default: return false;
+        }
+    }
+
+    // 执行到语句末尾之前一定已经 return
+    static bool alwaysReturns(const Stmt* s) {
+        switch (s->kind) {
+        case STMT_RETURN: return true;
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            return ifs->elseStmt && alwaysReturns(ifs->thenStmt) && alwaysReturns(ifs->elseStmt);
+        }
+        case STMT_BLOCK:
+            for (const Stmt* c : *static_cast<const BlockStmt*>(s)) {
+                if (alwaysReturns(c)) return true;
+            }
+            return false;
+        default: return false;
+        }
+    }
+
+    // 语句序列能否不复制代码地改成结构化形式；tail 表示序列之后没有别的语句。
+    // 含 return 的语句之后的语句会被移进它的某个分支，所处位置之后的语句不变，照原位置检查
+    static bool canLower(Stmt* const* begin, Stmt* const* end, bool tail) {
+        for (Stmt* const* p = begin; p != end; ++p) {
+            const Stmt* s = *p;
+            if (!hasReturn(s)) continue;
+            bool last = tail && p + 1 == end;
+            switch (s->kind) {
+            case STMT_RETURN:
+                return true;
+            case STMT_BLOCK: {
+                auto block = static_cast<const BlockStmt*>(s);
+                if (!canLower(block->begin(), block->end(), last)) return false;
+                break;
+            }
+            case STMT_IF: {
+                auto ifs = static_cast<const IfStmt*>(s);
+                bool thenReturns = alwaysReturns(ifs->thenStmt);
+                bool elseReturns = ifs->elseStmt && alwaysReturns(ifs->elseStmt);
+                if (!last && !thenReturns && !elseReturns) return false; // 后续语句要进两个分支
+                if (!canLower(&ifs->thenStmt, &ifs->thenStmt + 1, last)) return false;
+                if (ifs->elseStmt && !canLower(&ifs->elseStmt, &ifs->elseStmt + 1, last)) return false;
+                break;
+            }
+            default:
+                return false; // 循环内的 return
+            }
+        }
+        return true;
+    }
+
+    // 把 [begin, end) 加上后续语句 rest 改成结构化形式追加到 out，return e 改为 result = e。
+    // 遇到含 return 的语句时，其后的语句连同 rest 移进它内部；canLower 保证每条后续语句只落到一处，
+    // 因此不必复制
+    void lower(vector<Stmt*>& out, Stmt* const* begin, Stmt* const* end, const vector<Stmt*>& rest, SymId result) {
+        for (Stmt* const* p = begin; p != end; ++p) {
+            Stmt* s = *p;
+            if (!hasReturn(s)) {
+                out.push_back(s);
+                continue;
+            }
+            vector<Stmt*> next(p + 1, end);
+            next.insert(next.end(), rest.begin(), rest.end());
+            switch (s->kind) {
+            case STMT_RETURN:
+                out.push_back(arena.make<AssignStmt>(result, static_cast<ReturnStmt*>(s)->expr));
+                return;
+            case STMT_BLOCK: {
+                auto b = static_cast<BlockStmt*>(s);
+                vector<Stmt*> inner;
+                lower(inner, b->begin(), b->end(), next, result);
+                out.push_back(block(inner));
+                return;
+            }
+            default: {
+                auto ifs = static_cast<IfStmt*>(s);
+                vector<Stmt*> thenPart, elsePart;
+                lower(thenPart, &ifs->thenStmt, &ifs->thenStmt + 1, next, result);
+                if (ifs->elseStmt) lower(elsePart, &ifs->elseStmt, &ifs->elseStmt + 1, next, result);
+                else lower(elsePart, nullptr, nullptr, next, result);
+                ifs->thenStmt = block(thenPart);
+                ifs->elseStmt = elsePart.empty() ? nullptr : block(elsePart);
+                out.push_back(ifs);
+                return;
+            }
+            }
+        }
+        lower(out, rest.data(), rest.data() + rest.size(), vector<Stmt*>(), result);
+    }
+
+    Stmt* block(const vector<Stmt*>& stmts) {
+        return arena.make<BlockStmt>(arena.copyArray(stmts.data(), stmts.size()), (uint32_t)stmts.size());
+    }
+
+    // ---- 带改名的复制 ----
+    SymId rename(SymId name) {
+        for (size_t k = renames.size(); k-- > 0;) {
+            if (renames[k].first == name) return renames[k].second;
+        }
+        freeNames.push_back(name);
+        return name;
+    }
+
+    Expr* cloneExpr(const Expr* root) {
+        return postOrderExpr<Expr*>(root, [&](const Expr* e, Expr** kids) -> Expr* {
+            switch (e->kind) {
+            case EXPR_INT: return arena.make<IntConst>(static_cast<const IntConst*>(e)->value);
+            case EXPR_VAR: return arena.make<VarRef>(rename(static_cast<const VarRef*>(e)->name));
+            case EXPR_CALL: {
+                auto call = static_cast<const CallExpr*>(e);
+                return arena.make<CallExpr>(call->name, arena.copyArray(kids, call->argCount), call->argCount);
+            }
+            default:
+                return arena.make<BinaryOp>(static_cast<const BinaryOp*>(e)->op, kids[0], kids[1]);
+            }
+        });
+    }
+
+    Stmt* cloneStmt(const Stmt* s) {
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<const AssignStmt*>(s);
+            Expr* rhs = cloneExpr(assign->rhs);
+            return arena.make<AssignStmt>(rename(assign->var), rhs);
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            Expr* cond = cloneExpr(ifs->cond);
+            Stmt* thenStmt = cloneStmt(ifs->thenStmt);
+            return arena.make<IfStmt>(cond, thenStmt, ifs->elseStmt ? cloneStmt(ifs->elseStmt) : nullptr);
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<const WhileStmt*>(s);
+            Expr* cond = cloneExpr(whiles->cond);
+            return arena.make<WhileStmt>(cond, cloneStmt(whiles->body));
+        }
+        case STMT_RETURN:
+            return arena.make<ReturnStmt>(cloneExpr(static_cast<const ReturnStmt*>(s)->expr));
+        case STMT_EXPR:
+            return arena.make<ExprStmt>(cloneExpr(static_cast<const ExprStmt*>(s)->expr));
+        case STMT_BLOCK: {
+            size_t mark = renames.size();
+            vector<Stmt*> stmts;
+            for (const Stmt* c : *static_cast<const BlockStmt*>(s)) stmts.push_back(cloneStmt(c));
+            renames.resize(mark);
+            return block(stmts);
+        }
+        default: {
+            SymId name = fresh();
+            renames.push_back(make_pair(static_cast<const DeclStmt*>(s)->var, name));
+            return arena.make<DeclStmt>(name);
+        }
+        }
+    }
+};
+
+// ---------- 循环不变量外提 ----------
+// 由内向外处理每个 while：循环内既不赋值也不声明的变量视为不变，
+// 循环内有函数调用时被调函数可能改写全局变量，全局变量都不算不变；调用本身从不外提。
+// 只由常数和不变变量组成的子表达式（取最大的子树）移到循环之前，算进新的局部变量，
+// 循环内改读该变量。结构相同的不变表达式共用一个变量。
+// 循环执行0次时外提的表达式也会被求值，因此循环体中可能出错的除法（除数不是常数）不外提；
+// 条件在进入循环时至少求值一次，其中的表达式不受此限制。
+// 条件本身是比较时只外提两侧，比较留给条件跳转。
+// 改写形式：while (...) ...  =>  { int t; t = e; while (...) ... }
+class LoopInvariantMotion {
+    Arena& arena;
+    uint32_t tempCount;            // 临时变量编号，名字含 '.'，不会与源程序的标识符冲突
+    vector<SymId> variant;         // 当前循环内赋值或声明的变量
+    vector<SymId> globals;         // 全局变量名，循环内有调用时都视为被改写
+    bool hasCall;                  // 当前循环内是否有函数调用
+    vector<pair<Expr*, SymId>> hoisted; // 当前循环外提的表达式及其临时变量
+    unordered_set<const Expr*> movable; // rewriteExpr 中可以外提的子表达式
+public:
+    explicit LoopInvariantMotion(Arena& a) : arena(a), tempCount(0), hasCall(false) {}
+
+    void run(Program* prog) {
+        for (const Decl& d : prog->decls) {
+            if (d.kind == DECL_GLOBAL) globals.push_back(d.name);
+        }
+        for (Function* func : prog->functions) hoistStmt(func->body);
+    }
+
+private:
+    Stmt* hoistStmt(Stmt* s) {
+        switch (s->kind) {
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->thenStmt = hoistStmt(ifs->thenStmt);
+            if (ifs->elseStmt) ifs->elseStmt = hoistStmt(ifs->elseStmt);
+            return s;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->body = hoistStmt(whiles->body);
+            return hoistLoop(whiles);
+        }
+        case STMT_BLOCK: {
+            auto block = static_cast<BlockStmt*>(s);
+            for (uint32_t i = 0; i < block->count; ++i) block->stmts[i] = hoistStmt(block->stmts[i]);
+            return s;
+        }
+        default:
+            return s;
+        }
+    }
+
+    Stmt* hoistLoop(WhileStmt* loop) {
+        // 循环体是裸声明时它登记在外层作用域，包进新块会改变作用域，不处理
+        if (ConstantFolder::leaksDecl(loop->body)) return loop;
+        variant.clear();
+        hoisted.clear();
+        hasCall = false;
+        collectExpr(loop->cond);
+        collectStmt(loop->body);
+        if (hasCall) variant.insert(variant.end(), globals.begin(), globals.end());
+        sort(variant.begin(), variant.end());
+
+        if (auto cmp = as<BinaryOp>(loop->cond)) {
+            if (cmp->op >= BIN_LT && cmp->op <= BIN_NE) {
+                cmp->left = rewriteExpr(cmp->left, true);
+                cmp->right = rewriteExpr(cmp->right, true);
+            }
+            else loop->cond = rewriteExpr(loop->cond, true);
+        }
+        rewriteStmt(loop->body);
+        if (hoisted.empty()) return loop;
+
+        vector<Stmt*> stmts;
+        for (const auto& h : hoisted) {
+            stmts.push_back(arena.make<DeclStmt>(h.second));
+            stmts.push_back(arena.make<AssignStmt>(h.second, h.first));
+        }
+        stmts.push_back(loop);
+        return arena.make<BlockStmt>(arena.copyArray(stmts.data(), stmts.size()), (uint32_t)stmts.size());
+    }
+
+    // ---- 收集循环内改写的变量 ----
+    void collectExpr(const Expr* e) {
+        walkExpr(e, [&](const Expr* n) {
+            if (n->kind == EXPR_CALL) hasCall = true;
+            else if (auto bin = as<const BinaryOp>(n)) {
+                if (bin->op != BIN_ASSIGN) return true;
+                if (auto target = as<const VarRef>(bin->left)) variant.push_back(target->name);
+            }
+            return true;
+        });
+    }
+
+    void collectStmt(const Stmt* body) {
+        walkStmt(body, [&](const Stmt* s) {
+            if (s->kind == STMT_ASSIGN) variant.push_back(static_cast<const AssignStmt*>(s)->var);
+            else if (s->kind == STMT_DECL) variant.push_back(static_cast<const DeclStmt*>(s)->var);
+            if (const Expr* e = stmtExpr(s)) collectExpr(e);
+            return true;
+        });
+    }
+
+    // ---- 判断与改写 ----
+    enum : uint8_t { INVARIANT = 1, SPECULABLE = 2 }; // 子树不变；提前求值不会出错（除数都是 0、-1 以外的常数）
+
+    static bool sameExpr(const Expr* a, const Expr* b) {
+        vector<pair<const Expr*, const Expr*>> stack(1, make_pair(a, b));
+        while (!stack.empty()) {
+            const Expr* x = stack.back().first;
+            const Expr* y = stack.back().second;
+            stack.pop_back();
+            if (x->kind != y->kind) return false;
+            switch (x->kind) {
+            case EXPR_INT:
+                if (static_cast<const IntConst*>(x)->value != static_cast<const IntConst*>(y)->value) return false;
+                break;
+            case EXPR_VAR:
+                if (static_cast<const VarRef*>(x)->name != static_cast<const VarRef*>(y)->name) return false;
+                break;
+            default: {
+                auto bx = static_cast<const BinaryOp*>(x), by = static_cast<const BinaryOp*>(y);
+                if (bx->op != by->op) return false;
+                stack.push_back(make_pair(bx->right, by->right));
+                stack.push_back(make_pair(bx->left, by->left));
+                break;
+            }
+            }
+        }
+        return true;
+    }
+
+    // always 为真表示表达式每次进入循环都会求值。
+    // 先后序算出每棵子树能否外提，再从根往下找，遇到能外提的子树整棵换成临时变量
+    Expr* rewriteExpr(Expr* root, bool always) {
+        movable.clear();
+        postOrderExpr<uint8_t>(root, [&](const Expr* e, const uint8_t* kids) -> uint8_t {
+            switch (e->kind) {
+            case EXPR_INT: return INVARIANT | SPECULABLE;
+            case EXPR_VAR:
+                return binary_search(variant.begin(), variant.end(), static_cast<const VarRef*>(e)->name)
+                    ? SPECULABLE : INVARIANT | SPECULABLE;
+            case EXPR_CALL: return SPECULABLE;
+            default: {
+                auto bin = static_cast<const BinaryOp*>(e);
+                uint8_t f = kids[0] & kids[1];
+                int32_t d;
+                if (bin->op == BIN_ASSIGN) f &= ~INVARIANT;
+                if (bin->op == BIN_DIV && (!ConstantFolder::constValue(bin->right, d) || d == 0 || d == -1)) f &= ~SPECULABLE;
+                if ((f & INVARIANT) && (always || (f & SPECULABLE))) movable.insert(e);
+                return f;
+            }
+            }
+        });
+        vector<Expr**> slots(1, &root);
+        while (!slots.empty()) {
+            Expr** slot = slots.back();
+            slots.pop_back();
+            if (movable.count(*slot)) *slot = temp(*slot);
+            else if (auto call = as<CallExpr>(*slot)) {
+                for (uint32_t k = call->argCount; k-- > 0;) slots.push_back(&call->args[k]);
+            }
+            else if (auto bin = as<BinaryOp>(*slot)) {
+                slots.push_back(&bin->right);
+                if (bin->op != BIN_ASSIGN) slots.push_back(&bin->left);
+            }
+        }
+        return root;
+    }
+
+    Expr* temp(Expr* e) {
+        for (const auto& h : hoisted) {
+            if (sameExpr(h.first, e)) return arena.make<VarRef>(h.second);
+        }
+        string name = "licm." + to_string(tempCount++);
+        SymId id = interner.intern(name);
+        hoisted.push_back(make_pair(e, id));
+        return arena.make<VarRef>(id);
+    }
+
+    void rewriteStmt(Stmt* s) {
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<AssignStmt*>(s);
+            assign->rhs = rewriteExpr(assign->rhs, false);
+            break;
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->cond = rewriteExpr(ifs->cond, false);
+            rewriteStmt(ifs->thenStmt);
+            if (ifs->elseStmt) rewriteStmt(ifs->elseStmt);
+            break;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->cond = rewriteExpr(whiles->cond, false);
+            rewriteStmt(whiles->body);
+            break;
+        }
+        case STMT_RETURN: {
+            auto ret = static_cast<ReturnStmt*>(s);
+            ret->expr = rewriteExpr(ret->expr, false);
+            break;
+        }
+        case STMT_EXPR: {
+            auto es = static_cast<ExprStmt*>(s);
+            es->expr = rewriteExpr(es->expr, false);
+            break;
+        }
+        case STMT_BLOCK:
+            for (Stmt* c : *static_cast<BlockStmt*>(s)) rewriteStmt(c);
+            break;
+        case STMT_DECL:
+            break;
+        }
+    }
+};
+
+// ---------- 循环展开 ----------
+// 识别基本归纳变量：条件为 i < n、i <= n（或 i > n、i >= n），n 在循环内不变；
+// 循环体块的顶层恰有一条 i = i ± c（c 为常数，方向与比较一致），循环内别处不改写也不声明 i。
+// 这时每执行一遍循环体 i 恰好前进 c，连续 k 遍都满足条件只需 i 与 n 相差 (k-1)*|c| 以上：
+//   部分展开（倍数 U）：
+//     { int lim; lim = n - (U-1)*c;
+//       if (lim < n) { while (i < lim) { 体 体 ... 体 } }   // 减法回绕时跳过主循环
+//       while (i < n) 体 }                                   // 余数循环
+//   完全展开：紧邻循环之前有 i = 常数 且 n 为常数时算出次数，次数不多就把循环换成相应遍数的循环体。
+//   结束时 i 的值超出 32 位（原循环依赖回绕）的不展开。
+// 每份循环体是独立的块，其中的声明互不冲突；展开后循环体过大则不展开。
+// 循环内有函数调用时全局变量都按被改写处理，既不能作归纳变量也不能作界限。
+class LoopUnroller {
+    static const int FULL_TRIPS = 16;    // 完全展开的最多次数
+    static const int BODY_BUDGET = 256;  // 展开后循环体的最多节点数
+    Arena& arena;
+    int factor;        // 部分展开倍数，小于2时不做部分展开
+    bool full;         // 是否完全展开
+    uint32_t tempCount;
+
+    struct Induction {
+        SymId var;
+        BinOp rel;     // 归纳变量在左侧时的比较
+        Expr* bound;
+        int32_t step;
+    };
+
+    vector<SymId> written;  // 循环内的赋值目标（可重复）
+    vector<SymId> declared; // 循环内声明的变量
+    vector<SymId> globals;
+    bool hasCall;
+
+public:
+    LoopUnroller(Arena& a, int unrollFactor, bool fullUnroll)
+        : arena(a), factor(unrollFactor), full(fullUnroll), tempCount(0), hasCall(false) {}
+
+    void run(Program* prog) {
+        for (const Decl& d : prog->decls) {
+            if (d.kind == DECL_GLOBAL) globals.push_back(d.name);
+        }
+        for (Function* func : prog->functions) unrollStmt(func->body, nullptr);
+    }
+
+private:
+    // prev 为同一块中紧邻的前一条语句，用来找归纳变量的初值
+    Stmt* unrollStmt(Stmt* s, const Stmt* prev) {
+        switch (s->kind) {
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->thenStmt = unrollStmt(ifs->thenStmt, nullptr);
+            if (ifs->elseStmt) ifs->elseStmt = unrollStmt(ifs->elseStmt, nullptr);
+            return s;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->body = unrollStmt(whiles->body, nullptr);
+            return unrollLoop(whiles, prev);
+        }
+        case STMT_BLOCK: {
+            auto block = static_cast<BlockStmt*>(s);
+            for (uint32_t i = 0; i < block->count; ++i) {
+                Stmt* before = i ? block->stmts[i - 1] : nullptr;
+                block->stmts[i] = unrollStmt(block->stmts[i], before);
+            }
+            return s;
+        }
+        default:
+            return s;
+        }
+    }
+
+    Stmt* unrollLoop(WhileStmt* loop, const Stmt* prev) {
+        Induction iv = {};
+        if (!analyze(loop, iv)) return loop;
+        int size = countStmt(loop->body);
+
+        int64_t trips;
+        if (full && tripCount(iv, prev, trips) && trips <= FULL_TRIPS && trips * size <= BODY_BUDGET) {
+            vector<Stmt*> copies;
+            for (int64_t k = 0; k < trips; ++k) copies.push_back(cloneStmt(loop->body));
+            return block(copies);
+        }
+        if (factor < 2 || (int64_t)factor * size > BODY_BUDGET) return loop;
+
+        // 主循环的界限 lim = n - (U-1)*c，c 为负时即 n + (U-1)*|c|
+        int64_t distance = (int64_t)(factor - 1) * (iv.step < 0 ? -(int64_t)iv.step : iv.step);
+        if (distance > INT32_MAX) return loop;
+        bool up = iv.step > 0;
+        vector<Stmt*> body;
+        for (int k = 0; k < factor; ++k) body.push_back(cloneStmt(loop->body));
+        Stmt* mainLoop;
+        int32_t n;
+        vector<Stmt*> stmts;
+        if (ConstantFolder::constValue(iv.bound, n)) {
+            // 常数界限直接算出 lim，回绕时不展开
+            int64_t lim = up ? (int64_t)n - distance : (int64_t)n + distance;
+            if (lim < INT32_MIN || lim > INT32_MAX) return loop;
+            mainLoop = arena.make<WhileStmt>(compare(iv, constant((int32_t)lim)), block(body));
+        }
+        else {
+            SymId temp = interner.intern("unroll." + to_string(tempCount++));
+            Expr* limit = arena.make<BinaryOp>(up ? BIN_SUB : BIN_ADD, cloneExpr(iv.bound), constant((int32_t)distance));
+            stmts.push_back(arena.make<DeclStmt>(temp));
+            stmts.push_back(arena.make<AssignStmt>(temp, limit));
+            Stmt* inner = arena.make<WhileStmt>(compare(iv, arena.make<VarRef>(temp)), block(body));
+            Expr* noWrap = arena.make<BinaryOp>(up ? BIN_LT : BIN_GT, arena.make<VarRef>(temp), cloneExpr(iv.bound));
+            mainLoop = arena.make<IfStmt>(noWrap, inner);
+        }
+        stmts.push_back(mainLoop);
+        stmts.push_back(loop); // 余数循环
+        return block(stmts);
+    }
+
+    // ---- 识别归纳变量 ----
+    bool analyze(WhileStmt* loop, Induction& iv) {
+        auto cond = as<BinaryOp>(loop->cond);
+        auto body = as<BlockStmt>(loop->body);
+        if (!cond || !body || cond->op < BIN_LT || cond->op > BIN_GE) return false;
+        auto var = as<VarRef>(cond->left);
+        if (!var) return false;
+        iv.var = var->name;
+        iv.rel = cond->op;
+        iv.bound = cond->right;
+
+        written.clear();
+        declared.clear();
+        hasCall = false;
+        collectExpr(cond);
+        collectStmt(body);
+        if (hasCall) written.insert(written.end(), globals.begin(), globals.end());
+        if (count(written.begin(), written.end(), iv.var) != 1) return false;
+        if (find(declared.begin(), declared.end(), iv.var) != declared.end()) return false;
+        if (!invariant(iv.bound)) return false;
+
+        // 循环体顶层的 i = i ± c
+        bool found = false;
+        for (const Stmt* s : *body) {
+            auto assign = as<const AssignStmt>(s);
+            if (assign && assign->var == iv.var) found = stepOf(assign->rhs, iv.var, iv.step);
+        }
+        if (!found || iv.step == 0) return false;
+        bool up = iv.rel == BIN_LT || iv.rel == BIN_LE;
+        return up ? iv.step > 0 : iv.step < 0;
+    }
+
+    static bool stepOf(const Expr* e, SymId var, int32_t& step) {
+        auto bin = as<const BinaryOp>(e);
+        if (!bin || (bin->op != BIN_ADD && bin->op != BIN_SUB)) return false;
+        auto l = as<const VarRef>(bin->left);
+        int32_t c;
+        if (l && l->name == var && ConstantFolder::constValue(bin->right, c)) {
+            if (bin->op == BIN_SUB) {
+                if (c == INT32_MIN) return false;
+                c = -c;
+            }
+            step = c;
+            return true;
+        }
+        auto r = as<const VarRef>(bin->right);
+        if (bin->op == BIN_ADD && r && r->name == var && ConstantFolder::constValue(bin->left, c)) {
+            step = c;
+            return true;
+        }
+        return false;
+    }
+
+    // 由紧邻的 i = 常数 与常数界限算出循环次数
+    static bool tripCount(const Induction& iv, const Stmt* prev, int64_t& trips) {
+        auto init = as<const AssignStmt>(prev);
+        int32_t start, n;
+        if (!init || init->var != iv.var || !ConstantFolder::constValue(init->rhs, start)) return false;
+        if (!ConstantFolder::constValue(iv.bound, n)) return false;
+        int64_t c = iv.step < 0 ? -(int64_t)iv.step : iv.step;
+        int64_t span; // 满足条件的取值范围的长度
+        switch (iv.rel) {
+        case BIN_LT: span = (int64_t)n - start; break;
+        case BIN_LE: span = (int64_t)n - start + 1; break;
+        case BIN_GT: span = (int64_t)start - n; break;
+        default:     span = (int64_t)start - n + 1; break;
+        }
+        trips = span <= 0 ? 0 : (span + c - 1) / c;
+        int64_t last = (int64_t)start + trips * iv.step;
+        return last >= INT32_MIN && last <= INT32_MAX;
+    }
+
+    void collectExpr(const Expr* e) {
+        walkExpr(e, [&](const Expr* n) {
+            if (n->kind == EXPR_CALL) hasCall = true;
+            else if (auto bin = as<const BinaryOp>(n)) {
+                if (bin->op != BIN_ASSIGN) return true;
+                if (auto target = as<const VarRef>(bin->left)) written.push_back(target->name);
+            }
+            return true;
+        });
+    }
+
+    void collectStmt(const Stmt* body) {
+        walkStmt(body, [&](const Stmt* s) {
+            if (s->kind == STMT_ASSIGN) written.push_back(static_cast<const AssignStmt*>(s)->var);
+            else if (s->kind == STMT_DECL) declared.push_back(static_cast<const DeclStmt*>(s)->var);
+            if (const Expr* e = stmtExpr(s)) collectExpr(e);
+            return true;
+        });
+    }
+
+    bool invariant(const Expr* e) const {
+        bool result = true;
+        walkExpr(e, [&](const Expr* n) {
+            switch (n->kind) {
+            case EXPR_INT: break;
+            case EXPR_VAR: {
+                SymId name = static_cast<const VarRef*>(n)->name;
+                result = find(written.begin(), written.end(), name) == written.end() &&
+                         find(declared.begin(), declared.end(), name) == declared.end();
+                break;
+            }
+            case EXPR_CALL: result = false; break;
+            default: result = static_cast<const BinaryOp*>(n)->op != BIN_ASSIGN; break;
+            }
+            return result;
+        });
+        return result;
+    }
+
+    // ---- 复制与构造 ----
+    Expr* constant(int32_t v) { return arena.make<IntConst>(v); }
+
+    Expr* compare(const Induction& iv, Expr* limit) {
+        return arena.make<BinaryOp>(iv.rel, arena.make<VarRef>(iv.var), limit);
+    }
+
+    Stmt* block(const vector<Stmt*>& stmts) {
+        return arena.make<BlockStmt>(arena.copyArray(stmts.data(), stmts.size()), (uint32_t)stmts.size());
+    }
+
+    Expr* cloneExpr(const Expr* root) {
+        return postOrderExpr<Expr*>(root, [&](const Expr* e, Expr** kids) -> Expr* {
+            switch (e->kind) {
+            case EXPR_INT: return constant(static_cast<const IntConst*>(e)->value);
+            case EXPR_VAR: return arena.make<VarRef>(static_cast<const VarRef*>(e)->name);
+            case EXPR_CALL: {
+                auto call = static_cast<const CallExpr*>(e);
+                return arena.make<CallExpr>(call->name, arena.copyArray(kids, call->argCount), call->argCount);
+            }
+            default:
+                return arena.make<BinaryOp>(static_cast<const BinaryOp*>(e)->op, kids[0], kids[1]);
+            }
+        });
+    }
+
+    Stmt* cloneStmt(const Stmt* s) {
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<const AssignStmt*>(s);
+            return arena.make<AssignStmt>(assign->var, cloneExpr(assign->rhs));
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            return arena.make<IfStmt>(cloneExpr(ifs->cond), cloneStmt(ifs->thenStmt),
+                                      ifs->elseStmt ? cloneStmt(ifs->elseStmt) : nullptr);
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<const WhileStmt*>(s);
+            return arena.make<WhileStmt>(cloneExpr(whiles->cond), cloneStmt(whiles->body));
+        }
+        case STMT_RETURN:
+            return arena.make<ReturnStmt>(cloneExpr(static_cast<const ReturnStmt*>(s)->expr));
+        case STMT_EXPR:
+            return arena.make<ExprStmt>(cloneExpr(static_cast<const ExprStmt*>(s)->expr));
+        case STMT_BLOCK: {
+            vector<Stmt*> stmts;
+            for (const Stmt* c : *static_cast<const BlockStmt*>(s)) stmts.push_back(cloneStmt(c));
+            return block(stmts);
+        }
+        default:
+            return arena.make<DeclStmt>(static_cast<const DeclStmt*>(s)->var);
+        }
+    }
+};
+
+// ---------- 中间表示 ----------
+// 每个函数从语法树构造 SSA 形式的中间表示：基本块由 if/while/return 切分，
+// 局部变量的每次赋值是一个新值，汇合处用 phi 合并（Braun 等人的按需构造法，
+// 不需要支配树）。全局变量不进入 SSA，以 load/store 访问；函数调用可能读写任何全局变量，
+// 它的值与 load 一样不可知，且不能删除。
+// 优化遍改写中间表示时不删除原指令：值的替换记录在 replaced 中，删除的指令只打 dead 标记，
+// 这样回写语法树时仍能按原始的 phi/copy 追溯到变量的每次赋值。
+enum IrOp : uint8_t {
+    IR_CONST,  // x 为常数
+    IR_UNDEF,  // 未初始化的局部变量，x 为变量编号
+    IR_PARAM,  // 形参进入函数时的值，x 为变量编号
+    IR_PHI,    // x 为变量编号，操作数在 phiArgs[a, a+b)，与所在块的 preds 一一对应
+    IR_COPY,   // 局部变量赋值，x 为变量编号，a 为右值
+    IR_BINARY, // bin 为运算符，a、b 为操作数
+    IR_LOAD,   // 读全局变量，x 为名字
+    IR_STORE,  // 写全局变量，x 为名字，a 为值
+    IR_CALL,   // 调用函数 x，实参在 callArgs[a, a+b)
+    IR_JUMP,   // 无条件跳转到 succ[0]
+    IR_BRANCH, // a 非0跳转到 succ[0]，否则到 succ[1]
+    IR_RETURN  // 返回 a（函数末尾没有 return 时为 IR_NONE）
+};
+
+const uint32_t IR_NONE = 0xFFFFFFFFu;
+
+const char* const IR_BINOP_NAMES[] = { "add", "sub", "mul", "div", "lt", "le", "gt", "ge", "eq", "ne" };
+
+struct IrInst {
+    IrOp op;
+    uint8_t bin;    // BINARY: BinOp
+    bool dead;      // 已被删除
+    uint32_t block;
+    uint32_t a, b;
+    uint32_t x;
+};
+
+struct IrBlock {
+    vector<uint32_t> preds;
+    vector<uint32_t> phis;
+    vector<uint32_t> insts; // 最后一条是终结指令
+    uint32_t succ[2];
+    bool sealed;    // 前驱已全部确定
+    bool reachable; // 常量传播证明不可达后清除
+};
+
+struct IrFunction {
+    SymId name;
+    vector<IrInst> insts;
+    vector<IrBlock> blocks; // blocks[0] 为入口
+    vector<uint32_t> phiArgs;
+    vector<uint32_t> callArgs;
+    vector<uint32_t> replaced;   // 值被替换成的值，IR_NONE 表示未替换
+    vector<SymId> localNames;    // 局部变量编号 -> 名字
+
+    void reset(SymId n) {
+        name = n;
+        insts.clear();
+        blocks.clear();
+        phiArgs.clear();
+        callArgs.clear();
+        replaced.clear();
+        localNames.clear();
+    }
+
+    uint32_t add(IrOp op, uint32_t block, uint32_t a = IR_NONE, uint32_t b = IR_NONE, uint32_t x = 0) {
+        insts.push_back(IrInst{ op, 0, false, block, a, b, x });
+        replaced.push_back(IR_NONE);
+        return (uint32_t)insts.size() - 1;
+    }
+
+    uint32_t resolve(uint32_t v) const {
+        while (replaced[v] != IR_NONE) v = replaced[v];
+        return v;
+    }
+
+    // 指令是否仍然有效：未删除、未被替换且所在块可达
+    bool live(uint32_t i) const {
+        return !insts[i].dead && replaced[i] == IR_NONE && blocks[insts[i].block].reachable;
+    }
+
+    bool isConst(uint32_t v, int32_t& c) const {
+        const IrInst& in = insts[resolve(v)];
+        if (in.op != IR_CONST) return false;
+        c = (int32_t)in.x;
+        return true;
+    }
+
+    // 对指令的每个操作数（未解析替换）调用 fn
+    template<class Fn>
+    void forEachOperand(uint32_t i, Fn fn) const {
+        const IrInst& in = insts[i];
+        switch (in.op) {
+        case IR_PHI:
+            for (uint32_t k = 0; k < in.b; ++k) fn(phiArgs[in.a + k]);
+            break;
+        case IR_CALL:
+            for (uint32_t k = 0; k < in.b; ++k) fn(callArgs[in.a + k]);
+            break;
+        case IR_COPY: case IR_STORE: case IR_BRANCH:
+            fn(in.a);
+            break;
+        case IR_RETURN:
+            if (in.a != IR_NONE) fn(in.a);
+            break;
+        case IR_BINARY:
+            fn(in.a);
+            fn(in.b);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 删除边 from -> to，同时删去 to 中各 phi 对应的操作数
+    void removeEdge(uint32_t from, uint32_t to) {
+        IrBlock& blk = blocks[to];
+        size_t k = find(blk.preds.begin(), blk.preds.end(), from) - blk.preds.begin();
+        if (k == blk.preds.size()) return;
+        blk.preds.erase(blk.preds.begin() + k);
+        for (uint32_t p : blk.phis) {
+            IrInst& phi = insts[p];
+            copy(phiArgs.begin() + phi.a + k + 1, phiArgs.begin() + phi.a + phi.b, phiArgs.begin() + phi.a + k);
+            phi.b--;
+        }
+    }
+
+    void dump(ostream& os) const {
+        os << "function " << interner.str(name) << "\n";
+        for (size_t bi = 0; bi < blocks.size(); ++bi) {
+            const IrBlock& blk = blocks[bi];
+            if (!blk.reachable) continue;
+            os << "b" << bi << ":";
+            if (!blk.preds.empty()) {
+                os << "    ; preds";
+                for (uint32_t p : blk.preds) os << " b" << p;
+            }
+            os << "\n";
+            for (uint32_t i : blk.phis) dumpInst(os, i);
+            for (uint32_t i : blk.insts) dumpInst(os, i);
+        }
+        os << "\n";
+    }
+
+private:
+    string value(uint32_t v) const { return v == IR_NONE ? "undef" : "%" + to_string(resolve(v)); }
+
+    void dumpInst(ostream& os, uint32_t i) const {
+        if (!live(i)) return;
+        const IrInst& in = insts[i];
+        os << "    ";
+        switch (in.op) {
+        case IR_CONST:  os << "%" << i << " = const " << (int32_t)in.x; break;
+        case IR_UNDEF:  os << "%" << i << " = undef " << interner.str(localNames[in.x]); break;
+        case IR_PARAM:  os << "%" << i << " = param " << interner.str(localNames[in.x]); break;
+        case IR_PHI:
+            os << "%" << i << " = phi " << interner.str(localNames[in.x]);
+            for (uint32_t k = 0; k < in.b; ++k) {
+                os << (k ? ", " : " ") << "[" << value(phiArgs[in.a + k]) << ", b" << blocks[in.block].preds[k] << "]";
+            }
+            break;
+        case IR_COPY:   os << "%" << i << " = copy " << interner.str(localNames[in.x]) << ", " << value(in.a); break;
+        case IR_BINARY: os << "%" << i << " = " << IR_BINOP_NAMES[in.bin] << " " << value(in.a) << ", " << value(in.b); break;
+        case IR_LOAD:   os << "%" << i << " = load " << interner.str(in.x); break;
+        case IR_STORE:  os << "store " << interner.str(in.x) << ", " << value(in.a); break;
+        case IR_CALL:
+            os << "%" << i << " = call " << interner.str(in.x) << "(";
+            for (uint32_t k = 0; k < in.b; ++k) os << (k ? ", " : "") << value(callArgs[in.a + k]);
+            os << ")";
+            break;
+        case IR_JUMP:   os << "jmp b" << blocks[in.block].succ[0]; break;
+        case IR_BRANCH:
+            os << "br " << value(in.a) << ", b" << blocks[in.block].succ[0] << ", b" << blocks[in.block].succ[1];
+            break;
+        case IR_RETURN: os << "ret " << value(in.a); break;
+        }
+        os << "\n";
+    }
+};
+
+// ---------- 优化遍 ----------
+// 每一遍是一个 bool(IrFunction&) 函数，返回是否有改动；PassManager 按顺序运行，
+// 有改动就再来一轮，直到稳定或达到轮数上限
+
+// 稀疏条件常量传播（Wegman-Zadeck）：值的格为 未知/常数/非常数，只沿可执行的边传播。
+// 结束后常数值替换为 const 指令，条件恒定的分支改为跳转，从未执行的块标为不可达
+class SccpPass {
+    enum Lattice : uint8_t { LAT_TOP, LAT_CONST, LAT_BOTTOM };
+    IrFunction& f;
+    vector<uint8_t> state;
+    vector<int32_t> value;
+    vector<uint8_t> blockExec;
+    vector<vector<uint8_t>> edgeExec; // 与各块 preds 一一对应
+    vector<vector<uint32_t>> users;
+    vector<uint32_t> blockWork, valueWork;
+public:
+    explicit SccpPass(IrFunction& fn) : f(fn) {}
+
+    bool run() {
+        size_t n = f.insts.size();
+        state.assign(n, LAT_TOP);
+        value.assign(n, 0);
+        users.assign(n, vector<uint32_t>());
+        blockExec.assign(f.blocks.size(), 0);
+        edgeExec.resize(f.blocks.size());
+        for (size_t b = 0; b < f.blocks.size(); ++b) edgeExec[b].assign(f.blocks[b].preds.size(), 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (f.live(i)) f.forEachOperand(i, [&](uint32_t v) { users[f.resolve(v)].push_back(i); });
+        }
+
+        blockExec[0] = 1;
+        blockWork.push_back(0);
+        while (!blockWork.empty() || !valueWork.empty()) {
+            while (!blockWork.empty()) {
+                uint32_t b = blockWork.back();
+                blockWork.pop_back();
+                for (uint32_t i : f.blocks[b].phis) visit(i);
+                for (uint32_t i : f.blocks[b].insts) visit(i);
+            }
+            while (!valueWork.empty()) {
+                uint32_t v = valueWork.back();
+                valueWork.pop_back();
+                for (uint32_t u : users[v]) {
+                    if (blockExec[f.insts[u].block]) visit(u);
+                }
+            }
+        }
+        return rewrite(n);
+    }
+
+private:
+    void set(uint32_t i, Lattice s, int32_t v = 0) {
+        if (state[i] == LAT_BOTTOM || (state[i] == s && (s != LAT_CONST || value[i] == v))) return;
+        if (state[i] == LAT_CONST && s == LAT_CONST) s = LAT_BOTTOM; // 两个不同常数
+        state[i] = (uint8_t)s;
+        value[i] = v;
+        valueWork.push_back(i);
+    }
+
+    void markEdge(uint32_t from, uint32_t to) {
+        const vector<uint32_t>& preds = f.blocks[to].preds;
+        for (size_t k = 0; k < preds.size(); ++k) {
+            if (preds[k] != from || edgeExec[to][k]) continue;
+            edgeExec[to][k] = 1;
+            if (!blockExec[to]) {
+                blockExec[to] = 1;
+                blockWork.push_back(to);
+            }
+            else {
+                for (uint32_t p : f.blocks[to].phis) visit(p);
+            }
+            return;
+        }
+    }
+
+    void visit(uint32_t i) {
+        if (!f.live(i)) return;
+        const IrInst& in = f.insts[i];
+        const IrBlock& blk = f.blocks[in.block];
+        switch (in.op) {
+        case IR_CONST: set(i, LAT_CONST, (int32_t)in.x); break;
+        case IR_UNDEF: case IR_PARAM: case IR_LOAD: case IR_CALL: set(i, LAT_BOTTOM); break;
+        case IR_COPY: {
+            uint32_t a = f.resolve(in.a);
+            if (state[a] != LAT_TOP) set(i, (Lattice)state[a], value[a]);
+            break;
+        }
+        case IR_BINARY: {
+            uint32_t a = f.resolve(in.a), b = f.resolve(in.b);
+            if (state[a] == LAT_BOTTOM || state[b] == LAT_BOTTOM) set(i, LAT_BOTTOM);
+            else if (state[a] == LAT_CONST && state[b] == LAT_CONST) {
+                int32_t v;
+                if (ConstantFolder::evaluate((BinOp)in.bin, value[a], value[b], v)) set(i, LAT_CONST, v);
+                else set(i, LAT_BOTTOM); // 除数为0等，留给运行时
+            }
+            break;
+        }
+        case IR_PHI:
+            for (uint32_t k = 0; k < in.b; ++k) {
+                if (!edgeExec[in.block][k]) continue;
+                uint32_t a = f.resolve(f.phiArgs[in.a + k]);
+                if (state[a] != LAT_TOP) set(i, (Lattice)state[a], value[a]);
+            }
+            break;
+        case IR_JUMP:
+            markEdge(in.block, blk.succ[0]);
+            break;
+        case IR_BRANCH: {
+            uint32_t a = f.resolve(in.a);
+            if (state[a] == LAT_TOP) break;
+            if (state[a] == LAT_BOTTOM || value[a] != 0) markEdge(in.block, blk.succ[0]);
+            if (state[a] == LAT_BOTTOM || value[a] == 0) markEdge(in.block, blk.succ[1]);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    bool rewrite(size_t n) {
+        bool changed = false;
+        for (uint32_t i = 0; i < n; ++i) {
+            IrInst& in = f.insts[i];
+            if (!f.live(i) || !blockExec[in.block] || state[i] != LAT_CONST) continue;
+            if (in.op != IR_PHI && in.op != IR_COPY && in.op != IR_BINARY) continue;
+            uint32_t c = f.add(IR_CONST, 0, IR_NONE, IR_NONE, (uint32_t)value[i]);
+            f.blocks[0].insts.insert(f.blocks[0].insts.begin(), c);
+            f.replaced[i] = c;
+            changed = true;
+        }
+        for (uint32_t b = 0; b < f.blocks.size(); ++b) {
+            IrBlock& blk = f.blocks[b];
+            if (!blk.reachable) continue;
+            if (!blockExec[b]) {
+                // 从未执行：删去出边和全部指令
+                blk.reachable = false;
+                for (uint32_t& s : blk.succ) {
+                    if (s != IR_NONE) f.removeEdge(b, s);
+                    s = IR_NONE;
+                }
+                changed = true;
+                continue;
+            }
+            IrInst& term = f.insts[blk.insts.back()];
+            int32_t c;
+            if (term.op == IR_BRANCH && f.isConst(term.a, c)) {
+                uint32_t taken = c ? blk.succ[0] : blk.succ[1];
+                f.removeEdge(b, c ? blk.succ[1] : blk.succ[0]);
+                term.op = IR_JUMP;
+                term.a = IR_NONE;
+                blk.succ[0] = taken;
+                blk.succ[1] = IR_NONE;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+};
+
+inline bool runSccp(IrFunction& f) {
+    SccpPass pass(f);
+    return pass.run();
+}
+
+// 复制传播：copy 的使用者直接使用其右值；操作数（除自身外）全相同的 phi 替换为该值
+inline bool runCopyPropagation(IrFunction& f) {
+    bool changed = false, again = true;
+    while (again) {
+        again = false;
+        for (uint32_t i = 0; i < f.insts.size(); ++i) {
+            if (!f.live(i)) continue;
+            const IrInst& in = f.insts[i];
+            uint32_t same = IR_NONE;
+            if (in.op == IR_COPY) {
+                same = f.resolve(in.a);
+            }
+            else if (in.op == IR_PHI) {
+                for (uint32_t k = 0; k < in.b; ++k) {
+                    uint32_t a = f.resolve(f.phiArgs[in.a + k]);
+                    if (a == i || a == same) continue;
+                    if (same != IR_NONE) { same = IR_NONE; break; }
+                    same = a;
+                }
+                if (same == IR_NONE) continue;
+            }
+            else {
+                continue;
+            }
+            if (same == i) continue;
+            f.replaced[i] = same;
+            again = changed = true;
+        }
+    }
+    return changed;
+}
+
+// 死代码删除：从有副作用的指令（store、调用、跳转、返回）出发标记用到的值，其余删除
+inline bool runDce(IrFunction& f) {
+    vector<uint8_t> used(f.insts.size(), 0);
+    vector<uint32_t> work;
+    for (uint32_t i = 0; i < f.insts.size(); ++i) {
+        IrOp op = f.insts[i].op;
+        if (f.live(i) && (op == IR_STORE || op == IR_CALL || op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN)) {
+            used[i] = 1;
+            work.push_back(i);
+        }
+    }
+    while (!work.empty()) {
+        uint32_t i = work.back();
+        work.pop_back();
+        f.forEachOperand(i, [&](uint32_t v) {
+            v = f.resolve(v);
+            if (!used[v]) {
+                used[v] = 1;
+                work.push_back(v);
+            }
+        });
+    }
+    bool changed = false;
+    for (uint32_t i = 0; i < f.insts.size(); ++i) {
+        if (!used[i] && !f.insts[i].dead) {
+            f.insts[i].dead = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+class PassManager {
+public:
+    typedef bool (*PassFn)(IrFunction& f);
+
+    void add(const char* name, PassFn fn) { passes.push_back(Pass{ name, fn }); }
+
+    bool empty() const { return passes.empty(); }
+
+    // 按顺序运行各遍，一轮中有改动就再运行一轮，最多 maxRounds 轮
+    void run(IrFunction& f, int maxRounds) const {
+        for (int round = 0; round < maxRounds; ++round) {
+            bool changed = false;
+            for (const Pass& p : passes) {
+                if (p.fn(f)) changed = true;
+            }
+            if (!changed) break;
+        }
+    }
+
+    void describe(ostream& os) const {
+        os << "; passes:";
+        for (const Pass& p : passes) os << " " << p.name;
+        os << "\n";
+    }
+
+private:
+    struct Pass {
+        const char* name;
+        PassFn fn;
+    };
+    vector<Pass> passes;
+};
+
+// ---------- SSA 优化 ----------
+// 为每个函数构造中间表示并运行优化遍，再把结论回写到语法树，代码生成仍从语法树进行：
+//   值为常数的表达式（不含赋值）替换为常数；
+//   x = y 之后对 x 的读取，若此处 y 仍是同一个值，改为读 y；
+//   局部变量的赋值若没有任何保留下来的读取会用到它、且右值不含赋值，删除该赋值；
+//   不可达的语句删除。
+// 回写后常数条件的分支由随后的常量折叠删除
+class SsaOptimizer {
+    Arena& arena;
+    const PassManager& passes;
+    int rounds;
+    ostream* dumpOut; // 非空时输出优化后的中间表示
+    vector<uint8_t> isGlobal;
+
+    IrFunction ir;
+    uint32_t cur; // 当前基本块
+    bool failed;  // 遇到无法处理的结构（如重复声明），放弃优化这个函数，错误留给代码生成报告
+    unordered_map<uint64_t, uint32_t> currentDef; // (变量 << 32 | 块) -> 值
+    vector<vector<pair<uint32_t, uint32_t>>> incompletePhis; // 各块在封闭前创建的 (变量, phi)
+    vector<uint32_t> copySource; // 各局部变量最近一次 x = y 形式赋值的来源 y，没有为 IR_NONE
+
+    enum SiteAction : uint8_t { SITE_KEEP, SITE_CONST, SITE_RENAME, SITE_DROP };
+
+    // 中间表示由函数的扁平形式构造，记录与扁平数组一一对应、按同样的下标存放。
+    // 表达式是后序的，构造和改写按下标顺序一趟循环即可（先子后父），决定按逆序（先父后子）
+    struct ExprSite {
+        uint32_t value;    // 节点的值（原始值，未解析替换）
+        uint32_t copy;     // 对局部变量的赋值表达式：对应的 copy
+        uint32_t srcVar;   // 读局部变量 x 且 x 曾被赋值为 y：y 的编号
+        uint32_t srcValue; // 此处 y 的值，与 x 的值相同时可改读 y
+        bool pure;         // 子树不含赋值
+        bool target;       // 赋值的左侧，不是读取
+        SiteAction action; // SITE_DROP：位于整体换成常数的子树中
+    };
+
+    struct StmtSite {
+        uint32_t block;   // 语句开始所在的块
+        uint32_t copy;    // 对局部变量的赋值语句：对应的 copy
+    };
+
+    FlatFunction flat;
+    vector<ExprSite> exprSites;
+    vector<StmtSite> stmtSites;
+    vector<Expr*> applied;     // 改写时各表达式的结果
+    uint32_t exprPos, stmtPos; // 构造时下一个未处理的表达式；回写时下一条语句
+
+    // 回写：各赋值（以其 copy 标识）是否被保留下来的读取用到，以及其右值中的读取
+    vector<uint8_t> needed;
+    vector<pair<uint32_t, uint32_t>> ownedReads; // (所属赋值, 读到的值)，按所属赋值排序后查找
+    vector<uint32_t> rootReads;
+    uint32_t rewrites;
+
+public:
+    SsaOptimizer(Arena& a, const PassManager& pm, int maxRounds, ostream* dump)
+        : arena(a), passes(pm), rounds(maxRounds), dumpOut(dump), cur(0), failed(false),
+          exprPos(0), stmtPos(0), rewrites(0) {}
+
+    // 返回是否改动了语法树
+    bool run(Program* prog) {
+        for (const Decl& d : prog->decls) {
+            if (d.kind != DECL_GLOBAL) continue;
+            if (d.name >= isGlobal.size()) isGlobal.resize(d.name + 1, 0);
+            isGlobal[d.name] = 1;
+        }
+        if (dumpOut) passes.describe(*dumpOut);
+        rewrites = 0;
+        for (Function* func : prog->functions) optimize(func);
+        return rewrites > 0;
+    }
+
+private:
+    void optimize(Function* func) {
+        if (!build(func)) return;
+        passes.run(ir, rounds);
+        if (dumpOut) ir.dump(*dumpOut);
+        if (passes.empty()) return;
+
+        needed.assign(ir.insts.size(), 0);
+        ownedReads.clear();
+        rootReads.clear();
+        Scope scope;
+        for (uint32_t k = 0; k < func->paramCount; ++k) scope.declare(func->params[k]);
+        stmtPos = 0;
+        collectStmt(func->body, scope);
+        sort(ownedReads.begin(), ownedReads.end());
+        markNeeded();
+        applied.assign(flat.exprs.size(), nullptr);
+        stmtPos = 0;
+        applyStmt(func->body);
+    }
+
+    // ---- 构造 ----
+    bool build(Function* func) {
+        ir.reset(func->name);
+        currentDef.clear();
+        incompletePhis.clear();
+        flat.build(func);
+        exprSites.assign(flat.exprs.size(), ExprSite{ IR_NONE, IR_NONE, IR_NONE, IR_NONE, true, false, SITE_KEEP });
+        stmtSites.assign(flat.stmts.size(), StmtSite{ 0, IR_NONE });
+        exprPos = 0;
+        copySource.clear();
+        failed = false;
+        cur = newBlock();
+        seal(cur);
+        Scope scope;
+        for (uint32_t k = 0; k < func->paramCount; ++k) {
+            uint32_t id = declareLocal(func->params[k], scope);
+            writeVar(id, cur, emit(IR_PARAM, IR_NONE, IR_NONE, id));
+        }
+        buildStmt(0, scope);
+        if (!terminated(cur)) terminate(IR_RETURN, IR_NONE);
+        return !failed;
+    }
+
+    uint32_t newBlock() {
+        ir.blocks.push_back(IrBlock{ {}, {}, {}, { IR_NONE, IR_NONE }, false, true });
+        incompletePhis.emplace_back();
+        return (uint32_t)ir.blocks.size() - 1;
+    }
+
+    bool terminated(uint32_t b) const {
+        const vector<uint32_t>& insts = ir.blocks[b].insts;
+        if (insts.empty()) return false;
+        IrOp op = ir.insts[insts.back()].op;
+        return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+    }
+
+    uint32_t emit(IrOp op, uint32_t a = IR_NONE, uint32_t b = IR_NONE, uint32_t x = 0) {
+        uint32_t i = ir.add(op, cur, a, b, x);
+        ir.blocks[cur].insts.push_back(i);
+        return i;
+    }
+
+    // 结束当前块，跳转目标为 to（分支时另有 other）
+    void terminate(IrOp op, uint32_t a, uint32_t to = IR_NONE, uint32_t other = IR_NONE) {
+        emit(op, a);
+        ir.blocks[cur].succ[0] = to;
+        ir.blocks[cur].succ[1] = other;
+        if (to != IR_NONE) ir.blocks[to].preds.push_back(cur);
+        if (other != IR_NONE) ir.blocks[other].preds.push_back(cur);
+    }
+
+    void jump(uint32_t to) { terminate(IR_JUMP, IR_NONE, to); }
+
+    static uint64_t defKey(uint32_t var, uint32_t block) { return (uint64_t)var << 32 | block; }
+
+    void writeVar(uint32_t var, uint32_t block, uint32_t v) { currentDef[defKey(var, block)] = v; }
+
+    uint32_t readVar(uint32_t var, uint32_t block) {
+        auto it = currentDef.find(defKey(var, block));
+        return it != currentDef.end() ? it->second : readVarRecursive(var, block);
+    }
+
+    uint32_t readVarRecursive(uint32_t var, uint32_t block) {
+        uint32_t v;
+        const IrBlock& blk = ir.blocks[block];
+        if (!blk.sealed) {
+            v = newPhi(var, block);
+            incompletePhis[block].push_back(make_pair(var, v));
+        }
+        else if (blk.preds.size() == 1) {
+            v = readVar(var, blk.preds[0]);
+        }
+        else if (blk.preds.empty()) {
+            // 入口或不可达的块：变量未初始化
+            v = ir.add(IR_UNDEF, block, IR_NONE, IR_NONE, var);
+            ir.blocks[block].insts.insert(ir.blocks[block].insts.begin(), v);
+        }
+        else {
+            v = newPhi(var, block);
+            writeVar(var, block, v); // 先登记，打断循环
+            addPhiOperands(var, v);
+        }
+        writeVar(var, block, v);
+        return v;
+    }
+
+    uint32_t newPhi(uint32_t var, uint32_t block) {
+        uint32_t p = ir.add(IR_PHI, block, 0, 0, var);
+        ir.blocks[block].phis.push_back(p);
+        return p;
+    }
+
+    // 操作数先收集再整体追加，递归读取变量时可能有别的 phi 插进来
+    void addPhiOperands(uint32_t var, uint32_t phi) {
+        vector<uint32_t> args;
+        for (uint32_t pred : ir.blocks[ir.insts[phi].block].preds) args.push_back(readVar(var, pred));
+        ir.insts[phi].a = (uint32_t)ir.phiArgs.size();
+        ir.insts[phi].b = (uint32_t)args.size();
+        ir.phiArgs.insert(ir.phiArgs.end(), args.begin(), args.end());
+    }
+
+    // 块的前驱已全部确定：补齐封闭前创建的 phi
+    void seal(uint32_t block) {
+        ir.blocks[block].sealed = true;
+        vector<pair<uint32_t, uint32_t>> pending;
+        pending.swap(incompletePhis[block]);
+        for (const auto& p : pending) addPhiOperands(p.first, p.second);
+    }
+
+    uint32_t declareLocal(SymId name, Scope& scope) {
+        if (!scope.declare(name)) {
+            failed = true;
+            return 0;
+        }
+        uint32_t id = scope.lookup(name)->id;
+        if (id >= ir.localNames.size()) {
+            ir.localNames.resize(id + 1);
+            copySource.resize(id + 1, IR_NONE);
+        }
+        ir.localNames[id] = name;
+        return id;
+    }
+
+    bool globalName(SymId name) const { return name < isGlobal.size() && isGlobal[name]; }
+
+    // 赋值给变量 name，返回局部变量的 copy（全局变量返回 IR_NONE）
+    uint32_t buildAssign(SymId name, uint32_t rhs, uint32_t v, Scope& scope) {
+        Symbol* sym = scope.lookup(name);
+        if (!sym) {
+            emit(IR_STORE, v, IR_NONE, name);
+            return IR_NONE;
+        }
+        const FlatExpr& var = flat.exprs[rhs];
+        Symbol* src = var.kind == EXPR_VAR ? scope.lookup(var.a) : nullptr;
+        copySource[sym->id] = src ? src->id : IR_NONE;
+        uint32_t c = emit(IR_COPY, v, IR_NONE, sym->id);
+        writeVar(sym->id, cur, c);
+        return c;
+    }
+
+    // 表达式的子树是从 exprPos 到根 root 的一段下标，按下标顺序处理即先算操作数、再算运算，
+    // 与求值顺序一致，不随表达式深度递归
+    uint32_t buildExpr(uint32_t root, Scope& scope) {
+        uint32_t begin = exprPos;
+        exprPos = root + 1;
+        for (uint32_t k = begin; k <= root; ++k) {
+            const FlatExpr& e = flat.exprs[k];
+            if (e.kind == EXPR_BINARY && e.op == BIN_ASSIGN) exprSites[e.a].target = true;
+        }
+        for (uint32_t k = begin; k <= root; ++k) {
+            const FlatExpr& e = flat.exprs[k];
+            ExprSite& site = exprSites[k];
+            switch (e.kind) {
+            case EXPR_INT:
+                site.value = emit(IR_CONST, IR_NONE, IR_NONE, e.a);
+                break;
+            case EXPR_VAR: {
+                if (site.target) break;
+                Symbol* sym = scope.lookup(e.a);
+                if (!sym) {
+                    site.value = emit(IR_LOAD, IR_NONE, IR_NONE, e.a);
+                    break;
+                }
+                site.value = readVar(sym->id, cur);
+                uint32_t src = copySource[sym->id];
+                if (src != IR_NONE) {
+                    // 被遮蔽时名字指向的已不是 y，不能改写。要在构造时判断：回写各趟跳过不可达的语句，
+                    // 其中的声明不再登记，之后的变量编号会与构造时错开
+                    Symbol* srcSym = scope.lookup(ir.localNames[src]);
+                    if (srcSym && srcSym->id == src) {
+                        site.srcVar = src;
+                        site.srcValue = readVar(src, cur);
+                    }
+                }
+                break;
+            }
+            case EXPR_BINARY:
+                if (e.op == BIN_ASSIGN) {
+                    if (flat.exprs[e.a].kind != EXPR_VAR) { failed = true; return 0; }
+                    site.value = exprSites[e.b].value;
+                    site.copy = buildAssign(flat.exprs[e.a].a, e.b, site.value, scope);
+                    site.pure = false;
+                    break;
+                }
+                site.value = emit(IR_BINARY, exprSites[e.a].value, exprSites[e.b].value);
+                site.pure = exprSites[e.a].pure && exprSites[e.b].pure;
+                ir.insts[site.value].bin = e.op;
+                break;
+            case EXPR_CALL: {
+                uint32_t argc = flat.argCount(k);
+                site.value = emit(IR_CALL, (uint32_t)ir.callArgs.size(), argc, e.a);
+                for (uint32_t j = 0; j < argc; ++j) ir.callArgs.push_back(exprSites[flat.arg(k, j)].value);
+                site.pure = false;
+                break;
+            }
+            }
+        }
+        return exprSites[root].value;
+    }
+
+    void buildStmt(uint32_t i, Scope& scope) {
+        const FlatStmt& st = flat.stmts[i];
+        stmtSites[i].block = cur;
+        switch (st.kind) {
+        case STMT_ASSIGN: {
+            uint32_t v = buildExpr(st.b, scope);
+            stmtSites[i].copy = buildAssign(st.a, st.b, v, scope);
+            break;
+        }
+        case STMT_IF: {
+            uint32_t c = buildExpr(st.a, scope);
+            bool hasElse = st.b != FLAT_NONE;
+            uint32_t thenBlock = newBlock();
+            uint32_t elseBlock = hasElse ? newBlock() : IR_NONE;
+            uint32_t join = newBlock();
+            terminate(IR_BRANCH, c, thenBlock, hasElse ? elseBlock : join);
+            seal(thenBlock);
+            cur = thenBlock;
+            buildStmt(i + 1, scope);
+            jump(join);
+            if (hasElse) {
+                seal(elseBlock);
+                cur = elseBlock;
+                buildStmt(st.b, scope);
+                jump(join);
+            }
+            seal(join);
+            cur = join;
+            break;
+        }
+        case STMT_WHILE: {
+            uint32_t header = newBlock();
+            jump(header);
+            cur = header;
+            uint32_t c = buildExpr(st.a, scope);
+            uint32_t body = newBlock();
+            uint32_t exit = newBlock();
+            terminate(IR_BRANCH, c, body, exit);
+            seal(body);
+            cur = body;
+            buildStmt(i + 1, scope);
+            jump(header);
+            seal(header);
+            seal(exit);
+            cur = exit;
+            break;
+        }
+        case STMT_RETURN: {
+            uint32_t v = buildExpr(st.a, scope);
+            terminate(IR_RETURN, v);
+            cur = newBlock(); // 之后的语句不可达
+            seal(cur);
+            break;
+        }
+        case STMT_BLOCK:
+            scope.push();
+            for (uint32_t c = i + 1; c < st.end; c = flat.stmts[c].end) buildStmt(c, scope);
+            scope.pop();
+            break;
+        case STMT_DECL: {
+            uint32_t id = declareLocal(st.a, scope);
+            writeVar(id, cur, emit(IR_UNDEF, IR_NONE, IR_NONE, id));
+            break;
+        }
+        case STMT_EXPR:
+            buildExpr(st.a, scope);
+            break;
+        }
+    }
+
+    // ---- 回写 ----
+    // 第一趟只做决定：哪些表达式换成常数或改读别的变量，并记下保留下来的读取各读到哪个值。
+    // 读取若位于可删除的赋值语句右侧，只有该赋值被需要时才算数
+    // 语法树与扁平形式的语句同为前序，按游标对应。返回语句 s 的下标；
+    // 不可达（且不泄漏声明）的语句返回 FLAT_NONE 并跳过其子树
+    uint32_t enterStmt(const Stmt* s) {
+        uint32_t i = stmtPos;
+        if (ir.blocks[stmtSites[i].block].reachable || s->kind == STMT_DECL || ConstantFolder::leaksDecl(s)) {
+            stmtPos++;
+            return i;
+        }
+        stmtPos = flat.stmts[i].end;
+        return FLAT_NONE;
+    }
+
+    void addRead(uint32_t value, uint32_t owner) {
+        if (owner == IR_NONE) rootReads.push_back(value);
+        else ownedReads.push_back(make_pair(owner, value));
+    }
+
+    // 按下标逆序即先父后子：换成常数的节点，其子树是紧挨在它前面的一段，整段标记后跳过
+    void collectExpr(uint32_t root, Scope& scope, uint32_t owner) {
+        uint32_t begin = flat.firstOf(root);
+        for (uint32_t k = root + 1; k-- > begin;) {
+            ExprSite& site = exprSites[k];
+            const FlatExpr& e = flat.exprs[k];
+            int32_t c;
+            if (site.target) continue;
+            if (e.kind != EXPR_INT && site.pure && ir.isConst(site.value, c)) {
+                site.action = SITE_CONST;
+                uint32_t first = flat.firstOf(k);
+                for (uint32_t j = first; j < k; ++j) exprSites[j].action = SITE_DROP;
+                k = first;
+                continue;
+            }
+            if (e.kind != EXPR_VAR) continue;
+            if (site.srcVar != IR_NONE && ir.resolve(site.value) == ir.resolve(site.srcValue)) {
+                site.action = SITE_RENAME;
+                addRead(site.srcValue, owner);
+            }
+            else if (scope.lookup(e.a)) addRead(site.value, owner);
+        }
+    }
+
+    void collectStmt(const Stmt* s, Scope& scope) {
+        uint32_t i = enterStmt(s);
+        if (i == FLAT_NONE) return;
+        const FlatStmt& st = flat.stmts[i];
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            uint32_t copy = stmtSites[i].copy;
+            bool removable = copy != IR_NONE && exprSites[st.b].pure;
+            collectExpr(st.b, scope, removable ? copy : IR_NONE);
+            break;
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<const IfStmt*>(s);
+            collectExpr(st.a, scope, IR_NONE);
+            collectStmt(ifs->thenStmt, scope);
+            if (ifs->elseStmt) collectStmt(ifs->elseStmt, scope);
+            break;
+        }
+        case STMT_WHILE:
+            collectExpr(st.a, scope, IR_NONE);
+            collectStmt(static_cast<const WhileStmt*>(s)->body, scope);
+            break;
+        case STMT_RETURN:
+        case STMT_EXPR:
+            collectExpr(st.a, scope, IR_NONE);
+            break;
+        case STMT_BLOCK:
+            scope.push();
+            for (const Stmt* c : *static_cast<const BlockStmt*>(s)) collectStmt(c, scope);
+            scope.pop();
+            break;
+        case STMT_DECL:
+            scope.declare(st.a);
+            break;
+        }
+    }
+
+    // 从保留下来的读取出发，沿原始的 phi 找到它们可能读到的每次赋值
+    void markNeeded() {
+        vector<uint32_t> work(rootReads);
+        vector<uint8_t> visited(ir.insts.size(), 0);
+        while (!work.empty()) {
+            uint32_t v = work.back();
+            work.pop_back();
+            if (visited[v]) continue;
+            visited[v] = 1;
+            const IrInst& in = ir.insts[v];
+            if (in.op == IR_COPY) {
+                needed[v] = 1;
+                auto it = lower_bound(ownedReads.begin(), ownedReads.end(), make_pair(v, (uint32_t)0));
+                for (; it != ownedReads.end() && it->first == v; ++it) work.push_back(it->second);
+            }
+            else if (in.op == IR_PHI) {
+                for (uint32_t k = 0; k < in.b; ++k) work.push_back(ir.phiArgs[in.a + k]);
+            }
+        }
+    }
+
+    // 第二趟按决定改写，按下标顺序先子后父，父节点取用子节点改写后的结果；返回空指针表示语句删除
+    Expr* applyExpr(uint32_t root) {
+        for (uint32_t k = flat.firstOf(root); k <= root; ++k) {
+            const ExprSite& site = exprSites[k];
+            const FlatExpr& fe = flat.exprs[k];
+            Expr* e = flat.nodes[k];
+            switch (site.action) {
+            case SITE_DROP:
+                continue;
+            case SITE_CONST: {
+                int32_t c = 0;
+                ir.isConst(site.value, c);
+                rewrites++;
+                applied[k] = arena.make<IntConst>(c);
+                continue;
+            }
+            case SITE_RENAME:
+                static_cast<VarRef*>(e)->name = ir.localNames[site.srcVar];
+                rewrites++;
+                break;
+            default:
+                break;
+            }
+            if (fe.kind == EXPR_CALL) {
+                auto call = static_cast<CallExpr*>(e);
+                for (uint32_t j = 0; j < call->argCount; ++j) call->args[j] = applied[flat.arg(k, j)];
+            }
+            else if (fe.kind == EXPR_BINARY) {
+                auto bin = static_cast<BinaryOp*>(e);
+                bin->right = applied[fe.b];
+                if (bin->op != BIN_ASSIGN) bin->left = applied[fe.a];
+                else if (site.copy != IR_NONE && !needed[site.copy] && ConstantFolder::isPure(bin->right)) {
+                    rewrites++;
+                    e = bin->right; // 赋值无人读取，只保留右值
+                }
+            }
+            applied[k] = e;
+        }
+        return applied[root];
+    }
+
+    Stmt* applyChild(Stmt* s) {
+        Stmt* r = applyStmt(s);
+        return r ? r : arena.make<BlockStmt>(nullptr, 0);
+    }
+
+    Stmt* applyStmt(Stmt* s) {
+        uint32_t i = enterStmt(s);
+        if (i == FLAT_NONE) {
+            rewrites++;
+            return nullptr;
+        }
+        const FlatStmt& st = flat.stmts[i];
+        switch (s->kind) {
+        case STMT_ASSIGN: {
+            auto assign = static_cast<AssignStmt*>(s);
+            uint32_t copy = stmtSites[i].copy;
+            if (copy != IR_NONE && !needed[copy] && exprSites[st.b].pure) {
+                rewrites++;
+                stmtPos = st.end;
+                return nullptr;
+            }
+            assign->rhs = applyExpr(st.b);
+            return s;
+        }
+        case STMT_IF: {
+            auto ifs = static_cast<IfStmt*>(s);
+            ifs->cond = applyExpr(st.a);
+            ifs->thenStmt = applyChild(ifs->thenStmt);
+            if (ifs->elseStmt) ifs->elseStmt = applyStmt(ifs->elseStmt);
+            return s;
+        }
+        case STMT_WHILE: {
+            auto whiles = static_cast<WhileStmt*>(s);
+            whiles->cond = applyExpr(st.a);
+            whiles->body = applyChild(whiles->body);
+            return s;
+        }
+        case STMT_RETURN: {
+            auto ret = static_cast<ReturnStmt*>(s);
+            ret->expr = applyExpr(st.a);
+            return s;
+        }
+        case STMT_EXPR: {
+            auto es = static_cast<ExprStmt*>(s);
+            es->expr = applyExpr(st.a);
+            return s;
+        }
+        case STMT_BLOCK: {
+            auto block = static_cast<BlockStmt*>(s);
+            uint32_t n = 0;
+            for (uint32_t k = 0; k < block->count; ++k) {
+                if (Stmt* c = applyStmt(block->stmts[k])) block->stmts[n++] = c;
+            }
+            block->count = n;
+            return s;
+        }
+        case STMT_DECL:
+            return s;
+        }
+        return s;
+    }
+};
+
+// ---------- 寄存器分配 ----------
+// 局部变量的线性扫描寄存器分配，在扁平语法树上按生成顺序进行。
+// 语句 i 中的读取记为位置 2i，语句级赋值的写入记为 2i+1，使“读完即死”的变量
+// 可以把寄存器让给同一语句写入的变量。变量的活跃区间取首末两次引用；
+// 在循环内被引用的变量，区间扩展到覆盖最外层循环，保证跨回边的值不被覆盖。
+// 寄存器不够时溢出权重最小的区间：权重为引用次数，循环每深一层乘 8。
+// 形参排在局部变量之前，区间从函数入口开始，优先分到传入它的寄存器；
+// 区间内有函数调用的变量只能放在被调用者保存的 esi/edi/ebx 中。
+class RegisterAllocator {
+    struct Interval {
+        uint32_t start;
+        uint32_t end;
+        uint64_t weight; // 0 表示从未被引用
+        Reg reg;
+        Reg hint;        // 优先选用的寄存器
+    };
+    const FlatFunction* flat;
+    bool shiftDivide;      // 除以 2 的幂生成移位而不是 idiv
+    vector<Interval> vars; // 按声明顺序编号，与 Symbol::id 一致
+    vector<uint32_t> calls; // 函数调用所在的位置，递增
+    uint32_t loopDepth;
+    uint32_t loopStart, loopEnd; // 最外层循环的位置范围
+
+public:
+    // 为函数的每个局部变量选定位置，结果按声明顺序写入 regs 和 slots，返回栈帧中局部变量区的字节数；
+    // 前 regParams 个形参由 ecx、edx 传入
+    int run(const FlatFunction& f, bool shiftDiv, int regParams, vector<Reg>& regs, vector<int>& slots) {
+        flat = &f;
+        shiftDivide = shiftDiv;
+        vars.clear();
+        calls.clear();
+        loopDepth = 0;
+        Scope scope;
+        for (size_t k = 0; k < f.params.size(); ++k) {
+            scope.declare(f.params[k]);
+            vars.push_back({ 0, 0, 0, REG_NONE, (int)k < regParams ? ARG_REGS[k] : REG_NONE });
+        }
+        scanStmt(0, scope);
+        for (size_t k = 0; k < f.params.size(); ++k) vars[k].start = 0;
+        allocate();
+        regs.resize(vars.size());
+        for (size_t i = 0; i < vars.size(); ++i) regs[i] = vars[i].reg;
+        return assignSlots(f.params.size(), regParams, slots);
+    }
+
+private:
+    void touch(SymId name, Scope& scope, uint32_t pos) {
+        Symbol* sym = scope.lookup(name);
+        if (!sym) return; // 全局变量或未定义（后者由代码生成报错）
+        Interval& v = vars[sym->id];
+        if (v.weight == 0) v.start = v.end = pos;
+        v.start = min(v.start, pos);
+        v.end = max(v.end, pos);
+        if (loopDepth > 0) {
+            v.start = min(v.start, loopStart);
+            v.end = max(v.end, loopEnd);
+        }
+        v.weight += (uint64_t)1 << (3 * min(loopDepth, 16u));
+    }
+
+    // 扁平表达式按后序排列，子树 i 占 [firstOf(i), i]，顺序扫一遍即可
+    void scanExpr(uint32_t i, Scope& scope, uint32_t pos) {
+        for (uint32_t k = flat->firstOf(i); k <= i; ++k) {
+            const FlatExpr& e = flat->exprs[k];
+            if (e.kind == EXPR_VAR) touch(e.a, scope, pos);
+            else if (e.kind == EXPR_CALL && (calls.empty() || calls.back() != pos)) calls.push_back(pos);
+        }
+    }
+
+    bool spansCall(const Interval& v) const {
+        auto it = lower_bound(calls.begin(), calls.end(), v.start);
+        return it != calls.end() && *it <= v.end;
+    }
+
+    void scanStmt(uint32_t i, Scope& scope) {
+        const FlatStmt& st = flat->stmts[i];
+        uint32_t use = 2 * i;
+        switch (st.kind) {
+        case STMT_ASSIGN:
+            scanExpr(st.b, scope, use);
+            touch(st.a, scope, use + 1);
+            break;
+        case STMT_IF:
+            scanExpr(st.a, scope, use);
+            scanStmt(i + 1, scope);
+            if (st.b != FLAT_NONE) scanStmt(st.b, scope);
+            break;
+        case STMT_WHILE:
+            if (loopDepth++ == 0) {
+                loopStart = use;
+                loopEnd = 2 * st.end - 1;
+            }
+            scanExpr(st.a, scope, use);
+            scanStmt(i + 1, scope);
+            loopDepth--;
+            break;
+        case STMT_RETURN:
+            if (flat->exprs[st.a].kind == EXPR_CALL) {
+                // return f(...) 之后不再读任何变量（尾调用则根本不返回），这次调用不算跨越
+                for (uint32_t k = 0; k < flat->argCount(st.a); ++k) scanExpr(flat->arg(st.a, k), scope, use);
+            }
+            else scanExpr(st.a, scope, use);
+            break;
+        case STMT_BLOCK:
+            scope.push();
+            for (uint32_t c = i + 1; c < st.end; c = flat->stmts[c].end) scanStmt(c, scope);
+            scope.pop();
+            break;
+        case STMT_DECL:
+            if (scope.declare(st.a)) vars.push_back({ 0, 0, 0, REG_NONE, REG_NONE });
+            break;
+        case STMT_EXPR:
+            scanExpr(st.a, scope, use);
+            break;
+        }
+    }
+
+    void allocate() {
+        // cdq/idiv 和乘魔数都会改写 edx，含除法的函数不把 edx 分给变量（除以 2 的幂只用移位，除外）
+        bool edxFree = true;
+        for (const FlatExpr& e : flat->exprs) {
+            if (e.kind != EXPR_BINARY || e.op != BIN_DIV) continue;
+            uint32_t d = flat->exprs[e.b].a;
+            if ((int32_t)d < 0) d = 0u - d;
+            bool power = flat->exprs[e.b].kind == EXPR_INT && d != 0 && (d & (d - 1)) == 0;
+            if (!shiftDivide || !power) edxFree = false;
+        }
+
+        vector<uint32_t> order;
+        for (uint32_t i = 0; i < vars.size(); ++i) {
+            if (vars[i].weight) order.push_back(i);
+        }
+        sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return vars[a].start < vars[b].start;
+        });
+
+        vector<uint32_t> active; // 当前占有寄存器的区间
+        bool busy[REG_COUNT] = {};
+        if (!edxFree) busy[REG_EDX] = true;
+        for (uint32_t id : order) {
+            Interval& cur = vars[id];
+            // 释放已经结束的区间
+            size_t n = 0;
+            for (uint32_t a : active) {
+                if (vars[a].end < cur.start) busy[vars[a].reg] = false;
+                else active[n++] = a;
+            }
+            active.resize(n);
+
+            int limit = spansCall(cur) ? REG_EBX + 1 : REG_COUNT; // 可用的寄存器是 [0, limit)
+            int r = cur.hint != REG_NONE && cur.hint < limit && !busy[cur.hint] ? cur.hint : 0;
+            while (r < limit && busy[r]) r++;
+            if (r < limit) {
+                cur.reg = (Reg)r;
+                busy[r] = true;
+                active.push_back(id);
+                continue;
+            }
+            // 寄存器已满：与占着可用寄存器的活跃区间中权重最小的比较，较轻的一方留在栈上
+            size_t victim = active.size();
+            for (size_t k = 0; k < active.size(); ++k) {
+                if (vars[active[k]].reg >= limit) continue;
+                if (victim == active.size() || vars[active[k]].weight < vars[active[victim]].weight) victim = k;
+            }
+            if (victim == active.size()) continue;
+            Interval& v = vars[active[victim]];
+            if (v.weight < cur.weight) {
+                cur.reg = v.reg;
+                v.reg = REG_NONE;
+                active[victim] = id;
+            }
+        }
+    }
+
+    // 没分到寄存器的变量按活跃区间分配栈槽 [ebp-4k]：区间不相交的共用一个槽，
+    // 帧的大小由同时活跃的栈上变量数决定，与声明总数无关。从未引用的局部变量不占槽；
+    // 形参总要有位置（自身尾调用会写入），栈上传来的形参就在调用方的参数区，偏移为正由代码生成填写
+    int assignSlots(size_t paramCount, int regParams, vector<int>& slots) {
+        slots.assign(vars.size(), 0);
+        vector<uint32_t> order;
+        for (uint32_t i = 0; i < vars.size(); ++i) {
+            if (vars[i].reg != REG_NONE) continue;
+            if (i < paramCount ? (int)i >= regParams : vars[i].weight == 0) continue;
+            order.push_back(i);
+        }
+        stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return vars[a].start < vars[b].start;
+        });
+        vector<uint32_t> slotEnd; // 各槽当前占用者的区间终点
+        for (uint32_t id : order) {
+            size_t k = 0;
+            while (k < slotEnd.size() && slotEnd[k] >= vars[id].start) ++k;
+            if (k == slotEnd.size()) slotEnd.push_back(0);
+            slotEnd[k] = vars[id].end;
+            slots[id] = -4 * (int)(k + 1);
+        }
+        return 4 * (int)slotEnd.size();
+    }
+};
+
+// ---------- 代码生成 ----------
+// 函数体先生成为指令序列，经窥孔优化后输出；文件头、入口和数据段直接输出
+class CodeGenerator {
+    ostream& out;
+    Scope* globalScope; // 实际只需要函数内作用域，这里简化，为每个函数单独处理
+    int labelCounter;   // if/while 共用，保证标签不重复
+    vector<uint8_t> isGlobal; // 按驻留编号索引，标记全局变量
+    vector<Instr> code;       // 当前函数的指令序列
+    Peephole peephole;
+    bool optimize;            // 窥孔优化、乘除常数的指令选择（-O0 时关闭）
+    int regParams;            // 内部函数用寄存器传递的实参个数，0 即全部按 cdecl 压栈
+    map<SymId, int> functions; // 可调用的函数 -> 形参个数，extern 函数为 -1（不检查个数）
+public:
+    CodeGenerator(ostream& os, bool opt, int regs)
+        : out(os), globalScope(nullptr), labelCounter(0), optimize(opt), regParams(regs) {}
+
+    const Peephole& peepholeStats() const { return peephole; }
+
+    void printFrameStats(ostream& os) const {
+        os << "栈帧大小:\n";
+        for (const FrameStat& f : frameStats) {
+            os << "  " << interner.str(f.name) << ": " << f.bytes << " 字节（逐个分配 " << f.declared << " 字节）";
+            if (f.omitted) os << "，省略帧指针";
+            os << "\n";
+        }
+    }
+
+    void generate(Program* prog) {
+        out << "; Emerging语言生成的汇编 (NASM语法)\n";
+        out << "section .text\n";
+        out << "global _start\n";
+        for (const Decl& d : prog->decls) {
+            if (d.kind == DECL_EXTERN) {
+                out << "extern " << interner.str(d.name) << "\n";
+                functions[d.name] = -1;
+            }
+            else declareGlobal(d.name);
+        }
+        for (Function* func : prog->functions) {
+            if (!functions.insert(make_pair(func->name, (int)func->paramCount)).second) {
+                cerr << "重复定义的函数: " << interner.str(func->name) << endl; exit(1);
+            }
+        }
+        out << "\n";
+        out << "_start:\n";
+        out << "    call main\n";
+        out << "    mov ebx, eax\n";
+        out << "    mov eax, 1\n";
+        out << "    int 0x80\n\n";
+
+        for (Function* func : prog->functions) {
+            generateFunction(func);
+        }
+
+        // 全局变量放在数据段，以 _g_ 前缀避免与函数名和寄存器名冲突
+        bool first = true;
+        for (const Decl& d : prog->decls) {
+            if (d.kind != DECL_GLOBAL) continue;
+            if (first) out << "section .data\n";
+            first = false;
+            out << "_g_" << interner.str(d.name) << " dd " << d.value << "\n";
+        }
+    }
+
+private:
+    FlatFunction flat; // 当前函数的扁平形式
+    RegisterAllocator allocator;
+    vector<Reg> varRegs;      // 当前函数各局部变量的寄存器，按声明顺序
+    vector<int> varSlots;     // 当前函数各局部变量的栈槽偏移，分到寄存器的为 0
+    bool framePointer;        // 当前函数是否建立 ebp 栈帧
+    vector<Reg> savedRegs;    // 序言中压栈保存的寄存器
+    uint32_t declared;        // 当前函数已登记的局部变量数
+    vector<uint8_t> exprNeed; // 各表达式的 Sethi-Ullman 编号
+    vector<uint8_t> exprPure; // 各表达式子树是否不含赋值
+    vector<uint32_t> spine;   // evalExpr 沿左链下行时待完成的二元运算
+    int maxNeed;              // 当前函数最大的 Sethi-Ullman 编号
+    Reg scratch[REG_COUNT + 1]; // 表达式求值可用的寄存器，scratch[0] 为 eax
+    int scratchCount;
+    vector<string> paramHomes; // 各形参在函数体内的位置（寄存器或带 dword 的内存操作数）
+    string tailLabel;          // 自身尾调用跳回的标签，形参绑定之后；没有自身尾调用时为空
+
+    struct FrameStat {
+        SymId name;
+        int declared;   // 每个形参和局部变量各占一个槽时的字节数
+        int bytes;      // 实际的局部变量区字节数
+        bool omitted;   // 省略了帧指针
+    };
+    vector<FrameStat> frameStats;
+
+    void emit(Opcode op, string a = string(), string b = string(), string c = string()) {
+        code.push_back(Instr{ op, CC_E, move(a), move(b), move(c) });
+    }
+
+    void emitLabel(const string& name) { emit(OP_LABEL, name); }
+
+    void emitJcc(Cond cc, const string& label) {
+        code.push_back(Instr{ OP_JCC, cc, label, string(), string() });
+    }
+
+    void declareGlobal(SymId name) {
+        if (name >= isGlobal.size()) isGlobal.resize(name + 1, 0);
+        if (isGlobal[name]) {
+            cerr << "重复定义的全局变量: " << interner.str(name) << endl; exit(1);
+        }
+        isGlobal[name] = 1;
+    }
+
+    // 变量的操作数：局部变量为分到的寄存器或 [ebp-N]，全局变量 [_g_名字]；局部变量遮蔽同名全局变量
+    // sized 为真时内存操作数带 dword（idiv 等单操作数指令需要）
+    string varOperand(SymId name, Scope& scope, bool sized = false) {
+        string prefix = sized ? "dword " : "";
+        if (Symbol* sym = scope.lookup(name)) {
+            if (sym->reg != REG_NONE) return REG_NAMES[sym->reg];
+            return prefix + (sym->offset < 0 ? "[ebp" : "[ebp+") + to_string(sym->offset) + "]";
+        }
+        if (name < isGlobal.size() && isGlobal[name]) {
+            return prefix + "[_g_" + interner.str(name) + "]";
+        }
+        cerr << "未定义的变量: " << interner.str(name) << endl; exit(1);
+    }
+
+    void generateFunction(Function* func) {
+        flat.build(func);
+        code.clear();
+        emitLabel(interner.str(flat.name));
+
+        Scope localScope;
+        globalScope = &localScope; // 用于变量查找
+        // 为局部变量分配寄存器和栈槽，剩下的寄存器作表达式临时寄存器；
+        // 用到的被调用者保存寄存器在序言中压栈。变量在生成时按作用域登记
+        int stackSize = allocator.run(flat, optimize, regParams, varRegs, varSlots);
+        framePointer = !optimize || !omitFramePointer(stackSize);
+        if (framePointer) {
+            emit(OP_PUSH, "ebp");
+            emit(OP_MOV, "ebp", "esp");
+        }
+        if (stackSize > 0) {
+            emit(OP_SUB, "esp", to_string(stackSize));
+        }
+        frameStats.push_back({ flat.name, collectDeclarations(), stackSize, !framePointer });
+        labelExprs();
+        chooseScratch();
+        declared = 0;
+        savedRegs.clear();
+        for (int r = 0; r < REG_COUNT; ++r) {
+            if (!isCalleeSaved((Reg)r)) continue;
+            if (find(varRegs.begin(), varRegs.end(), (Reg)r) != varRegs.end() ||
+                find(scratch, scratch + scratchCount, (Reg)r) != scratch + scratchCount) {
+                savedRegs.push_back((Reg)r);
+                emit(OP_PUSH, REG_NAMES[r]);
+            }
+        }
+        bindParams(localScope);
+        // 调用自身的尾调用把实参写进各形参后跳到这里，递归变成循环
+        tailLabel.clear();
+        for (const FlatStmt& st : flat.stmts) {
+            if (st.kind == STMT_RETURN && isTailCall(st.a) && flat.exprs[st.a].a == flat.name) {
+                tailLabel = ".Ltail" + to_string(labelCounter++);
+                emitLabel(tailLabel);
+                break;
+            }
+        }
+
+        // 生成函数体语句（stmts[0] 即函数体块）
+        generateStmt(0, localScope);
+
+        // 函数末尾隐含return 0？但标准要求有return，没有则返回0？
+        // 假设用户一定有return
+        generateEpilogue();
+
+        flushCode();
+        out << "\n";
+    }
+
+    // 超长函数分段优化并输出，避免整个函数的指令序列常驻内存。
+    // 只在语句之间分段：此处标志位已死，跨段的跳转找不到标签，规则会按保守处理
+    static const size_t FLUSH_THRESHOLD = 1 << 16;
+
+    void flushCode() {
+        if (optimize) peephole.run(code);
+        writeInstrs(out, code);
+        code.clear();
+    }
+
+    // 语句之间表达式栈为空，esp 正好指向保存的寄存器，按相反顺序弹出即可
+    void generateEpilogue() {
+        releaseFrame();
+        emit(OP_RET);
+    }
+
+    // 恢复保存的寄存器并撤销栈帧，之后 esp 指向返回地址
+    void releaseFrame() {
+        for (size_t i = savedRegs.size(); i-- > 0;) {
+            emit(OP_POP, REG_NAMES[savedRegs[i]]);
+        }
+        if (framePointer) emit(OP_LEAVE);
+    }
+
+    // 不调用任何函数、没有变量留在栈上的函数不建立 ebp 栈帧：
+    // 栈上传来的形参都已分到寄存器，在序言中按 esp 寻址装入，函数体内不再出现 [ebp±N]
+    bool omitFramePointer(int stackSize) const {
+        if (stackSize > 0) return false;
+        for (const FlatExpr& e : flat.exprs) {
+            if (e.kind == EXPR_CALL) return false;
+        }
+        for (size_t k = regParams; k < flat.params.size(); ++k) {
+            if (varRegs[k] == REG_NONE) return false;
+        }
+        return true;
+    }
+
+    // 每个形参和局部变量声明各占一个槽时的大小，仅用于统计。语句按前序连续存放，直接顺序扫描即可
+    int collectDeclarations() const {
+        int size = 4 * (int)flat.params.size();
+        for (const FlatStmt& st : flat.stmts) {
+            if (st.kind == STMT_DECL) size += 4;
+        }
+        return size;
+    }
+
+    // 形参登记在函数最外层作用域。由 ecx、edx 传来的移到分配的位置（寄存器或栈槽），
+    // 两者互换位置时经 eax 中转；栈上传来的就在 [ebp+8] 起的调用方栈帧中，分到寄存器的才装入
+    void bindParams(Scope& scope) {
+        uint32_t count = (uint32_t)flat.params.size();
+        uint32_t inRegs = min<uint32_t>(count, regParams);
+        string dest[MAX_REG_PARAMS];
+        paramHomes.clear();
+        for (uint32_t k = 0; k < count; ++k) {
+            scope.declare(flat.params[k]);
+            Symbol* sym = scope.lookup(flat.params[k]);
+            sym->reg = varRegs[declared];
+            sym->offset = varSlots[declared++];
+            if (k >= inRegs) sym->offset = 8 + 4 * (int)(k - inRegs);
+            else dest[k] = varOperand(flat.params[k], scope);
+            paramHomes.push_back(varOperand(flat.params[k], scope, true));
+        }
+        const char* ecx = REG_NAMES[ARG_REGS[0]];
+        const char* edx = REG_NAMES[ARG_REGS[1]];
+        if (inRegs == 2 && dest[0] == edx && dest[1] == ecx) {
+            emit(OP_MOV, "eax", ecx);
+            emit(OP_MOV, ecx, edx);
+            emit(OP_MOV, edx, "eax");
+        }
+        else if (inRegs == 2 && dest[0] == edx) {
+            emit(OP_MOV, dest[1], edx);
+            emit(OP_MOV, dest[0], ecx);
+        }
+        else {
+            for (uint32_t k = 0; k < inRegs; ++k) {
+                if (dest[k] != REG_NAMES[ARG_REGS[k]]) emit(OP_MOV, dest[k], REG_NAMES[ARG_REGS[k]]);
+            }
+        }
+        for (uint32_t k = inRegs; k < count; ++k) {
+            Symbol* sym = scope.lookup(flat.params[k]);
+            if (sym->reg == REG_NONE) continue;
+            // 没有 ebp 栈帧时按 esp 寻址：其上依次是保存的寄存器、返回地址、实参
+            string src = framePointer ? "[ebp+" + to_string(sym->offset) + "]"
+                                      : "[esp+" + to_string(sym->offset - 4 + 4 * (int)savedRegs.size()) + "]";
+            emit(OP_MOV, REG_NAMES[sym->reg], src);
+        }
+    }
+
+    void generateStmt(uint32_t i, Scope& scope) {
+        const FlatStmt& st = flat.stmts[i];
+        switch (st.kind) {
+        case STMT_ASSIGN: {
+            generateExpr(st.b, scope); // 结果在eax
+            emit(OP_MOV, varOperand(st.a, scope), "eax");
+            break;
+        }
+        case STMT_IF:     generateIf(i, scope); break;
+        case STMT_WHILE:  generateWhile(i, scope); break;
+        case STMT_RETURN:
+            if (isTailCall(st.a)) {
+                generateTailCall(st.a, scope);
+                break;
+            }
+            generateExpr(st.a, scope); // 返回值在eax
+            generateEpilogue();
+            break;
+        case STMT_BLOCK:
+            scope.push();
+            for (uint32_t c = i + 1; c < st.end; c = flat.stmts[c].end) {
+                generateStmt(c, scope);
+                if (code.size() >= FLUSH_THRESHOLD) flushCode();
+            }
+            scope.pop();
+            break;
+        case STMT_DECL:
+            // 位置已由分配器选定，这里登记到当前作用域并取回分配的寄存器和栈槽，无代码生成
+            if (!scope.declare(st.a)) {
+                cerr << "重复定义的变量: " << interner.str(st.a) << endl; exit(1);
+            }
+            scope.lookup(st.a)->reg = varRegs[declared];
+            scope.lookup(st.a)->offset = varSlots[declared++];
+            break;
+        case STMT_EXPR:
+            generateExpr(st.a, scope); // 丢弃返回值
+            break;
+        }
+    }
+
+    void generateIf(uint32_t i, Scope& scope) {
+        const FlatStmt& st = flat.stmts[i];
+        int id = labelCounter++;
+        string labelElse = ".Lelse" + to_string(id);
+        string labelEnd = ".Lend" + to_string(id);
+
+        generateCondition(st.a, scope, labelElse); // 条件为假跳转到else
+        generateStmt(i + 1, scope);
+        emit(OP_JMP, labelEnd);
+        emitLabel(labelElse);
+        if (st.b != FLAT_NONE) generateStmt(st.b, scope);
+        emitLabel(labelEnd);
+    }
+
+    void generateWhile(uint32_t i, Scope& scope) {
+        const FlatStmt& st = flat.stmts[i];
+        int id = labelCounter++;
+        string labelStart = ".Lstart" + to_string(id);
+        string labelEnd = ".Lend" + to_string(id);
+
+        emitLabel(labelStart);
+        generateCondition(st.a, scope, labelEnd);
+        generateStmt(i + 1, scope);
+        emit(OP_JMP, labelStart);
+        emitLabel(labelEnd);
+    }
+
+    // 比较运算成立时的条件码
+    static Cond condition(BinOp op) {
+        switch (op) {
+        case BIN_LT: return CC_L;
+        case BIN_LE: return CC_LE;
+        case BIN_GT: return CC_G;
+        case BIN_GE: return CC_GE;
+        case BIN_EQ: return CC_E;
+        default:     return CC_NE;
+        }
+    }
+
+    // 条件生成：如果条件为假，跳转到label
+    void generateCondition(uint32_t cond, Scope& scope, const string& falseLabel) {
+        // 简化：假设条件是比较表达式或常数
+        const FlatExpr& e = flat.exprs[cond];
+        if (e.kind == EXPR_INT) {
+            // 折叠后剩下的常数条件：恒真不生成代码，恒假直接跳转
+            if (flat.intValue(cond) == 0) emit(OP_JMP, falseLabel);
+            return;
+        }
+        if (e.kind == EXPR_BINARY && e.op >= BIN_LT && e.op <= BIN_NE) {
+            Operand rhs;
+            BinOp op = generateOperands(cond, scratch, scratchCount, scope, rhs);
+            emit(OP_CMP, REG_NAMES[scratch[0]], operandText(rhs, scope));
+            if (rhs.kind == OPND_STACK) emit(OP_LEA, "esp", "[esp+8]"); // 弹出操作数，不影响标志位
+            emitJcc(COND_NEGATE[condition(op)], falseLabel); // 不满足条件时跳转
+            return;
+        }
+        // 非比较表达式：将其值作为布尔，0为假，非0为真
+        generateExpr(cond, scope);
+        emit(OP_CMP, "eax", "0");
+        emitJcc(CC_E, falseLabel);
+    }
+
+    // ---- 表达式求值 ----
+    // 按 Sethi-Ullman 编号在寄存器中求值：need 为子树不溢出所需的寄存器数，
+    // 较重的子树先算，另一侧用剩下的寄存器；右操作数是常数或变量时直接作指令操作数。
+    // 寄存器只剩一个时退回栈：两侧依次压栈，左值取回寄存器，右值以 [esp] 为操作数。
+    // 子树含赋值时保持从左到右的求值顺序，不交换也不重排。
+
+    // 二元运算右操作数的位置
+    enum OperandKind : uint8_t { OPND_REG, OPND_IMM, OPND_VAR, OPND_STACK };
+    struct Operand {
+        OperandKind kind;
+        uint32_t value; // REG: 寄存器；IMM: 常数；VAR: 变量名
+    };
+
+    // 表达式按后序存放，子节点总在父节点之前，一趟顺序扫描即可标号
+    void labelExprs() {
+        exprNeed.resize(flat.exprs.size());
+        exprPure.resize(flat.exprs.size());
+        maxNeed = 1;
+        for (size_t i = 0; i < flat.exprs.size(); ++i) {
+            const FlatExpr& e = flat.exprs[i];
+            if (e.kind == EXPR_CALL) {
+                // 实参逐个算完即入栈，所需寄存器取各实参的最大值；调用可能改写全局变量
+                exprNeed[i] = 1;
+                for (uint32_t k = 0; k < flat.argCount((uint32_t)i); ++k) {
+                    exprNeed[i] = max(exprNeed[i], exprNeed[flat.arg((uint32_t)i, k)]);
+                }
+                exprPure[i] = 0;
+                continue;
+            }
+            if (e.kind != EXPR_BINARY) {
+                exprNeed[i] = 1;
+                exprPure[i] = 1;
+                continue;
+            }
+            if (e.op == BIN_ASSIGN) {
+                exprNeed[i] = exprNeed[e.b];
+                exprPure[i] = 0;
+                continue;
+            }
+            uint8_t l = exprNeed[e.a];
+            uint8_t r = isLeaf(e.b) ? 0 : exprNeed[e.b];
+            exprNeed[i] = l == r ? l + 1 : max(l, r);
+            if (optimize && e.op == BIN_DIV && flat.exprs[e.b].kind == EXPR_INT) {
+                // 除以常数：2 的幂要一个临时寄存器，乘魔数还要 eax、edx 之外再有一个
+                uint32_t d = flat.exprs[e.b].a;
+                if ((int32_t)d < 0) d = 0u - d;
+                exprNeed[i] = max<uint8_t>(exprNeed[i], isPowerOfTwo(d) ? 2 : 3);
+            }
+            exprPure[i] = exprPure[e.a] && exprPure[e.b];
+            maxNeed = max(maxNeed, (int)exprNeed[i]);
+        }
+    }
+
+    // 临时寄存器：eax 之后依次取未分给变量的 edx、ecx、ebx、esi、edi，够用即止
+    void chooseScratch() {
+        static const Reg ORDER[] = { REG_EDX, REG_ECX, REG_EBX, REG_ESI, REG_EDI };
+        scratch[0] = REG_EAX;
+        scratchCount = 1;
+        for (Reg r : ORDER) {
+            if (scratchCount >= maxNeed) break;
+            if (find(varRegs.begin(), varRegs.end(), r) == varRegs.end()) scratch[scratchCount++] = r;
+        }
+    }
+
+    bool isLeaf(uint32_t i) const { return flat.exprs[i].kind == EXPR_INT || flat.exprs[i].kind == EXPR_VAR; }
+
+    Operand leafOperand(uint32_t i) const {
+        const FlatExpr& e = flat.exprs[i];
+        return e.kind == EXPR_INT ? Operand{ OPND_IMM, e.a } : Operand{ OPND_VAR, e.a };
+    }
+
+    string operandText(const Operand& o, Scope& scope) {
+        switch (o.kind) {
+        case OPND_REG:   return REG_NAMES[o.value];
+        case OPND_IMM:   return to_string((int32_t)o.value);
+        case OPND_VAR:   return varOperand(o.value, scope);
+        default:         return "dword [esp]";
+        }
+    }
+
+    // 结果在eax
+    void generateExpr(uint32_t i, Scope& scope) {
+        evalExpr(i, scratch, scratchCount, scope);
+    }
+
+    // 把表达式 i 的值算进 regs[0]；regs[0..n) 可以随意改写，其余寄存器保持不变。
+    // 长的 a+b+c+... 是左深的树：先用同样寄存器算左侧的运算沿左链一直走到底，
+    // 算完最底下的节点再由下往上完成各层，调用栈不随链长加深
+    void evalExpr(uint32_t i, const Reg* regs, int n, Scope& scope) {
+        size_t base = spine.size();
+        while (leftFirst(i, n)) {
+            spine.push_back(i);
+            i = flat.exprs[i].a;
+        }
+        evalNode(i, regs, n, scope);
+        while (spine.size() > base) {
+            generateBinary(spine.back(), regs, n, scope, true);
+            spine.pop_back();
+        }
+    }
+
+    void evalNode(uint32_t i, const Reg* regs, int n, Scope& scope) {
+        const FlatExpr& e = flat.exprs[i];
+        Reg r = regs[0];
+        switch (e.kind) {
+        case EXPR_INT:
+            emit(OP_MOV, REG_NAMES[r], to_string(flat.intValue(i)));
+            break;
+        case EXPR_VAR:
+            emit(OP_MOV, REG_NAMES[r], varOperand(e.a, scope));
+            break;
+        case EXPR_BINARY:
+            if (e.op == BIN_ASSIGN) generateAssignExpr(e, regs, n, scope);
+            else if (e.op == BIN_DIV) generateDivide(e, regs, n, scope);
+            else generateBinary(i, regs, n, scope);
+            break;
+        case EXPR_CALL:
+            generateCall(i, regs, n, scope);
+            break;
+        }
+    }
+
+    // 函数调用。内部函数的前 regParams 个实参放在 ecx、edx，其余实参与 extern 函数一样
+    // 按 cdecl 从右到左压栈、由调用方清栈，返回值在 eax。eax、ecx、edx 会被被调函数改写，
+    // 其中保存着外层表达式中间值的先压栈保存；跨调用存活的变量已由分配器放在 esi/edi/ebx
+    void generateCall(uint32_t i, const Reg* regs, int n, Scope& scope) {
+        const FlatExpr& e = flat.exprs[i];
+        uint32_t argc = flat.argCount(i);
+        auto it = functions.find(e.a);
+        if (it == functions.end()) {
+            cerr << "未定义的函数: " << interner.str(e.a) << endl; exit(1);
+        }
+        if (it->second >= 0 && (uint32_t)it->second != argc) {
+            cerr << "函数 " << interner.str(e.a) << " 需要 " << it->second << " 个参数，传入了 " << argc << " 个\n"; exit(1);
+        }
+        uint32_t inRegs = it->second >= 0 ? min<uint32_t>(argc, regParams) : 0;
+
+        vector<Reg> saved;
+        for (int k = 0; k < scratchCount; ++k) {
+            Reg r = scratch[k];
+            if (isCalleeSaved(r) || find(regs, regs + n, r) != regs + n) continue;
+            saved.push_back(r);
+            emit(OP_PUSH, REG_NAMES[r]);
+        }
+        bool pure = true;
+        for (uint32_t k = 0; k < argc; ++k) pure = pure && exprPure[flat.arg(i, k)];
+        if (pure) {
+            // 实参没有副作用时求值顺序无关：栈上的从右到左直接压栈；
+            // 寄存器实参中的算式先算好压栈再弹进寄存器，常数和变量最后直接装入
+            for (uint32_t k = argc; k-- > inRegs;) {
+                uint32_t a = flat.arg(i, k);
+                if (flat.exprs[a].kind == EXPR_VAR) emit(OP_PUSH, varOperand(flat.exprs[a].a, scope, true));
+                else if (flat.exprs[a].kind == EXPR_INT) emit(OP_PUSH, to_string(flat.intValue(a)));
+                else {
+                    evalExpr(a, regs, n, scope);
+                    emit(OP_PUSH, REG_NAMES[regs[0]]);
+                }
+            }
+            for (uint32_t k = inRegs; k-- > 0;) {
+                if (isLeaf(flat.arg(i, k))) continue;
+                evalExpr(flat.arg(i, k), regs, n, scope);
+                emit(OP_PUSH, REG_NAMES[regs[0]]);
+            }
+            for (uint32_t k = 0; k < inRegs; ++k) {
+                if (!isLeaf(flat.arg(i, k))) emit(OP_POP, REG_NAMES[ARG_REGS[k]]);
+            }
+            for (uint32_t k = 0; k < inRegs; ++k) {
+                uint32_t a = flat.arg(i, k);
+                if (isLeaf(a)) emit(OP_MOV, REG_NAMES[ARG_REGS[k]], operandText(leafOperand(a), scope));
+            }
+        }
+        else {
+            // 从左到右求值，依次存入预留的栈空间，再把前几个弹进寄存器
+            if (argc > 0) emit(OP_SUB, "esp", to_string(4 * argc));
+            for (uint32_t k = 0; k < argc; ++k) {
+                evalExpr(flat.arg(i, k), regs, n, scope);
+                emit(OP_MOV, k ? "[esp+" + to_string(4 * k) + "]" : "[esp]", REG_NAMES[regs[0]]);
+            }
+            for (uint32_t k = 0; k < inRegs; ++k) emit(OP_POP, REG_NAMES[ARG_REGS[k]]);
+        }
+        emit(OP_CALL, interner.str(e.a));
+        if (argc > inRegs) emit(OP_ADD, "esp", to_string(4 * (argc - inRegs)));
+        if (regs[0] != REG_EAX) emit(OP_MOV, REG_NAMES[regs[0]], "eax");
+        for (size_t k = saved.size(); k-- > 0;) emit(OP_POP, REG_NAMES[saved[k]]);
+    }
+
+    // ---- 尾调用 ----
+    // return g(...) 中 g 是内部函数时不再 call：调用自身时实参写进各形参后跳回 tailLabel；
+    // 调用别的函数时实参写进 ecx、edx 和本函数的栈上参数区，撤销栈帧后 jmp 到 g，由 g 直接返回到本函数的调用方。
+    // 栈上参数由调用方按它压入的个数清理，因此 g 的栈上实参不能多于本函数的栈上形参。-O0 不做
+    bool isTailCall(uint32_t i) const {
+        const FlatExpr& e = flat.exprs[i];
+        if (!optimize || e.kind != EXPR_CALL) return false;
+        auto it = functions.find(e.a);
+        uint32_t argc = flat.argCount(i);
+        if (it == functions.end() || it->second < 0 || (uint32_t)it->second != argc) return false;
+        return e.a == flat.name || stackArgs(argc) <= stackArgs((uint32_t)flat.params.size());
+    }
+
+    uint32_t stackArgs(uint32_t argc) const { return argc - min<uint32_t>(argc, regParams); }
+
+    // 实参从左到右全部算完压栈，再从栈顶依次弹到目标位置，目标之间互不干扰。
+    // 实参都没有副作用时，已经在目标位置上的变量（如原样传下去的形参）不必移动
+    void generateTailCall(uint32_t i, Scope& scope) {
+        const FlatExpr& e = flat.exprs[i];
+        uint32_t argc = flat.argCount(i);
+        uint32_t inRegs = min<uint32_t>(argc, regParams);
+        bool self = e.a == flat.name;
+        bool pure = true;
+        for (uint32_t k = 0; k < argc; ++k) pure = pure && exprPure[flat.arg(i, k)];
+        vector<string> dest(argc);
+        for (uint32_t k = 0; k < argc; ++k) {
+            if (self) dest[k] = paramHomes[k];
+            else if (k < inRegs) dest[k] = REG_NAMES[ARG_REGS[k]];
+            else dest[k] = "dword [ebp+" + to_string(8 + 4 * (k - inRegs)) + "]";
+            uint32_t a = flat.arg(i, k);
+            const FlatExpr& arg = flat.exprs[a];
+            if (pure && arg.kind == EXPR_VAR && varOperand(arg.a, scope, true) == dest[k]) {
+                dest[k].clear();
+                continue;
+            }
+            if (arg.kind == EXPR_VAR) emit(OP_PUSH, varOperand(arg.a, scope, true));
+            else if (arg.kind == EXPR_INT) emit(OP_PUSH, to_string(flat.intValue(a)));
+            else {
+                generateExpr(a, scope);
+                emit(OP_PUSH, "eax");
+            }
+        }
+        for (uint32_t k = argc; k-- > 0;) {
+            if (!dest[k].empty()) emit(OP_POP, dest[k]);
+        }
+        if (self) {
+            emit(OP_JMP, tailLabel);
+            return;
+        }
+        releaseFrame();
+        emit(OP_JMP, interner.str(e.a));
+    }
+
+    // 赋值表达式：右值算进 regs[0] 后存入左变量，结果仍在 regs[0]
+    void generateAssignExpr(const FlatExpr& bin, const Reg* regs, int n, Scope& scope) {
+        evalExpr(bin.b, regs, n, scope);
+        const FlatExpr& target = flat.exprs[bin.a];
+        if (target.kind != EXPR_VAR) { cerr << "无效的赋值目标\n"; exit(1); }
+        emit(OP_MOV, varOperand(target.a, scope), REG_NAMES[regs[0]]);
+    }
+
+    // 左边是叶子而右边不是，或左边是常数而右边是变量：可交换的运算交换两侧，
+    // 叶子（尤其是常数）放到右边直接作操作数
+    bool swapsOperands(const FlatExpr& e) const {
+        bool pure = exprPure[e.a] && exprPure[e.b];
+        bool swapLeaf = isLeaf(e.a) && (!isLeaf(e.b) || (flat.exprs[e.a].kind == EXPR_INT && flat.exprs[e.b].kind == EXPR_VAR));
+        return pure && swapLeaf && e.op != BIN_SUB;
+    }
+
+    // 右子树更重时先算右边
+    bool rightFirst(uint32_t a, uint32_t b) const {
+        return exprPure[a] && exprPure[b] && exprNeed[b] > exprNeed[a];
+    }
+
+    // 二元运算 i 是否由 generateOperands 先用同样的 regs[0..n) 算不交换的左侧
+    bool leftFirst(uint32_t i, int n) const {
+        const FlatExpr& e = flat.exprs[i];
+        if (e.kind != EXPR_BINARY || e.op == BIN_ASSIGN || e.op == BIN_DIV || swapsOperands(e)) return false;
+        return isLeaf(e.b) || n < 2 || !rightFirst(e.a, e.b);
+    }
+
+    // 计算二元运算的两侧：左值进 regs[0]，右值由 rhs 给出；leftDone 表示左值已经在 regs[0] 中。
+    // 为少用寄存器可能交换两侧，返回交换后等价的运算符
+    BinOp generateOperands(uint32_t i, const Reg* regs, int n, Scope& scope, Operand& rhs, bool leftDone = false) {
+        const FlatExpr& e = flat.exprs[i];
+        uint32_t a = e.a, b = e.b;
+        BinOp op = (BinOp)e.op;
+        if (swapsOperands(e)) {
+            swap(a, b);
+            op = mirror(op);
+        }
+        if (isLeaf(b)) {
+            if (!leftDone) evalExpr(a, regs, n, scope);
+            rhs = leafOperand(b);
+            return op;
+        }
+        if (n >= 2) {
+            Reg rest[REG_COUNT + 1];
+            if (rightFirst(a, b)) {
+                // 右子树更重：先用全部寄存器把它算进 regs[1]，再用 regs[1] 以外的算左边
+                rest[0] = regs[1];
+                rest[1] = regs[0];
+                copy(regs + 2, regs + n, rest + 2);
+                evalExpr(b, rest, n, scope);
+                rest[0] = regs[0];
+                copy(regs + 2, regs + n, rest + 1);
+                evalExpr(a, rest, n - 1, scope);
+            }
+            else {
+                if (!leftDone) evalExpr(a, regs, n, scope);
+                evalExpr(b, regs + 1, n - 1, scope);
+            }
+            rhs = Operand{ OPND_REG, (uint32_t)regs[1] };
+            return op;
+        }
+        // 寄存器用尽：[esp+4] 为左值、[esp] 为右值，左值取回寄存器
+        const char* r = REG_NAMES[regs[0]];
+        if (!leftDone) evalExpr(a, regs, 1, scope);
+        emit(OP_PUSH, r);
+        evalExpr(b, regs, 1, scope);
+        emit(OP_PUSH, r);
+        emit(OP_MOV, r, "[esp+4]");
+        rhs = Operand{ OPND_STACK, 0 };
+        return op;
+    }
+
+    // 交换两侧后的等价运算符
+    static BinOp mirror(BinOp op) {
+        switch (op) {
+        case BIN_LT: return BIN_GT;
+        case BIN_LE: return BIN_GE;
+        case BIN_GT: return BIN_LT;
+        case BIN_GE: return BIN_LE;
+        default:     return op; // 加、乘、相等、不等
+        }
+    }
+
+    void generateBinary(uint32_t i, const Reg* regs, int n, Scope& scope, bool leftDone = false) {
+        Operand rhs;
+        BinOp op = generateOperands(i, regs, n, scope, rhs, leftDone);
+        const char* r = REG_NAMES[regs[0]];
+        string b = operandText(rhs, scope);
+        switch (op) {
+        case BIN_ADD: emit(OP_ADD, r, b); break;
+        case BIN_SUB: emit(OP_SUB, r, b); break;
+        case BIN_MUL:
+            if (rhs.kind != OPND_IMM) emit(OP_IMUL, r, b);
+            else if (!optimize || !lowerMulConst(code, r, n >= 2 ? REG_NAMES[regs[1]] : "", (int32_t)rhs.value)) {
+                emit(OP_IMUL, r, r, b);
+            }
+            break;
+        default:      emit(OP_CMP, r, b); break;
+        }
+        if (op >= BIN_LT && op <= BIN_NE) generateSetcc(op, regs[0]);
+        if (rhs.kind == OPND_STACK) emit(OP_ADD, "esp", "8");
+    }
+
+    // 比较结果转为 0/1；esi/edi 没有8位形式，改用条件跳转
+    void generateSetcc(BinOp op, Reg r) {
+        Cond cc = condition(op);
+        if (REG_LOW_NAMES[r]) {
+            code.push_back(Instr{ OP_SETCC, cc, REG_LOW_NAMES[r], string(), string() });
+            emit(OP_MOVZX, REG_NAMES[r], REG_LOW_NAMES[r]);
+            return;
+        }
+        string label = ".Lset" + to_string(labelCounter++);
+        emit(OP_MOV, REG_NAMES[r], "1"); // mov 不影响标志位
+        emitJcc(cc, label);
+        emit(OP_MOV, REG_NAMES[r], "0");
+        emitLabel(label);
+    }
+
+    // idiv 固定使用 edx:eax。eax、edx 都可改写且除数是变量或常数时，被除数直接算进 eax；
+    // 否则两侧压栈，临时保存被占用的 eax/edx，以栈上的除数做除法
+    void generateDivide(const FlatExpr& bin, const Reg* regs, int n, Scope& scope) {
+        if (optimize && flat.exprs[bin.b].kind == EXPR_INT && generateDivideConst(bin, regs, n, scope)) return;
+        Reg r = regs[0];
+        bool eaxFree = find(regs, regs + n, REG_EAX) != regs + n;
+        bool edxFree = find(regs, regs + n, REG_EDX) != regs + n;
+        Reg rest[REG_COUNT + 1];
+        const Reg* divisor = nullptr; // 常数除数要用的寄存器
+        if (flat.exprs[bin.b].kind == EXPR_INT) {
+            divisor = find_if(regs, regs + n, [](Reg x) { return x != REG_EAX && x != REG_EDX; });
+        }
+        if (eaxFree && edxFree && (flat.exprs[bin.b].kind == EXPR_VAR || (divisor && divisor != regs + n))) {
+            rest[0] = REG_EAX;
+            int m = 1;
+            for (int k = 0; k < n; ++k) {
+                if (regs[k] != REG_EAX) rest[m++] = regs[k];
+            }
+            evalExpr(bin.a, rest, n, scope);
+            if (flat.exprs[bin.b].kind == EXPR_VAR) {
+                emit(OP_CDQ);
+                emit(OP_IDIV, varOperand(flat.exprs[bin.b].a, scope, true));
+            }
+            else {
+                emit(OP_MOV, REG_NAMES[*divisor], to_string(flat.intValue(bin.b)));
+                emit(OP_CDQ);
+                emit(OP_IDIV, REG_NAMES[*divisor]);
+            }
+            if (r != REG_EAX) emit(OP_MOV, REG_NAMES[r], "eax");
+            return;
+        }
+        evalExpr(bin.a, regs, n, scope);
+        emit(OP_PUSH, REG_NAMES[r]);
+        evalExpr(bin.b, regs, n, scope);
+        emit(OP_PUSH, REG_NAMES[r]);
+        int saved = 0;
+        if (!eaxFree) { emit(OP_PUSH, "eax"); saved += 4; }
+        if (!edxFree) { emit(OP_PUSH, "edx"); saved += 4; }
+        emit(OP_MOV, "eax", "[esp+" + to_string(saved + 4) + "]");
+        emit(OP_CDQ);
+        emit(OP_IDIV, "dword [esp+" + to_string(saved) + "]");
+        if (r != REG_EAX) emit(OP_MOV, REG_NAMES[r], "eax");
+        if (!edxFree) emit(OP_POP, "edx");
+        if (!eaxFree) emit(OP_POP, "eax");
+        emit(OP_ADD, "esp", "8");
+    }
+
+    // 除以常数不用 idiv：±2^k 在 regs[0] 中移位，要一个临时寄存器；其他除数乘魔数。
+    // eax、edx 都可改写且另有寄存器时被除数算进该寄存器；否则被除数是变量就直接作操作数，
+    // 不是变量则算好后压栈，被占用的 eax、edx 临时保存。条件不满足返回 false，仍走 idiv
+    bool generateDivideConst(const FlatExpr& bin, const Reg* regs, int n, Scope& scope) {
+        int32_t d = flat.intValue(bin.b);
+        uint32_t m = d < 0 ? 0u - (uint32_t)d : (uint32_t)d;
+        Reg r = regs[0];
+        if (isPowerOfTwo(m)) {
+            if (m > 1 && n < 2) return false;
+            evalExpr(bin.a, regs, n, scope);
+            lowerDivPowerOfTwo(code, REG_NAMES[r], m > 1 ? REG_NAMES[regs[1]] : "", d);
+            return true;
+        }
+        if (m == 0) return false;
+        bool eaxFree = find(regs, regs + n, REG_EAX) != regs + n;
+        bool edxFree = find(regs, regs + n, REG_EDX) != regs + n;
+        bool isVar = flat.exprs[bin.a].kind == EXPR_VAR;
+        const Reg* x = regs + n;
+        if (eaxFree && edxFree) x = find_if(regs, regs + n, [](Reg v) { return v != REG_EAX && v != REG_EDX; });
+        if (x != regs + n && !isVar) {
+            Reg rest[REG_COUNT + 1];
+            rest[0] = *x;
+            int k = 1;
+            for (int j = 0; j < n; ++j) {
+                if (regs[j] != *x) rest[k++] = regs[j];
+            }
+            evalExpr(bin.a, rest, n, scope);
+            lowerDivMagic(code, REG_NAMES[*x], d);
+            if (r != REG_EDX) emit(OP_MOV, REG_NAMES[r], "edx");
+            return true;
+        }
+        // 有这种除法时 edx 不分给变量，变量的位置不会被下面的序列改写
+        string operand;
+        if (isVar) operand = varOperand(flat.exprs[bin.a].a, scope, true);
+        else {
+            evalExpr(bin.a, regs, n, scope);
+            emit(OP_PUSH, REG_NAMES[r]);
+        }
+        int saved = 0;
+        if (!eaxFree) { emit(OP_PUSH, "eax"); saved += 4; }
+        if (!edxFree) { emit(OP_PUSH, "edx"); saved += 4; }
+        if (!isVar) operand = "dword [esp+" + to_string(saved) + "]";
+        lowerDivMagic(code, operand, d);
+        if (r != REG_EDX) emit(OP_MOV, REG_NAMES[r], "edx");
+        if (!edxFree) emit(OP_POP, "edx");
+        if (!eaxFree) emit(OP_POP, "eax");
+        if (!isVar) emit(OP_LEA, "esp", "[esp+4]");
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // 解析命令行参数：选项之外依次为输入文件、输出文件
+    bool peepholeStats = false;
+    bool frameStats = false;
+    bool dumpIr = false;
+    int optLevel = 1;
+    int unrollFactor = 0;   // -funroll-loops[=N]，0 表示不做部分展开
+    int regParams = MAX_REG_PARAMS; // -mregparm=N，内部函数用寄存器传递的实参个数
+    int inlineLimit = 20;   // -finline-limit=N，内联的函数体节点数上限；-fno-inline 为 -1
+    bool licm = true;       // -fno-licm 关闭循环不变量外提
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--version") printVersionAndExit();
+        else if (arg == "--peephole-stats") peepholeStats = true;
+        else if (arg == "--frame-stats") frameStats = true;
+        else if (arg == "--dump-ir") dumpIr = true;
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2") optLevel = arg[2] - '0';
+        else if (arg == "-funroll-loops") unrollFactor = 4;
+        else if (arg.compare(0, 15, "-funroll-loops=") == 0) {
+            unrollFactor = atoi(arg.c_str() + 15);
+            if (unrollFactor < 1 || unrollFactor > 16) {
+                cerr << "展开倍数应在 1 到 16 之间: " << arg << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-fno-inline") inlineLimit = -1;
+        else if (arg == "-fno-licm") licm = false;
+        else if (arg.compare(0, 15, "-finline-limit=") == 0) {
+            inlineLimit = atoi(arg.c_str() + 15);
+            if (inlineLimit < 0 || arg.size() == 15) {
+                cerr << "内联阈值应为非负整数: " << arg << endl;
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 10, "-mregparm=") == 0) {
+            regParams = atoi(arg.c_str() + 10);
+            if (regParams < 0 || regParams > MAX_REG_PARAMS || arg.size() == 10) {
+                cerr << "寄存器参数个数应在 0 到 " << MAX_REG_PARAMS << " 之间: " << arg << endl;
+                return 1;
+            }
+        }
+        else files.push_back(arg);
+    }
+    if (files.empty() || files.size() > 2) {
+        cerr << "用法: " << argv[0] << " [--version] [-O0|-O1|-O2] [-funroll-loops[=N]] [-finline-limit=N] [-fno-inline] [-fno-licm] [-mregparm=N] [--dump-ir] [--peephole-stats] [--frame-stats] <输入文件.emg> [输出文件.asm]\n";
+        return 1;
+    }
+    string infile = files[0];
+    string outfile = files.size() > 1 ? files[1] : (infile + ".asm");
+
+    string source;
+    if (!readSourceFile(infile, source)) {
+        cerr << "无法打开输入文件: " << infile << endl;
+        return 1;
+    }
+
+    // 头文件搜索顺序：源文件目录、编译器所在目录下的 include、当前目录下的 include
+    HeaderCache headers;
+    headers.addSearchDir(dirName(argv[0]) + "include/");
+    headers.addSearchDir("include/");
+
+    TokenStream toks(source.data(), source.data() + source.size());
+    Parser parser(toks, headers, dirName(infile));
+    auto prog = parser.parse();
+
+    // -O0 不做优化；-O1 常量折叠、函数内联、循环不变量外提、SSA 上的常量传播与死代码删除、窥孔优化、乘除常数的指令选择、
+    // 尾调用改跳转、叶函数省略帧指针；
+    // -O2 另加复制传播与小循环的完全展开，SSA 各遍反复运行直到稳定；
+    // -funroll-loops 在 -O1 以上完全展开小循环并按倍数 N（默认 4）部分展开计数循环
+    // -finline-limit=N 调整内联的函数体大小上限（默认 20 个节点），-fno-inline 关闭内联，-fno-licm 关闭循环不变量外提
+    ConstantFolder folder(prog->arena);
+    if (optLevel > 0) folder.run(prog.get());
+    if (optLevel > 0 && inlineLimit >= 0) Inliner(prog->arena, inlineLimit).run(prog.get());
+    if (optLevel > 0 && (optLevel > 1 || unrollFactor > 0)) LoopUnroller(prog->arena, unrollFactor, true).run(prog.get());
+    if (optLevel > 0 && licm) LoopInvariantMotion(prog->arena).run(prog.get());
+    PassManager passes;
+    if (optLevel > 0) passes.add("sccp", runSccp);
+    if (optLevel > 1) passes.add("copy-propagation", runCopyPropagation);
+    if (optLevel > 0) passes.add("dce", runDce);
+    if (optLevel > 0 || dumpIr) {
+        SsaOptimizer ssa(prog->arena, passes, optLevel > 1 ? 4 : 1, dumpIr ? &cerr : nullptr);
+        if (ssa.run(prog.get())) folder.run(prog.get());
+    }
+
+    ofstream out(outfile);
+    if (!out) {
+        cerr << "无法打开输出文件: " << outfile << endl;
+        return 1;
+    }
+
+    CodeGenerator cg(out, optLevel > 0, regParams);
+    cg.generate(prog.get());
+    if (peepholeStats) cg.peepholeStats().printStats(cerr);
+    if (frameStats) cg.printFrameStats(cerr);
+
+    cout << "汇编代码已写入 " << outfile << endl;
+    cout << "现在执行: nasm -f elf32 " << outfile << " -o " << infile << ".o" << endl;
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#!/bin/sh
+# 基准对比：同一程序按几组编译选项分别编译，各运行 REPEAT 次取最短用时，
+# 并核对各组的退出码和输出与第一组相同。
+#
+# 用法: tests/bench/compare.sh <i686-emerging> <程序.emg> <选项组>...
+# 每个选项组是一个参数，如 "-O2" "-O2 -mregparm=0"。
+# 环境变量 NASM、LD 同 tests/run_programs.sh；OUT 为输出目录，默认 build/bench；REPEAT 默认 5
+
+compiler=${1:?用法: $0 <i686-emerging> <程序.emg> <选项组>...}
+src=${2:?用法: $0 <i686-emerging> <程序.emg> <选项组>...}
+shift 2
+here=$(dirname "$0")
+NASM=${NASM:-nasm -f elf32}
+LD=${LD:-ld -m elf_i386}
+OUT=${OUT:-build/bench}
+REPEAT=${REPEAT:-5}
+
+mkdir -p "$OUT" || exit 1
+$NASM "$here/../rt/putint.asm" -o "$OUT/putint.o" || exit 1
+
+name=$(basename "$src" .emg)
+first=
+status=0
+for flags in "$@"; do
+    base=$OUT/$name$(echo "$flags" | tr -d ' =')
+    "$compiler" $flags "$src" "$base.asm" > /dev/null || exit 1
+    $NASM "$base.asm" -o "$base.o" && $LD "$base.o" "$OUT/putint.o" -o "$base.bin" || exit 1
+    best=
+    k=0
+    while [ $k -lt "$REPEAT" ]; do
+        start=$(date +%s%N)
+        "$base.bin" > "$base.stdout"
+        code=$?
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+        k=$((k + 1))
+    done
+    echo "$code" >> "$base.stdout"
+    printf '%-32s %6d ms\n' "$name $flags" "$best"
+    if [ -z "$first" ]; then first=$base.stdout
+    elif ! cmp -s "$first" "$base.stdout"; then
+        echo "FAIL $name $flags: 退出码或输出与 \"$1\" 不同"
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,57 @@
+#!/bin/sh
+# 汇编检查：tests/asm 下的每个 .emg 按文件中的 "// flags: ..." 编译，再按其中的检查行核对生成的汇编。
+# "// check: 模式" 按顺序匹配，每个都要匹配在前一个 check 所匹配的行之后；
+# "// check-not: 模式" 要求在前后两个 check 所匹配的行之间（后面没有 check 时直到文件末尾）没有行匹配。
+# 模式是 awk 的扩展正则表达式，与汇编的整行比较。
+#
+# 用法: tests/check_asm.sh <i686-emerging> [输出目录]
+
+compiler=${1:?用法: $0 <i686-emerging> [输出目录]}
+out=${2:-build/tests}
+here=$(dirname "$0")
+
+mkdir -p "$out" || exit 1
+pass=0
+fail=0
+for src in "$here"/asm/*.emg; do
+    name=$(basename "$src" .emg)
+    flags=$(sed -n 's/^\/\/ flags: *//p' "$src" | tr -d '\r')
+    if ! "$compiler" $flags "$src" "$out/$name.asm" > /dev/null 2> "$out/$name.err"; then
+        echo "FAIL $name: 编译失败"; sed 's/^/    /' "$out/$name.err"
+        fail=$((fail + 1)); continue
+    fi
+    if awk -v name="$name" '
+        FNR == NR {
+            sub(/\r$/, "")
+            if (sub(/^\/\/ check: */, "")) { kind[++n] = "check"; pat[n] = $0 }
+            else if (sub(/^\/\/ check-not: */, "")) { kind[++n] = "not"; pat[n] = $0 }
+            next
+        }
+        BEGIN { d = 1 }
+        FNR == 1 { collect() }
+        # 收集下一个 check 之前的 check-not
+        function collect() {
+            nn = 0
+            while (d <= n && kind[d] == "not") nots[++nn] = pat[d++]
+        }
+        {
+            if (d <= n && $0 ~ pat[d]) { d++; collect(); next }
+            for (k = 1; k <= nn; ++k) {
+                if ($0 ~ nots[k]) {
+                    printf "FAIL %s: 第 %d 行匹配了 check-not: %s\n    %s\n", name, FNR, nots[k], $0
+                    bad = 1; exit
+                }
+            }
+        }
+        END {
+            if (bad) exit 1
+            if (d <= n) { printf "FAIL %s: 找不到 check: %s\n", name, pat[d]; exit 1 }
+        }' "$src" "$out/$name.asm"; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+    fi
+done
+
+echo "汇编检查: 通过 $pass，失败 $fail"
+[ "$fail" -eq 0 ]
@@ -0,0 +1,164 @@
+// 窥孔优化的汇编级测试：每个用例给出一段指令和窥孔之后应得到的指令，
+// 直接对 common/peephole.h 中的 Peephole 运行，不经过代码生成。
+// 重点是基本块内的存储转发与死存储（ruleStoreForward、ruleDeadStore）的边界：
+// cdq/idiv 隐式改写 eax、edx，函数返回前的局部变量存储，以及不参与分析的 [esp+N]。
+//
+// 用法: peephole_test，全部通过时退出码为 0
+
+#include "../common/peephole.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// 把一行汇编文本解析为 Instr，格式与 writeInstrs 的输出相同
+Instr parseInstr(const string& line) {
+    Instr in = { OP_RAW, CC_E, "", "", "" };
+    size_t sp = line.find(' ');
+    string name = line.substr(0, sp);
+    if (!name.empty() && name.back() == ':') {
+        in.op = OP_LABEL;
+        in.a = name.substr(0, name.size() - 1);
+        return in;
+    }
+    for (int op = OP_MOV; op < OP_RAW; ++op) {
+        if (op == OP_JCC || op == OP_SETCC) {
+            size_t n = string(OPCODE_NAMES[op]).size();
+            if (name.compare(0, n, OPCODE_NAMES[op]) != 0 || name == "jmp") continue;
+            for (int c = 0; c < CC_COUNT; ++c) {
+                if (name.compare(n, string::npos, COND_NAMES[c]) == 0) {
+                    in.op = (Opcode)op;
+                    in.cc = (Cond)c;
+                }
+            }
+        }
+        else if (name == OPCODE_NAMES[op]) {
+            in.op = (Opcode)op;
+        }
+        if (in.op != OP_RAW) break;
+    }
+    if (in.op == OP_RAW) {
+        in.a = line;
+        return in;
+    }
+    string* operands[3] = { &in.a, &in.b, &in.c };
+    size_t k = 0;
+    for (size_t i = sp; i != string::npos && k < 3; ++k) {
+        size_t end = line.find(", ", i + 1);
+        *operands[k] = line.substr(i + (k == 0 ? 1 : 2), end == string::npos ? string::npos : end - i - (k == 0 ? 1 : 2));
+        i = end;
+    }
+    return in;
+}
+
+// 用 "; " 分隔的指令序列
+vector<Instr> parseCode(const string& text) {
+    vector<Instr> code;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t end = text.find("; ", i);
+        if (end == string::npos) end = text.size();
+        code.push_back(parseInstr(text.substr(i, end - i)));
+        i = end + 2;
+    }
+    return code;
+}
+
+string formatCode(const vector<Instr>& code) {
+    ostringstream os;
+    writeInstrs(os, code);
+    string s = os.str();
+    string out;
+    for (size_t i = 0; i < s.size();) {
+        size_t end = s.find('\n', i);
+        size_t start = s.find_first_not_of(' ', i);
+        if (!out.empty()) out += "; ";
+        out += s.substr(start, end - start);
+        i = end + 1;
+    }
+    return out;
+}
+
+struct Case {
+    const char* name;
+    const char* input;
+    const char* expect;
+};
+
+const Case CASES[] = {
+    // ---- 跨 cdq/idiv 的存储转发 ----
+    { "idiv 改写 eax，之后不能从 eax 转发",
+      "mov [ebp-4], eax; cdq; idiv ecx; mov ebx, [ebp-4]; push ebx",
+      "mov [ebp-4], eax; cdq; idiv ecx; mov ebx, [ebp-4]; push ebx" },
+    { "cdq 改写 edx，之后不能从 edx 转发",
+      "mov [ebp-4], edx; mov eax, ebx; cdq; mov ecx, [ebp-4]; push ecx",
+      "mov [ebp-4], edx; mov eax, ebx; cdq; mov ecx, [ebp-4]; push ecx" },
+    { "cdq/idiv 不改写 ecx，可以跨过它们转发",
+      "mov [ebp-8], ecx; cdq; idiv ecx; mov ebx, [ebp-8]; push ebx",
+      "mov [ebp-8], ecx; cdq; idiv ecx; mov ebx, ecx; push ebx" },
+    { "idiv 的内存除数改读寄存器",
+      "mov [ebp-8], ecx; cdq; idiv dword [ebp-8]; push eax",
+      "mov [ebp-8], ecx; cdq; idiv ecx; push eax" },
+    { "立即数不能作 idiv 的除数",
+      "mov dword [ebp-8], 7; cdq; idiv dword [ebp-8]; push eax",
+      "mov dword [ebp-8], 7; cdq; idiv dword [ebp-8]; push eax" },
+
+    // ---- 返回前的死存储 ----
+    { "局部变量槽在 leave 之前的存储删除",
+      "mov [ebp-4], eax; leave; ret",
+      "leave; ret" },
+    { "局部变量槽在 ret 之前的存储删除",
+      "mov [ebp-12], ecx; mov eax, 1; ret",
+      "mov eax, 1; ret" },
+    { "参数槽 [ebp+N] 在返回前的存储保留",
+      "mov [ebp+8], eax; leave; ret",
+      "mov [ebp+8], eax; leave; ret" },
+    { "全局变量在返回前的存储保留",
+      "mov [g], eax; leave; ret",
+      "mov [g], eax; leave; ret" },
+    { "读取都改为转发后，返回前的存储删除",
+      "mov [ebp-4], ecx; mov eax, [ebp-8]; add eax, [ebp-4]; push eax; leave; ret",
+      "mov eax, [ebp-8]; add eax, ecx; push eax; leave; ret" },
+    { "返回前仍被读取的存储保留",
+      "mov [ebp-4], eax; add [ebp-4], ecx; leave; ret",
+      "mov [ebp-4], eax; add [ebp-4], ecx; leave; ret" },
+    { "被调用隔开的存储保留",
+      "mov [ebp-4], eax; call f; leave; ret",
+      "mov [ebp-4], eax; call f; leave; ret" },
+
+    // ---- [esp+N] 不参与分析 ----
+    { "[esp+N] 不做转发",
+      "mov [esp+4], eax; push ebx; mov ecx, [esp+4]; push ecx",
+      "mov [esp+4], eax; push ebx; mov ecx, [esp+4]; push ecx" },
+    { "[esp] 被覆盖也不当作死存储",
+      "mov [esp], eax; mov [esp], ebx; call f",
+      "mov [esp], eax; mov [esp], ebx; call f" },
+    { "[esp+N] 在返回前的存储保留",
+      "mov [esp+8], eax; leave; ret",
+      "mov [esp+8], eax; leave; ret" },
+    { "idiv 的 [esp+N] 除数保留",
+      "mov [esp+0], ecx; cdq; idiv dword [esp+0]; push eax",
+      "mov [esp+0], ecx; cdq; idiv dword [esp+0]; push eax" },
+};
+
+int main() {
+    int pass = 0, fail = 0;
+    for (const Case& c : CASES) {
+        vector<Instr> code = parseCode(c.input);
+        Peephole peephole;
+        peephole.run(code);
+        string got = formatCode(code);
+        if (got == c.expect) {
+            pass++;
+            continue;
+        }
+        cout << "FAIL " << c.name << "\n"
+             << "    输入: " << c.input << "\n"
+             << "    期望: " << c.expect << "\n"
+             << "    得到: " << got << "\n";
+        fail++;
+    }
+    cout << "窥孔测试: 通过 " << pass << "，失败 " << fail << endl;
+    return fail == 0 ? 0 : 1;
+}
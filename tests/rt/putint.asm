@@ -0,0 +1,39 @@
+; 测试程序用的运行时：putint(x) 以十进制输出 x 和换行。
+; 按 cdecl 调用，只改写 eax、ecx、edx，不依赖 C 库
+section .text
+global putint
+
+putint:
+    push ebp
+    mov ebp, esp
+    push ebx
+    sub esp, 16
+    lea ecx, [esp+15]
+    mov byte [ecx], 10
+    mov eax, [ebp+8]
+    test eax, eax
+    jns putint_digits
+    neg eax
+putint_digits:
+    xor edx, edx
+    mov ebx, 10
+    div ebx
+    add edx, 48
+    dec ecx
+    mov [ecx], dl
+    test eax, eax
+    jnz putint_digits
+    cmp dword [ebp+8], 0
+    jge putint_write
+    dec ecx
+    mov byte [ecx], 45
+putint_write:
+    lea edx, [esp+16]
+    sub edx, ecx
+    mov eax, 4
+    mov ebx, 1
+    int 0x80
+    add esp, 16
+    pop ebx
+    pop ebp
+    ret
@@ -0,0 +1,166 @@
+#!/bin/sh
+# 回归测试：tests/programs 下的每个 .emg 在 -O0、-O1、-O2 下编译、汇编、链接并运行，
+# 比较退出码（文件首行 "// expect: N"）和标准输出（同名 .out，没有时要求无输出）。
+# 文件中的 "// flags: ..." 行给出该程序额外的编译选项，环境变量 EMGFLAGS 追加到所有程序。
+# 此外生成上万项的长表达式和除以常数的对照程序，同样在各级别下运行；
+# 并检查头文件改动后旧的预编译缓存不再被使用。
+#
+# 用法: tests/run_programs.sh <i686-emerging> [输出目录]
+# 环境变量 NASM、LD 可替换汇编器和链接器，默认为 "nasm -f elf32" 和 "ld -m elf_i386"；
+# LEVELS 可替换要测试的优化级别
+
+compiler=${1:?用法: $0 <i686-emerging> [输出目录]}
+out=${2:-build/tests}
+here=$(dirname "$0")
+NASM=${NASM:-nasm -f elf32}
+LD=${LD:-ld -m elf_i386}
+LEVELS=${LEVELS:--O0 -O1 -O2}
+
+mkdir -p "$out" || exit 1
+$NASM "$here/rt/putint.asm" -o "$out/putint.o" || exit 1
+
+pass=0
+fail=0
+
+# check <源文件> <期望退出码> <期望输出文件> <编译选项...>
+check() {
+    src=$1; expect=$2; want=$3; shift 3
+    name=$(basename "$src" .emg)
+    tag=$(echo "$*" | tr -d ' =')
+    base=$out/$name$tag
+    if ! "$compiler" "$@" "$src" "$base.asm" > /dev/null 2> "$base.err"; then
+        echo "FAIL $name $*: 编译失败"; sed 's/^/    /' "$base.err"
+        fail=$((fail + 1)); return
+    fi
+    if ! $NASM "$base.asm" -o "$base.o" 2> "$base.err" || ! $LD "$base.o" "$out/putint.o" -o "$base.bin" 2> "$base.err"; then
+        echo "FAIL $name $*: 汇编或链接失败"; sed 's/^/    /' "$base.err"
+        fail=$((fail + 1)); return
+    fi
+    timeout 10 "$base.bin" > "$base.stdout"
+    status=$?
+    if [ "$status" != "$expect" ]; then
+        echo "FAIL $name $*: 退出码 $status，期望 $expect"
+        fail=$((fail + 1)); return
+    fi
+    if ! cmp -s "$want" "$base.stdout"; then
+        echo "FAIL $name $*: 输出不符"
+        diff "$want" "$base.stdout" | sed 's/^/    /'
+        fail=$((fail + 1)); return
+    fi
+    pass=$((pass + 1))
+}
+
+for src in "$here"/programs/*.emg; do
+    expect=$(sed -n '1s/^\/\/ expect: *\([0-9][0-9]*\).*/\1/p' "$src")
+    if [ -z "$expect" ]; then
+        echo "FAIL $src: 首行缺少 // expect: N"
+        fail=$((fail + 1)); continue
+    fi
+    flags=$(sed -n 's/^\/\/ flags: *//p' "$src" | tr -d '\r')
+    want=${src%.emg}.out
+    [ -f "$want" ] || want=/dev/null
+    for level in $LEVELS; do
+        check "$src" "$expect" "$want" $level $flags $EMGFLAGS
+    done
+done
+
+# 上万项的长表达式（常数链、全局变量链、循环条件、循环体、被内联的函数体）：
+# 各遍都不能随表达式长度递归，否则会栈溢出
+awk -v n=100000 '
+function chain(t,   k) {
+    for (k = 1; k < n; ++k) printf "%s + %s", t, (k % 16 ? "" : "\n        ")
+    printf "%s", t
+}
+BEGIN {
+    a = int((n + 6) / 7) * 7 + 2 * n + 1 + n
+    printf "// expect: %d\nint g = 1;\nint f(int x) {\n    return ", a % 256
+    chain("x")
+    printf ";\n}\nint main() {\n    int a;\n    int i;\n    a = "
+    chain("1")
+    printf ";\n    a = a - ("
+    chain("g")
+    printf ");\n    while (a < "
+    chain("g")
+    printf ") a = a + 7;\n    i = 0;\n    while (i < 2) {\n        a = a + i + "
+    chain("g")
+    printf ";\n        i = i + 1;\n    }\n    return a + f(g);\n}\n"
+}' > "$out/longexpr.emg" || exit 1
+expect=$(sed -n '1s/^\/\/ expect: *//p' "$out/longexpr.emg")
+for level in $LEVELS; do
+    check "$out/longexpr.emg" "$expect" /dev/null $level $EMGFLAGS
+done
+
+# 除以常数：-O0 用 idiv，-O1 起换成移位或乘魔数（lowerDivPowerOfTwo、lowerDivMagic）。
+# 除数取 ±1..±128，被除数含 INT_MIN、INT_MAX 和各除数倍数的邻近值，
+# 被除数是变量和算式各一个函数，结果与按截断除法算出的期望逐个比对
+awk -v n=128 -v prog="$out/divmagic.emg" -v want="$out/divmagic.out" '
+# 数值一律按 %.0f 输出：mawk 的 %d 会把 INT_MIN 截成 -2147483647
+function lit(v) {
+    if (v >= 0) return sprintf("%.0f", v)
+    return v == -2147483648 ? "0 - 2147483647 - 1" : sprintf("0 - %.0f", -v)
+}
+function call(f, x, d, args) {
+    if (x == -2147483648 && d == -1) return # 溢出，idiv 会出错
+    printf "    putint(%s(%s));\n", f, args > prog
+    printf "%.0f\n", int(x / d) + 0 > want # + 0 去掉 -0
+}
+BEGIN {
+    nf = split("-2147483648 -2147483647 -1073741825 -1000 -7 -1 0 1 7 1000 1073741823 2147483646 2147483647", fixed, " ")
+    print "// expect: 0\nextern int putint(int x);" > prog
+    for (m = 1; m <= n; ++m) {
+        printf "int q%d(int x) { return x / %d; }\n", m, m > prog
+        printf "int qm%d(int x) { return x / (0 - %d); }\n", m, m > prog
+        printf "int r%d(int x, int z) { return (x - z) / %d; }\n", m, m > prog
+        printf "int rm%d(int x, int z) { return (x - z) / (0 - %d); }\n", m, m > prog
+    }
+    print "int main() {" > prog
+    for (m = 1; m <= n; ++m) {
+        k = int(2147483647 / m) * m
+        cnt = 0
+        for (j = 1; j <= nf; ++j) xs[++cnt] = fixed[j] + 0
+        xs[++cnt] = k - 1; xs[++cnt] = k; xs[++cnt] = -k; xs[++cnt] = -k - 1
+        for (j = 1; j <= cnt; ++j) {
+            x = xs[j]
+            call("q" m, x, m, lit(x))
+            call("qm" m, x, -m, lit(x))
+            call("r" m, x, m, lit(x) ", 0")
+            call("rm" m, x, -m, lit(x) ", 0")
+        }
+    }
+    print "    return 0;\n}" > prog
+}' || exit 1
+for level in $LEVELS; do
+    check "$out/divmagic.emg" 0 "$out/divmagic.out" $level -fno-inline $EMGFLAGS
+done
+
+# 预编译头缓存：头文件改动后旧的 <头文件>.pch 必须作废。先编译一次生成缓存，再分别改动
+# 直接包含和嵌套包含的头文件（长度不变），结果应随之改变、缓存随之重写；
+# 把改动前的缓存放回去再编译，也不能读到旧的声明
+pch=$out/pch
+rm -rf "$pch" && mkdir -p "$pch" || exit 1
+printf '// expect: 30\n#include "outer.emg"\nint main() {\n    return A + B;\n}\n' > "$pch/pchuse.emg"
+printf '#include "inner.emg"\nint A = 10;\n' > "$pch/outer.emg"
+printf 'int B = 20;\n' > "$pch/inner.emg"
+pchfail() {
+    echo "FAIL pchuse: $1"
+    fail=$((fail + 1))
+}
+check "$pch/pchuse.emg" 30 /dev/null -O2 $EMGFLAGS
+if [ -f "$pch/outer.emg.pch" ] && [ -f "$pch/inner.emg.pch" ]; then
+    cp "$pch/outer.emg.pch" "$pch/outer.old"
+    cp "$pch/inner.emg.pch" "$pch/inner.old"
+    printf '#include "inner.emg"\nint A = 17;\n' > "$pch/outer.emg"
+    check "$pch/pchuse.emg" 37 /dev/null -O2 $EMGFLAGS
+    cmp -s "$pch/outer.old" "$pch/outer.emg.pch" && pchfail "outer.emg 改动后缓存未重写"
+    printf 'int B = 29;\n' > "$pch/inner.emg"
+    check "$pch/pchuse.emg" 46 /dev/null -O2 $EMGFLAGS
+    cmp -s "$pch/inner.old" "$pch/inner.emg.pch" && pchfail "inner.emg 改动后缓存未重写"
+    cp "$pch/outer.old" "$pch/outer.emg.pch"
+    cp "$pch/inner.old" "$pch/inner.emg.pch"
+    check "$pch/pchuse.emg" 46 /dev/null -O2 $EMGFLAGS
+else
+    pchfail "编译后没有生成 .pch 缓存"
+fi
+
+echo "程序测试: 通过 $pass，失败 $fail"
+[ "$fail" -eq 0 ]